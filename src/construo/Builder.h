@@ -1,12 +1,20 @@
 #ifndef _Builder_H_
 #define _Builder_H_
 
+#include <ostream>
 #include <string>
 #include <vector>
 
+#include <construo/CachedImageFile.h>
+#include <construo/ConstruoStats.h>
 #include <construo/ImagePatch.h>
+#include <construo/IngestJournal.h>
+#include <construo/KinTileCache.h>
+#include <construo/SubsampleFilter.h>
 #include <construo/Tree.h>
 
+#include <construo/vrui.h>
+
 
 namespace crusta {
 
@@ -31,6 +39,10 @@ public:
     };
     typedef std::vector<ImagePatchSource> ImagePatchSources;
 
+    BuilderBase() :
+        statsStream(NULL)
+    {
+    }
     virtual ~BuilderBase(){}
 
     ///add a source image patch to be integrated into the spheroid
@@ -38,20 +50,29 @@ public:
     {
         imagePatchSources = sources;
     }
+    ///request a JSON report of the counters of the update on the given stream
+    void setStatsStream(std::ostream* stream)
+    {
+        statsStream = stream;
+    }
 
     ///update the spheroid with the new patches
     virtual void update() = 0;
 
 protected:
     ImagePatchSources imagePatchSources;
+    ///stream receiving the counters of the update (NULL for none)
+    std::ostream* statsStream;
 };
 
 template <typename PixelParam>
 class Builder : public BuilderBase
 {
 public:
-    ///opens a spheroid file to which new additions are to be made
-    Builder(const std::string& spheroidName, const size_t tileSize[2]);
+    /** opens a spheroid file to which new additions are to be made. The nodes
+        of the update are processed using the given number of threads */
+    Builder(const std::string& spheroidName, const size_t tileSize[2],
+            int numThreads=1);
     ///closes the spheroid file and cleans up scratch data
     ~Builder();
 
@@ -61,48 +82,181 @@ protected:
     typedef Spheroid<PixelParam>  Globe;
     typedef TreeNode<PixelParam>  Node;
     typedef ImagePatch<PixelType> Patch;
+    typedef std::vector<Node*>    Nodes;
+    typedef std::vector<Nodes>    LevelNodes;
+
+    ///orders the nodes of a level by base patch and then along their paths
+    struct TreeOrder
+    {
+        bool operator()(const Node* a, const Node* b) const;
+    };
+
+    ///window of the source image covering a group of nearby samples
+    struct ImgBox
+    {
+        typedef std::vector<int> Indices;
+
+        ImgBox();
+        ///empty the box
+        void reset();
+        /** add a sample to the box if that doesn't grow the box beyond the
+            allowed size */
+        bool add(int index, const Point& p, const Point::Scalar allowed[2]);
+
+        Indices indices;
+        Point min;
+        Point max;
+    };
+    ///maximum number of image boxes accumulating samples at the same time
+    static const int MAX_OPEN_IMGBOXES = 4;
+
+    ///temporary buffers used to process a node. Each worker has its own set
+    struct Scratch
+    {
+        ///temporary buffer to hold scope refinements
+        Scope::Scalar* scopeBuf;
+        ///temporary buffer to hold sample positions for sourcing data
+        Point* sampleBuf;
+        ///temporary buffer to hold node data
+        PixelType* nodeDataBuf;
+        ///temporary buffer to hold node data that needs to be sampled
+        PixelType* nodeDataSampleBuf;
+        ///temporary buffer to hold the subsampling domain
+        PixelType* domainBuf;
+        ///temporary buffer used by the subsampling filter
+        double* filterBuf;
+        ///image boxes accumulating the samples of a node
+        ImgBox imgBoxes[MAX_OPEN_IMGBOXES];
+        ///temporary buffer to hold the image pixels of a box
+        std::vector<PixelType> imgBoxBuf;
+        ///counters of the work done with this scratch
+        ConstruoStats stats;
+    };
+    typedef std::vector<Scratch> Scratches;
+
+    ///kin of a node contributing to the node's subsampling domain
+    struct DomainKin
+    {
+        ///the kin node (NULL if there is none)
+        Node* node;
+        ///offset of the requested location inside the kin (see getKin)
+        int offset[2];
+        ///orientation of the kin relative to the node
+        size_t orientation;
+    };
+    typedef std::vector<DomainKin> DomainKins;
+
+    typedef std::vector<Threads::Thread*> WorkerThreads;
+    ///processes the work item of given index using the provided scratch
+    typedef void (Builder::*WorkProcessor)(size_t item, Scratch& scratch);
 
     ///subsamples data from the given node into that node's children
-    void subsampleChildren(Node* node);
+    void subsampleChildren(Node* node, Scratch& scratch);
     ///refines a node by adding the children to the build tree
     void refine(Node* node);
 
+    ///returns the identifier of a source image in the journal
+    std::string getJournalId(const ImagePatchSource& source) const;
+
+    ///returns the size of the pixels of a tile in bytes
+    uint64_t getTileBytes() const;
+
     ///flags all the ancestors for an update
     void flagAncestorsForUpdate(Node* node);
+    ///checks whether the in-memory tree exceeds its memory budget
+    bool isTreeOverBudget() const;
+    /** releases the subtrees hanging off the given one that don't have any
+        pending updates */
+    void trimTree(Node* node);
     ///sources the data for a node from an image patch and commits it to file
-    void sourceFinest(Node* node, Patch* imgPatch, size_t overlap);
-    ///traverse the tree to update it for given patch
+    ///\todo time it on polar stereographic and UTM sources against the old scan
+    void sourceFinest(Node* node, Patch* imgPatch, Scratch& scratch);
+    ///samples the image pixels of a box into the node's data and empties it
+    void sourceImgBox(Node* node, Patch* imgPatch, ImgBox& box,
+                      Scratch& scratch);
+    /** traverse the tree to update it for given patch. The nodes that need to
+        be sourced from the patch are queued as work items */
     int updateFiner(Node* node, Patch* imgPatch, Point::Scalar imgResolution);
     /** sources new patches to create new finer levels or update existing ones.
         Returns the depth of the update-tree for use during updating of the
-        coarse levels. */
+        coarse levels. If sourcing is disabled (see sourcePatch), only the
+        nodes of the coarse levels are flagged for updating */
     int updateFinestLevels(const ImagePatchSource& patchSource);
 
+    /** retrieve the kin (loading them if necessary) that make up the
+        subsampling domain of a node and append them to the work kin */
+    void gatherSubsamplingKin(Node* node);
     ///read all the finer data required for subsampling into a continuous region
-    void prepareSubsamplingDomain(Node* node);
-    /** traverse the tree to resample the next level of nodes that have had
-        finer data modified */
-    void updateCoarser(Node* node, int level);
+    void prepareSubsamplingDomain(Node* node, const DomainKin* kins,
+                                  Scratch& scratch);
+    ///resample a node from its finer data and commit it to file
+    void subsampleNode(Node* node, const DomainKin* kins, Scratch& scratch);
+    ///queue a node that has had finer data modified for resampling
+    void queueCoarser(Node* node);
     ///regenerate interior hierarchy nodes that have had finer levels updated
     void updateCoarserLevels(int depth);
 
+    ///work processor sourcing a queued node from the work patch
+    void sourceFinestItem(size_t item, Scratch& scratch);
+    ///work processor resampling a queued node from its finer data
+    void subsampleNodeItem(size_t item, Scratch& scratch);
+    /** process all the queued work nodes using the worker threads. The queue is
+        cleared once all the nodes have been processed */
+    void processWork(WorkProcessor processor);
+    ///worker thread function: processes queued nodes until there are none left
+    void* workerThreadFunc();
+    ///merge the counters of the scratches and report them
+    void reportStats(double seconds);
+
     ///new or existing database containing the hierarchy to be updated
     Globe* globe;
 
-    ///temporary buffer to hold scope refinements
-    Scope::Scalar* scopeBuf;
-    ///temporary buffer to hold sample positions for sourcing data
-    Point* sampleBuf;
-    ///temporary buffer to hold node data
-    PixelType* nodeDataBuf;
-    ///temporary buffer to hold node data that needs to be sampled before use
-    PixelType* nodeDataSampleBuf;
+    ///number of threads processing the nodes of an update
+    ///\todo time the speedup per thread count on a reference mosaic
+    int numThreads;
+    ///scratch buffers for each of the threads
+    Scratches scratches;
     ///size of the tiles to be generated/updated
     size_t tileSize[2];
-    ///temporary buffer to hold the subsampling domain
-    PixelType* domainBuf;
     ///size of the temporary subsampling domain
     size_t domainSize[2];
+    ///filter used to subsample the tiles of the coarser levels
+    SubsampleFilterType tileFilter;
+    /** sources the nodes of the traversed image patches. Disabled to recover
+        the state of patches that have been added before an interruption */
+    bool sourcePatch;
+    ///progress of the update, used to resume interrupted updates
+    IngestJournal journal;
+    ///number of tree nodes that may be held in memory (0 for unlimited)
+    size_t maxResidentNodes;
+
+    ///nodes queued for processing
+    Nodes workNodes;
+    ///subsampling domain kin of the queued nodes (16 per node)
+    DomainKins workKins;
+    ///image patch from which the queued nodes are sourced
+    Patch* workPatch;
+    ///function processing the queued nodes
+    WorkProcessor workProcessor;
+    ///index of the next queued node to be processed
+    size_t nextWorkItem;
+    ///index of the next scratch to be handed out to a worker
+    size_t nextScratch;
+    ///message of the first error encountered by the workers
+    std::string workError;
+    ///serializes access to the work queue
+    Threads::Mutex workMutex;
+
+    ///cache of source image blocks shared by all the images and workers
+    ImageBlockCache<PixelType> blockCache;
+
+    ///number of kin tiles cached while resampling the coarse levels
+    static const size_t KIN_CACHE_SIZE = 256;
+    /** the nodes flagged for update, by level. The coarse levels only resample
+        these instead of traversing the whole tree */
+    LevelNodes dirtyNodes;
+    ///cache of the kin tiles read to assemble the subsampling domains
+    KinTileCache<PixelParam> kinCache;
 
 //- Inherited from BuilderBase
 public:
@@ -1,7 +1,10 @@
 ///\todo fix GPL
 
-//#include "omp.h"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
 
+#include <construo/construoGlobals.h>
 #include <construo/ImageFileLoader.h>
 #include <construo/ImagePatch.h>
 #include <construo/SubsampleFilter.h>
@@ -10,7 +13,6 @@
 
 
 #define DYNAMIC_FILTER_TYPE SUBSAMPLEFILTER_PYRAMID
-#define STATIC_FILTER_TYPE  SUBSAMPLEFILTER_PYRAMID
 
 
 ///\todo remove
@@ -30,7 +32,14 @@ namespace crusta {
 
 template <typename PixelParam>
 Builder<PixelParam>::
-Builder(const std::string& spheroidName, const size_t size[2])
+Builder(const std::string& spheroidName, const size_t size[2],
+        int iNumThreads) :
+    numThreads(std::max(iNumThreads, 1)), sourcePatch(true), workPatch(NULL),
+    workProcessor(NULL),
+    nextWorkItem(0), nextScratch(0),
+    blockCache(size_t(std::max(CONSTRUO_SETTINGS.sourceCacheSize, 0)) *
+               1024*1024),
+    kinCache(KIN_CACHE_SIZE, size[0]*size[1])
 {
 ///\todo Frak this is retarded. Reason so far is the getRefinement from scope
 assert(size[0]==size[1]);
@@ -39,15 +48,46 @@ assert(size[0]==size[1]);
     tileSize[1] = size[1];
 
     globe = new Globe(spheroidName, tileSize);
+    journal.open(spheroidName);
+
+    //keep the workers from stalling on the tile writes
+    if (CONSTRUO_SETTINGS.tileWriteBuffer > 0)
+    {
+        globe->globeFile.startWriteBehind(
+            size_t(CONSTRUO_SETTINGS.tileWriteBuffer) * 1024*1024);
+    }
 
-    scopeBuf          = new Scope::Scalar[tileSize[0]*tileSize[1]*3];
-    sampleBuf         = new Point[tileSize[0]*tileSize[1]];
-    nodeDataBuf       = new PixelType[tileSize[0]*tileSize[1]];
-    nodeDataSampleBuf = new PixelType[tileSize[0]*tileSize[1]];
     //the -3 takes into account the shared edges of the tiles
     domainSize[0] = 4*tileSize[0] - 3;
     domainSize[1] = 4*tileSize[1] - 3;
-    domainBuf     = new PixelType[domainSize[0]*domainSize[1]];
+
+    tileFilter = CONSTRUO_SETTINGS.lanczosSubsampling ?
+                 SUBSAMPLEFILTER_LANCZOS5 : SUBSAMPLEFILTER_PYRAMID;
+    size_t filterSize = tileFilter==SUBSAMPLEFILTER_LANCZOS5 ?
+        SubsampleTileFilter<PixelType,
+                            SUBSAMPLEFILTER_LANCZOS5>::scratchSize(tileSize) :
+        SubsampleTileFilter<PixelType,
+                            SUBSAMPLEFILTER_PYRAMID>::scratchSize(tileSize);
+
+    /* estimate the footprint of a node from a base node, including the
+       vertices of its coverage */
+    const Node& base = globe->baseNodes.front();
+    size_t nodeSize  = sizeof(Node) +
+                       base.coverage.getVertices().size()*sizeof(Point);
+    size_t budget    = std::max(CONSTRUO_SETTINGS.treeMemoryBudget, 0);
+    maxResidentNodes = budget*1024*1024 / nodeSize;
+
+    scratches.resize(numThreads);
+    for (typename Scratches::iterator it=scratches.begin();
+         it!=scratches.end(); ++it)
+    {
+        it->scopeBuf          = new Scope::Scalar[tileSize[0]*tileSize[1]*3];
+        it->sampleBuf         = new Point[tileSize[0]*tileSize[1]];
+        it->nodeDataBuf       = new PixelType[tileSize[0]*tileSize[1]];
+        it->nodeDataSampleBuf = new PixelType[tileSize[0]*tileSize[1]];
+        it->domainBuf         = new PixelType[domainSize[0]*domainSize[1]];
+        it->filterBuf         = new double[filterSize];
+    }
 }
 
 template <typename PixelParam>
@@ -55,17 +95,22 @@ Builder<PixelParam>::
 ~Builder()
 {
     delete globe;
-    delete[] scopeBuf;
-    delete[] sampleBuf;
-    delete[] nodeDataBuf;
-    delete[] nodeDataSampleBuf;
-    delete[] domainBuf;
+    for (typename Scratches::iterator it=scratches.begin();
+         it!=scratches.end(); ++it)
+    {
+        delete[] it->scopeBuf;
+        delete[] it->sampleBuf;
+        delete[] it->nodeDataBuf;
+        delete[] it->nodeDataSampleBuf;
+        delete[] it->domainBuf;
+        delete[] it->filterBuf;
+    }
 }
 
 
 template <typename PixelParam>
 void Builder<PixelParam>::
-subsampleChildren(Node* node)
+subsampleChildren(Node* node, Scratch& scratch)
 {
     typedef GlobeData<PixelParam> gd;
     typedef PixelOps<PixelType>   po;
@@ -74,7 +119,11 @@ subsampleChildren(Node* node)
     //read in the node's existing data from file
     typename gd::File* file =
         node->globeFile->getPatch(node->treeIndex.patch());
-    file->readTile(node->tileIndex, nodeDataSampleBuf);
+    {
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+            ConstruoStats::STAGE_READ_TILE, getTileBytes());
+        file->readTile(node->tileIndex, scratch.nodeDataSampleBuf);
+    }
 
     const PixelType& nodata = node->globeFile->getNodata();
 
@@ -84,11 +133,11 @@ subsampleChildren(Node* node)
     const int halfSize[2] = { int((tileSize[0]+1)>>1), int((tileSize[1]+1)>>1) };
     for (int i=0; i<4; ++i)
     {
-//        #pragma omp parallel for
         for (int y=0; y<halfSize[1]; ++y)
         {
-            PixelType* wbase = nodeDataBuf + y*2*tileSize[0];
-            PixelType* rbase = nodeDataSampleBuf + y*tileSize[0] + offsets[i];
+            PixelType* wbase = scratch.nodeDataBuf + y*2*tileSize[0];
+            PixelType* rbase = scratch.nodeDataSampleBuf + y*tileSize[0] +
+                               offsets[i];
             for (int x=0; x<halfSize[0]; ++x, wbase+=2, ++rbase)
             {
                 wbase[0] = rbase[0];
@@ -110,11 +159,15 @@ subsampleChildren(Node* node)
         }
         //write the subsampled data to the child
         Node& child = node->children[i];
-        child.data = nodeDataBuf;
+        child.data = scratch.nodeDataBuf;
         typename gd::TileHeader header = child.getTileHeader();
         typename gd::File* childFile =
             child.globeFile->getPatch(child.treeIndex.patch());
-        childFile->writeTile(child.tileIndex, header, child.data);
+        {
+            ConstruoStats::ScopedTimer timer(scratch.stats,
+                ConstruoStats::STAGE_WRITE_TILE, getTileBytes());
+            childFile->writeTile(child.tileIndex, header, child.data);
+        }
         child.data = NULL;
     }
 }
@@ -144,7 +197,8 @@ refine(Node* node)
 ///\todo should I dump default-value-initialized to file here?
             childIndices[i]  = child->tileIndex;
         }
-        subsampleChildren(node);
+        //refinement happens during the serial traversal: use the first scratch
+        subsampleChildren(node, scratches[0]);
         //link the parent with the new children in the file
         file->writeTile(node->tileIndex, childIndices);
 ///\todo this is debugging code to check tree consistency
@@ -152,6 +206,26 @@ refine(Node* node)
     }
 }
 
+template <typename PixelParam>
+std::string Builder<PixelParam>::
+getJournalId(const ImagePatchSource& source) const
+{
+    //any of the parameters affects the sourced data
+    std::ostringstream oss;
+    oss.precision(17);
+    oss << source.pixelOffset << " " << source.pixelScale << " " <<
+           (source.pointSampled ? "point" : "area") << " [" << source.nodata <<
+           "] " << source.path;
+    return oss.str();
+}
+
+template <typename PixelParam>
+uint64_t Builder<PixelParam>::
+getTileBytes() const
+{
+    return uint64_t(tileSize[0]) * tileSize[1] * sizeof(PixelType);
+}
+
 template <typename PixelParam>
 void Builder<PixelParam>::
 flagAncestorsForUpdate(Node* node)
@@ -163,133 +237,228 @@ ConstruoVisualizer::addPrimitive(GL_LINES, node->coverage, flagAncestorsForUpdat
 ConstruoVisualizer::show();
 #endif //DEBUG_FLAGANCESTORSFORUPDATE
         node->mustBeUpdated = true;
+
+        //record the node for the update of its level
+        size_t level = node->treeIndex.level();
+        if (dirtyNodes.size() <= level)
+            dirtyNodes.resize(level+1);
+        dirtyNodes[level].push_back(node);
+
         node = node->parent;
     }
 }
 
-struct ImgBox
+template <typename PixelParam>
+bool Builder<PixelParam>::
+isTreeOverBudget() const
 {
-    typedef std::vector<int> Indices;
+    return maxResidentNodes!=0 &&
+           TreeNodeStats::numResident>maxResidentNodes;
+}
 
-    ImgBox()
+template <typename PixelParam>
+void Builder<PixelParam>::
+trimTree(Node* node)
+{
+    /* all the data of nodes without pending updates is in the file, while the
+       flags of the others would be lost */
+    if (!node->mustBeUpdated)
     {
-        min[0] = min[1] =  HUGE_VAL;
-        max[0] = max[1] = -HUGE_VAL;
+        node->releaseChildren();
+        return;
     }
-    bool add(int index, const Point& p, const Point::Scalar allowed[2])
+    if (node->children == NULL)
+        return;
+
+    bool hasPendingChildren = false;
+    for (int i=0; i<4; ++i)
     {
-        //tentatively expand the box to accommodate the new point
-        Point newMin, newMax;
-        newMin[0] = std::min(min[0], p[0]);
-        newMin[1] = std::min(min[1], p[1]);
-        newMax[0] = std::max(max[0], p[0]);
-        newMax[1] = std::max(max[1], p[1]);
+        trimTree(&node->children[i]);
+        hasPendingChildren |= node->children[i].mustBeUpdated;
+    }
+    /* the node itself still needs resampling, but that reloads the children
+       it requires through getKin */
+    if (!hasPendingChildren)
+        node->releaseChildren();
+}
 
-        //check that the box doesn't get too bloated
-        if ((newMax[0] - newMin[0]) > allowed[0] ||
-            (newMax[1] - newMin[1]) > allowed[1])
-        {
-            return false;
-        }
+template <typename PixelParam>
+Builder<PixelParam>::ImgBox::
+ImgBox()
+{
+    reset();
+}
+
+template <typename PixelParam>
+void Builder<PixelParam>::ImgBox::
+reset()
+{
+    indices.clear();
+    min[0] = min[1] =  HUGE_VAL;
+    max[0] = max[1] = -HUGE_VAL;
+}
 
-        //add the new point if all is okay
-        indices.push_back(index);
-        min = newMin;
-        max = newMax;
-        return true;
+template <typename PixelParam>
+bool Builder<PixelParam>::ImgBox::
+add(int index, const Point& p, const Point::Scalar allowed[2])
+{
+    //tentatively expand the box to accommodate the new point
+    Point newMin, newMax;
+    newMin[0] = std::min(min[0], p[0]);
+    newMin[1] = std::min(min[1], p[1]);
+    newMax[0] = std::max(max[0], p[0]);
+    newMax[1] = std::max(max[1], p[1]);
+
+    //check that the box doesn't get too bloated
+    if ((newMax[0] - newMin[0]) > allowed[0] ||
+        (newMax[1] - newMin[1]) > allowed[1])
+    {
+        return false;
     }
 
-    Indices indices;
-    Point min;
-    Point max;
-};
-typedef std::vector<ImgBox> ImgBoxes;
+    //add the new point if all is okay
+    indices.push_back(index);
+    min = newMin;
+    max = newMax;
+    return true;
+}
 
 
-///\todo overlap is apparently unused here
 template <typename PixelParam>
 void Builder<PixelParam>::
-sourceFinest(Node* node, Patch* imgPatch, size_t overlap)
+sourceFinest(Node* node, Patch* imgPatch, Scratch& scratch)
 {
     typedef GlobeData<PixelParam> gd;
 
-    ImgBoxes imgBoxes;
-    const int*        imgSize  = imgPatch->image->getSize();
-    const PixelType& imgNodata = imgPatch->image->getNodata();
+    const int* imgSize = imgPatch->image->getSize();
     const Point::Scalar allowedBoxSize[2] = { Point::Scalar(imgSize[0]>>1), Point::Scalar(imgSize[1]>>1) };
 
     //transform all the sample points into the image space
-    node->scope.getRefinement(tileSize[0], scopeBuf);
+    const int numSamples = tileSize[0]*tileSize[1];
+    {
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+                                         ConstruoStats::STAGE_TRANSFORM);
+        node->scope.getRefinement(tileSize[0], scratch.scopeBuf);
+        Converter::cartesianToSpherical(numSamples, scratch.scopeBuf,
+                                        scratch.sampleBuf);
+        imgPatch->transform->worldToImage(scratch.sampleBuf,
+                                          scratch.sampleBuf, numSamples);
+    }
 
-    for (int i=0; i<int(tileSize[0]*tileSize[1]); ++i)
+    //prepare the node's data buffer
+    node->data = scratch.nodeDataBuf;
+    typename gd::File* file =
+        node->globeFile->getPatch(node->treeIndex.patch());
     {
-        Point& p = sampleBuf[i];
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+            ConstruoStats::STAGE_READ_TILE, getTileBytes());
+        file->readTile(node->tileIndex, node->data);
+    }
 
-        //convert the scope sample to a spherical one
-        const Scope::Scalar* curScope = &scopeBuf[i*3];
-        p = Converter::cartesianToSpherical(
-            Scope::Vertex(curScope[0], curScope[1], curScope[2]));
-        //transform the sample into the image space
-        p = imgPatch->transform->worldToImage(p);
+    /* group the samples into image boxes. The samples are generated in
+       scanline order and consecutive ones map to nearby image pixels, such
+       that the box that took the previous sample most likely takes the next
+       one too. The open boxes are thus kept ordered by when they were last
+       extended. When none of them fits a sample, the least recently extended
+       box is sampled and reused */
+    ImgBox* boxes = scratch.imgBoxes;
+    int numOpen   = 0;
+    for (int i=0; i<numSamples; ++i)
+    {
+        const Point& p = scratch.sampleBuf[i];
 
         //make sure the sample is valid
         if (p[0]<0 || p[0]>imgSize[0]-1 || p[1]<0 || p[1]>imgSize[1]-1)
             continue;
 
-        //insert the sample into an image box
-        bool wasInserted = false;
-        for (ImgBoxes::iterator it=imgBoxes.begin(); it!=imgBoxes.end(); ++it)
+        int box = 0;
+        while (box<numOpen && !boxes[box].add(i, p, allowedBoxSize))
+            ++box;
+
+        if (box == numOpen)
         {
-            if (it->add(i, p, allowedBoxSize))
-            {
-                wasInserted = true;
-                break;
-            }
+            if (numOpen == MAX_OPEN_IMGBOXES)
+                sourceImgBox(node, imgPatch, boxes[--numOpen], scratch);
+            box = numOpen++;
+            boxes[box].add(i, p, allowedBoxSize);
         }
-        //add the sample to a new box if not already inserted
-        if (!wasInserted)
+
+        //move the extended box to the front
+        for (; box>0; --box)
         {
-            imgBoxes.push_back(ImgBox());
-            imgBoxes.back().add(i, p, allowedBoxSize);
+            std::swap(boxes[box].indices, boxes[box-1].indices);
+            std::swap(boxes[box].min,     boxes[box-1].min);
+            std::swap(boxes[box].max,     boxes[box-1].max);
         }
     }
 
-    //prepare the node's data buffer
-    node->data = nodeDataBuf;
-    typename gd::File* file =
-        node->globeFile->getPatch(node->treeIndex.patch());
-    file->readTile(node->tileIndex, node->data);
+    //sample the remaining boxes
+    for (int box=0; box<numOpen; ++box)
+        sourceImgBox(node, imgPatch, boxes[box], scratch);
+
+    {
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+            ConstruoStats::STAGE_WRITE_TILE, getTileBytes());
+
+        //prepare the header
+        typename gd::TileHeader header = node->getTileHeader();
 
-    //go through all the image boxes and sample them
+        //commit the data to file
+        file->writeTile(node->tileIndex, header, node->data);
+    }
+
+#if 0
+{
+static const float color[3] = { 0.2f, 1.0f, 0.1f };
+ConstruoVisualizer::addScopeRefinement(tileSize[0], scratch.scopeBuf, color);
+ConstruoVisualizer::show();
+}
+#endif
+    node->data = NULL;
+///\todo this is debugging code to check tree consistency
+//verifyQuadtreeFile(node);
+}
+
+template <typename PixelParam>
+void Builder<PixelParam>::
+sourceImgBox(Node* node, Patch* imgPatch, ImgBox& box, Scratch& scratch)
+{
+    const PixelType& imgNodata   = imgPatch->image->getNodata();
     const PixelType& globeNodata = node->globeFile->getNodata();
-//    #pragma omp parallel for
-    for (int box=0; box<static_cast<int>(imgBoxes.size()); ++box)
-    {
-        const ImgBox& ib = imgBoxes[box];
-        //read the corresponding image piece
-        int rectOrigin[2];
-        int rectSize[2];
-        for (int i=0; i<2; i++)
-        {
+
+    //read the corresponding image piece
+    int rectOrigin[2];
+    int rectSize[2];
+    for (int i=0; i<2; i++)
+    {
 ///\todo abstract the sampler assume bilinear interpolation here
-            rectOrigin[i] = static_cast<int>(Math::floor(ib.min[i]));
-            rectSize[i]   = static_cast<int>(Math::ceil (ib.max[i])) -
-                            rectOrigin[i] + 1;
-        }
-        PixelType* rectBuffer = new PixelType[rectSize[0] * rectSize[1]];
+        rectOrigin[i] = static_cast<int>(Math::floor(box.min[i]));
+        rectSize[i]   = static_cast<int>(Math::ceil (box.max[i])) -
+                        rectOrigin[i] + 1;
+    }
+    size_t rectLen = size_t(rectSize[0]) * rectSize[1];
+    if (scratch.imgBoxBuf.size() < rectLen)
+        scratch.imgBoxBuf.resize(rectLen);
+    PixelType* rectBuffer = &scratch.imgBoxBuf.front();
+    {
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+            ConstruoStats::STAGE_READ_IMAGE, rectLen*sizeof(PixelType));
         imgPatch->image->readRectangle(rectOrigin, rectSize, rectBuffer);
+    }
 
-        //sample the points
-//        #pragma omp parallel for
-        typedef SubsampleFilter<PixelType, DYNAMIC_FILTER_TYPE> Filter;
-        for (int i=0; i<static_cast<int>(ib.indices.size()); ++i)
-        {
-            const int& idx          = ib.indices[i];
-            double at[2]            = { sampleBuf[idx][0], sampleBuf[idx][1] };
-            PixelType& defaultValue = node->data[idx];
+    //sample the points
+    typedef SubsampleFilter<PixelType, DYNAMIC_FILTER_TYPE> Filter;
+    ConstruoStats::ScopedTimer timer(scratch.stats,
+                                     ConstruoStats::STAGE_SAMPLE);
+    for (int i=0; i<static_cast<int>(box.indices.size()); ++i)
+    {
+        const int& idx          = box.indices[i];
+        double at[2]            = { scratch.sampleBuf[idx][0],
+                                    scratch.sampleBuf[idx][1] };
+        PixelType& defaultValue = node->data[idx];
 
-            node->data[idx] = Filter::sample(rectBuffer, rectOrigin, at,
-                rectSize, imgNodata, defaultValue, globeNodata);
+        node->data[idx] = Filter::sample(rectBuffer, rectOrigin, at,
+            rectSize, imgNodata, defaultValue, globeNodata);
 
 #if DEBUG_SOURCEFINEST
 ConstruoVisualizer::Floats scopeSample;
@@ -304,60 +473,9 @@ float scopeSampleColor[3] = {
 ConstruoVisualizer::addPrimitive(GL_POINTS, scopeSample, scopeSampleColor);
 ConstruoVisualizer::show();
 #endif //DEBUG_SOURCEFINEST
-        }
-        //clean up the temporary image uffer
-        delete[] rectBuffer;
     }
 
-    //prepare the header
-    typename gd::TileHeader header = node->getTileHeader();
-
-    //commit the data to file
-    file->writeTile(node->tileIndex, header, node->data);
-
-#if 0
-{
-static const float color[3] = { 0.2f, 1.0f, 0.1f };
-ConstruoVisualizer::addScopeRefinement(tileSize[0], scopeBuf, color);
-ConstruoVisualizer::show();
-}
-#endif
-    node->data = NULL;
-
-    if (node->parent != NULL)
-    {
-#if DEBUG_FLAGANCESTORSFORUPDATE
-flagAncestorsForUpdateColor[0] = (float)rand() / RAND_MAX;
-flagAncestorsForUpdateColor[1] = (float)rand() / RAND_MAX;
-flagAncestorsForUpdateColor[2] = (float)rand() / RAND_MAX;
-#endif //DEBUG_FLAGANCESTORSFORUPDATE
-        //make sure that the parent dependent on this new data is also updated
-        flagAncestorsForUpdate(node->parent);
-
-///\TODO Proper filtering will need this, but it is quite broken right now
-#if 0
-        //we musn't forget to update all the adjacent non-sibling nodes either
-/**\todo DANGER: there exist valence 5 corners. Need to account for reaching 2
-different nodes on corners depending on which neighbor we traverse first. Need
-to adjust getKin and its API to allow this */
-        static const int offsets[4][3][2] = {
-            { {-1, 0}, {-1,-1}, { 0,-1} }, { { 0,-1}, { 1,-1}, { 1, 0} },
-            { {-1, 0}, {-1, 1}, { 0, 1} }, { { 0, 1}, { 1, 1}, { 1, 0} }
-        };
-        int off[2];
-        Node* kin;
-        for (size_t i=0; i<3; ++i)
-        {
-            off[0] = offsets[node->treeIndex.child][i][0];
-            off[1] = offsets[node->treeIndex.child][i][1];
-            node->parent->getKin(kin, off);
-            if (kin != NULL)
-                flagAncestorsForUpdate(kin);
-        }
-#endif
-    }
-///\todo this is debugging code to check tree consistency
-//verifyQuadtreeFile(node);
+    box.reset();
 }
 
 template <typename PixelParam>
@@ -391,12 +509,56 @@ ConstruoVisualizer::peek();
             depth = std::max(updateFiner(&node->children[i], imgPatch,
                                          imgResolution), depth);
         }
+
+        /* the children have been traversed. Source the queued nodes such that
+           their subtrees can be released if the tree has grown too large */
+        if (isTreeOverBudget())
+        {
+            processWork(&Builder::sourceFinestItem);
+            for (size_t i=0; i<4; ++i)
+                trimTree(&node->children[i]);
+        }
         return depth;
     }
 
-    //this node has the appropriate resolution
+    //this node has the appropriate resolution: queue it for sourcing
 //ConstruoVisualizer::show();
-    sourceFinest(node, imgPatch, overlap);
+    if (sourcePatch)
+        workNodes.push_back(node);
+
+    if (node->parent != NULL)
+    {
+#if DEBUG_FLAGANCESTORSFORUPDATE
+flagAncestorsForUpdateColor[0] = (float)rand() / RAND_MAX;
+flagAncestorsForUpdateColor[1] = (float)rand() / RAND_MAX;
+flagAncestorsForUpdateColor[2] = (float)rand() / RAND_MAX;
+#endif //DEBUG_FLAGANCESTORSFORUPDATE
+        //make sure that the parent dependent on the new data is also updated
+        flagAncestorsForUpdate(node->parent);
+
+///\TODO Proper filtering will need this, but it is quite broken right now
+#if 0
+        //we musn't forget to update all the adjacent non-sibling nodes either
+/**\todo DANGER: there exist valence 5 corners. Need to account for reaching 2
+different nodes on corners depending on which neighbor we traverse first. Need
+to adjust getKin and its API to allow this */
+        static const int offsets[4][3][2] = {
+            { {-1, 0}, {-1,-1}, { 0,-1} }, { { 0,-1}, { 1,-1}, { 1, 0} },
+            { {-1, 0}, {-1, 1}, { 0, 1} }, { { 0, 1}, { 1, 1}, { 1, 0} }
+        };
+        int off[2];
+        Node* kin;
+        for (size_t i=0; i<3; ++i)
+        {
+            off[0] = offsets[node->treeIndex.child][i][0];
+            off[1] = offsets[node->treeIndex.child][i][1];
+            node->parent->getKin(kin, off);
+            if (kin != NULL)
+                flagAncestorsForUpdate(kin);
+        }
+#endif
+    }
+
     return node->treeIndex.level();
 }
 
@@ -410,6 +572,9 @@ updateFinestLevels(const ImagePatchSource& patchSource)
     Patch patch(patchSource.path,
                 patchSource.pixelOffset, patchSource.pixelScale,
                 patchSource.nodata, patchSource.pointSampled);
+    //serve the pixels of the image through the block cache
+    if (blockCache.getBudget() != 0)
+        patch.image = new CachedImageFile<PixelType>(patch.image, blockCache);
 
 ///\todo remove
 #if DEBUG_SOURCE_FINEST
@@ -466,10 +631,15 @@ ConstruoVisualizer::show();
     imgResolution *= Point::Scalar(Math::sqrt(2.0));
 
     //iterate over all the spheroid's base patches to determine overlap
+    workPatch = &patch;
     for (typename Globe::BaseNodes::iterator bIt=globe->baseNodes.begin();
          bIt!=globe->baseNodes.end(); ++bIt)
     {
         depth = std::max(updateFiner(&(*bIt), &patch, imgResolution), depth);
+        //source the nodes of the base patch that were queued by the traversal
+        processWork(&Builder::sourceFinestItem);
+        if (isTreeOverBudget())
+            trimTree(&(*bIt));
 
         std::cout << ".";
         std::cout.flush();
@@ -477,6 +647,7 @@ ConstruoVisualizer::show();
 //verifyQuadtreeFile(&(*bIt));
 //ConstruoVisualizer::show();
     }
+    workPatch = NULL;
     std::cout << " done\n\n";
     std::cout.flush();
 
@@ -485,7 +656,31 @@ ConstruoVisualizer::show();
 
 template <typename PixelParam>
 void Builder<PixelParam>::
-prepareSubsamplingDomain(Node* node)
+gatherSubsamplingKin(Node* node)
+{
+    /* specify the order of lower-level nodes manually such that the inner nodes
+       are added last and overwrite the edge value (e.g. if one of the
+       neighboring nodes does not exist or has no valid values, we want to use
+       the inner node ones instead */
+    static const int offsets[16][2] = {
+        {-1,-1}, { 0,-1}, { 1,-1}, { 2,-1}, {-1, 2}, { 0, 2}, { 1, 2}, { 2, 2},
+        {-1, 1}, {-1, 0}, { 2, 1}, { 2, 0}, { 0, 0}, { 1, 0}, { 0, 1}, { 1, 1}
+    };
+    for (int i=0; i<16; ++i)
+    {
+        /* retrieving the kin may load missing parts of the tree and must thus
+           not happen concurrently with the processing of the nodes */
+        DomainKin kin;
+        kin.offset[0] = offsets[i][0];
+        kin.offset[1] = offsets[i][1];
+        node->getKin(kin.node, kin.offset, true, 1, &kin.orientation);
+        workKins.push_back(kin);
+    }
+}
+
+template <typename PixelParam>
+void Builder<PixelParam>::
+prepareSubsamplingDomain(Node* node, const DomainKin* kins, Scratch& scratch)
 {
     typedef GlobeData<PixelParam> gd;
 
@@ -494,10 +689,7 @@ ConstruoVisualizer::addPrimitive(GL_LINES, node->coverage);
 ConstruoVisualizer::show();
 #endif //DEBUG_PREPARESUBSAMPLINGDOMAIN
 
-    /* specify the order of lower-level nodes manually such that the inner nodes
-       are added last and overwrite the edge value (e.g. if one of the
-       neighboring nodes does not exist or has no valid values, we want to use
-       the inner node ones instead */
+    //offsets of the kin in the domain, same order as in gatherSubsamplingKin
     static const int offsets[16][2] = {
         {-1,-1}, { 0,-1}, { 1,-1}, { 2,-1}, {-1, 2}, { 0, 2}, { 1, 2}, { 2, 2},
         {-1, 1}, {-1, 0}, { 2, 1}, { 2, 0}, { 0, 0}, { 1, 0}, { 0, 1}, { 1, 1}
@@ -505,18 +697,17 @@ ConstruoVisualizer::show();
     for (int i=0; i<16; ++i)
     {
     //- retrieve the kin
-        Node* kin         = NULL;
-        PixelType* domain = domainBuf + (tileSize[1]-1)*domainSize[0] +
-                             tileSize[0]-1;
-
-        int domainOff[2] = {offsets[i][0], offsets[i][1]};
-        int nodeOff[2]   = {offsets[i][0], offsets[i][1]};
-        size_t kinO;
-        node->getKin(kin, nodeOff, true, 1, &kinO);
+        Node* kin         = kins[i].node;
+        PixelType* domain = scratch.domainBuf + (tileSize[1]-1)*domainSize[0] +
+                            tileSize[0]-1;
+
+        int domainOff[2]   = {offsets[i][0], offsets[i][1]};
+        const int* nodeOff = kins[i].offset;
+        size_t kinO        = kins[i].orientation;
 #if DEBUG_PREPARESUBSAMPLINGDOMAIN
 const static float scopeRefColor[3] = { 0.3f, 0.8f, 0.3f };
-kin->scope.getRefinement(tileSize[0], scopeBuf);
-ConstruoVisualizer::addScopeRefinement(tileSize[0], scopeBuf, scopeRefColor);
+kin->scope.getRefinement(tileSize[0], scratch.scopeBuf);
+ConstruoVisualizer::addScopeRefinement(tileSize[0], scratch.scopeBuf, scopeRefColor);
 ConstruoVisualizer::show();
 #endif //DEBUG_PREPARESUBSAMPLINGDOMAIN
 
@@ -539,13 +730,22 @@ Note: getKin across patches seem to be broken: e.g. offset==3 returned. */
             if (nodeOff[0]==0 && nodeOff[1]==0)
             {
                 //we're grabbing data from a same leveled kin
-                file->readTile(kin->tileIndex, nodeDataBuf);
-                data = nodeDataBuf;
+                ConstruoStats::ScopedTimer timer(scratch.stats,
+                    ConstruoStats::STAGE_READ_TILE, getTileBytes());
+                kinCache.readTile(file, kin->treeIndex.patch(), kin->tileIndex,
+                                  scratch.nodeDataBuf);
+                data = scratch.nodeDataBuf;
             }
             else
             {
                 //need to sample coarser level node as the kin replacement
-                file->readTile(kin->tileIndex, nodeDataSampleBuf);
+                {
+                    ConstruoStats::ScopedTimer timer(scratch.stats,
+                        ConstruoStats::STAGE_READ_TILE, getTileBytes());
+                    kinCache.readTile(file, kin->treeIndex.patch(),
+                                      kin->tileIndex,
+                                      scratch.nodeDataSampleBuf);
+                }
                 //determine the resample step size
                 double scale = 1;
                 for (size_t i=kin->treeIndex.level();
@@ -559,9 +759,8 @@ Note: getKin across patches seem to be broken: e.g. offset==3 returned. */
                 int rectOrigin[2] = {0,0};
                 int rectSize[2] = {int(tileSize[0]), int(tileSize[1])};
                 const PixelType& nodata = kin->globeFile->getNodata();
-                PixelType* wbase = nodeDataBuf;
+                PixelType* wbase = scratch.nodeDataBuf;
 
-//                #pragma omp parallel for
                 typedef SubsampleFilter<PixelType, DYNAMIC_FILTER_TYPE> Filter;
                 for (size_t ny=0; ny<tileSize[1]; ++ny)
                 {
@@ -569,12 +768,12 @@ Note: getKin across patches seem to be broken: e.g. offset==3 returned. */
                     at[0] = nodeOff[0]*scale;
                     for (size_t nx=0; nx<tileSize[0]; ++nx,at[0]+=step[0],++wbase)
                     {
-                        *wbase = Filter::sample(nodeDataSampleBuf, rectOrigin,
-                                                at, rectSize, nodata, nodata,
-                                                nodata);
+                        *wbase = Filter::sample(scratch.nodeDataSampleBuf,
+                                                rectOrigin, at, rectSize,
+                                                nodata, nodata, nodata);
                     }
                 }
-                data = nodeDataBuf;
+                data = scratch.nodeDataBuf;
             }
         }
 
@@ -590,7 +789,6 @@ kinO = 0;
         int stepY[4]  = { int(tileSize[0]), 1,  -int(tileSize[0]), -1 };
         int startX[4] = { 0, 0, int(tileSize[0])-1, int(tileSize[0])-1 };
         int stepX[4]  = { 1,  -int(tileSize[1]), -1, int(tileSize[0])};
-//        #pragma omp parallel for
         for (size_t y=0; y<tileSize[1]; ++y)
         {
             PixelType* to         = base + y*domainSize[0];
@@ -604,61 +802,92 @@ kinO = 0;
 
 template <typename PixelParam>
 void Builder<PixelParam>::
-updateCoarser(Node* node, int level)
+subsampleNode(Node* node, const DomainKin* kins, Scratch& scratch)
 {
-#if DEBUG_PREPARESUBSAMPLINGDOMAIN
-static const float covColor[3] = { 0.1f, 0.4f, 0.6f };
-ConstruoVisualizer::addPrimitive(GL_LINES, node->coverage, covColor);
-ConstruoVisualizer::peek();
-#endif
-
-    //the nodes on the way must be flagged for update
-    if (!node->mustBeUpdated)
-        return;
-
-//- recurse until we've hit the requested level
-    if (node->treeIndex.level()!=static_cast<uint8_t>(level) &&
-        node->children!=NULL)
     {
-        for (size_t i=0; i<4; ++i)
-            updateCoarser(&(node->children[i]), level);
-        return;
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+                                         ConstruoStats::STAGE_DOMAIN);
+        prepareSubsamplingDomain(node, kins, scratch);
     }
 
-//- we've reached a node that must be updated
-    prepareSubsamplingDomain(node);
-
-    /* walk the pixels of the node's data and performed filtered look-ups into
-       the domain */
-    typedef SubsampleFilter<PixelType, SUBSAMPLEFILTER_PYRAMID> Filter;
+    /* perform filtered look-ups into the domain for all the pixels of the
+       node's data. The tile starts at the center of the domain */
+    typedef SubsampleTileFilter<PixelType, SUBSAMPLEFILTER_PYRAMID>  Pyramid;
+    typedef SubsampleTileFilter<PixelType, SUBSAMPLEFILTER_LANCZOS5> Lanczos5;
 
     const PixelType& globeNodata = node->globeFile->getNodata();
 
-    PixelType* data = nodeDataBuf;
-    PixelType* domain;
-    for (domain = domainBuf +   (tileSize[1]-1)*domainSize[0]+  (tileSize[0]-1);
-         domain<= domainBuf + 3*(tileSize[1]-1)*domainSize[0]+3*(tileSize[0]-1);
-         domain+= 2*domainSize[0] - 2*tileSize[0])
+    PixelType* domain = scratch.domainBuf + (tileSize[1]-1)*domainSize[0] +
+                        (tileSize[0]-1);
     {
-        for (size_t i=0; i<tileSize[0]; ++i, domain+=2, ++data)
-            *data  = Filter::sample(domain, domainSize[0], globeNodata);
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+                                         ConstruoStats::STAGE_FILTER);
+        if (tileFilter == SUBSAMPLEFILTER_LANCZOS5)
+        {
+            Lanczos5::sample(domain, domainSize[0], tileSize,
+                             scratch.nodeDataBuf, globeNodata,
+                             scratch.filterBuf);
+        }
+        else
+        {
+            Pyramid::sample(domain, domainSize[0], tileSize,
+                            scratch.nodeDataBuf, globeNodata,
+                            scratch.filterBuf);
+        }
     }
 
     //commit the data to file
-    node->data = nodeDataBuf;
+    node->data = scratch.nodeDataBuf;
 
     typedef GlobeData<PixelParam> gd;
-    typename gd::TileHeader header = node->getTileHeader();
     typename gd::File* file =
         node->globeFile->getPatch(node->treeIndex.patch());
-
-    file->writeTile(node->tileIndex, header, node->data);
+    {
+        ConstruoStats::ScopedTimer timer(scratch.stats,
+            ConstruoStats::STAGE_WRITE_TILE, getTileBytes());
+        typename gd::TileHeader header = node->getTileHeader();
+        file->writeTile(node->tileIndex, header, node->data);
+    }
 
     node->data = NULL;
 ///\todo this is debugging code to check tree consistency
 //verifyQuadtreeFile(node);
 }
 
+template <typename PixelParam>
+bool Builder<PixelParam>::TreeOrder::
+operator()(const Node* a, const Node* b) const
+{
+    if (a->treeIndex.patch() != b->treeIndex.patch())
+        return a->treeIndex.patch() < b->treeIndex.patch();
+
+    //the paths start with the child index of the first level
+    uint64_t aPath = a->treeIndex.index();
+    uint64_t bPath = b->treeIndex.index();
+    for (int l=0; l<a->treeIndex.level(); ++l, aPath>>=2, bPath>>=2)
+    {
+        if ((aPath&0x3) != (bPath&0x3))
+            return (aPath&0x3) < (bPath&0x3);
+    }
+    return false;
+}
+
+template <typename PixelParam>
+void Builder<PixelParam>::
+queueCoarser(Node* node)
+{
+#if DEBUG_PREPARESUBSAMPLINGDOMAIN
+static const float covColor[3] = { 0.1f, 0.4f, 0.6f };
+ConstruoVisualizer::addPrimitive(GL_LINES, node->coverage, covColor);
+ConstruoVisualizer::peek();
+#endif
+
+    workNodes.push_back(node);
+    gatherSubsamplingKin(node);
+    //the coarser levels only need the flags of the ancestors from now on
+    node->mustBeUpdated = false;
+}
+
 template <typename PixelParam>
 void Builder<PixelParam>::
 updateCoarserLevels(int depth)
@@ -666,25 +895,157 @@ updateCoarserLevels(int depth)
     if (depth==0)
         return;
 
-    for (int level=depth-1; level>=0; --level)
+    //resume after the last level resampled before an interruption
+    int firstLevel = depth - 1;
+    if (journal.hasCoarseLevel())
+        firstLevel = std::min(firstLevel, journal.getCoarseLevel()-1);
+
+    dirtyNodes.resize(std::max(dirtyNodes.size(), size_t(depth)));
+    for (int level=firstLevel; level>=0; --level)
     {
-        std::cout << "Upsampling level " << level;
+        Nodes& nodes = dirtyNodes[level];
+        std::cout << "Upsampling level " << level << " (" << nodes.size() <<
+                     " nodes)";
         std::cout.flush();
-        for (typename Globe::BaseNodes::iterator it=globe->baseNodes.begin();
-             it!=globe->baseNodes.end(); ++it)
+
+        //the kin of this level have just been rewritten by the previous one
+        kinCache.clear();
+
+        //resample in tree order such that consecutive nodes share their kin
+        std::sort(nodes.begin(), nodes.end(), TreeOrder());
+        for (size_t i=0; i<nodes.size();)
         {
-//ConstruoVisualizer::clear();
-//ConstruoVisualizer::addPrimitive(GL_LINES, it->coverage);
-//ConstruoVisualizer::show();
-            //traverse the tree and update the next level
-            updateCoarser(&(*it), level);
-//verifyQuadtreeFile(&(*it));
+            //process the nodes of one base patch at a time
+            uint8_t patch = nodes[i]->treeIndex.patch();
+            for (; i<nodes.size() && nodes[i]->treeIndex.patch()==patch; ++i)
+                queueCoarser(nodes[i]);
+            processWork(&Builder::subsampleNodeItem);
+            if (isTreeOverBudget())
+                trimTree(&globe->baseNodes[patch]);
+//verifyQuadtreeFile(&globe->baseNodes[patch]);
             std::cout << ".";
             std::cout.flush();
         }
+        nodes.clear();
+
+        globe->globeFile.checkpoint();
+        journal.addCoarseLevel(level);
         std::cout << " done" << std::endl;
     }
     std::cout << std::endl;
+
+    dirtyNodes.clear();
+    kinCache.clear();
+}
+
+
+template <typename PixelParam>
+void Builder<PixelParam>::
+sourceFinestItem(size_t item, Scratch& scratch)
+{
+    Node* node   = workNodes[item];
+    double start = ConstruoStats::now();
+    sourceFinest(node, workPatch, scratch);
+    scratch.stats.addSourced(node->treeIndex.level(),
+                             ConstruoStats::now()-start);
+}
+
+template <typename PixelParam>
+void Builder<PixelParam>::
+subsampleNodeItem(size_t item, Scratch& scratch)
+{
+    Node* node   = workNodes[item];
+    double start = ConstruoStats::now();
+    subsampleNode(node, &workKins[item*16], scratch);
+    scratch.stats.addResampled(node->treeIndex.level(),
+                               ConstruoStats::now()-start);
+}
+
+template <typename PixelParam>
+void Builder<PixelParam>::
+processWork(WorkProcessor processor)
+{
+    if (workNodes.empty())
+        return;
+
+    workProcessor = processor;
+    nextWorkItem  = 0;
+    nextScratch   = 0;
+    workError.clear();
+
+    int numWorkers = std::min(numThreads, static_cast<int>(workNodes.size()));
+    if (numWorkers == 1)
+    {
+        //no need to spawn threads, process the nodes in order
+        try
+        {
+            for (size_t i=0; i<workNodes.size(); ++i)
+                (this->*workProcessor)(i, scratches[0]);
+        }
+        catch (std::runtime_error err)
+        {
+            workError = err.what();
+        }
+    }
+    else
+    {
+        /* the workers only read the tree and write to the tiles of the nodes
+           they have been assigned. Any structural changes to the tree (new
+           tiles or loaded nodes) have already been made by the traversal */
+        WorkerThreads workers(numWorkers);
+        for (int i=0; i<numWorkers; ++i)
+        {
+            workers[i] = new Threads::Thread;
+            workers[i]->start(this, &Builder::workerThreadFunc);
+        }
+        for (int i=0; i<numWorkers; ++i)
+        {
+            workers[i]->join();
+            delete workers[i];
+        }
+    }
+
+    workNodes.clear();
+    workKins.clear();
+
+    if (!workError.empty())
+        Misc::throwStdErr("%s", workError.c_str());
+}
+
+template <typename PixelParam>
+void* Builder<PixelParam>::
+workerThreadFunc()
+{
+    Scratch* scratch = NULL;
+    {
+        Threads::Mutex::Lock lock(workMutex);
+        scratch = &scratches[nextScratch++];
+    }
+
+    while (true)
+    {
+        size_t item;
+        {
+            Threads::Mutex::Lock lock(workMutex);
+            //stop processing on the first error
+            if (nextWorkItem>=workNodes.size() || !workError.empty())
+                break;
+            item = nextWorkItem++;
+        }
+
+        try
+        {
+            (this->*workProcessor)(item, *scratch);
+        }
+        catch (std::runtime_error err)
+        {
+            Threads::Mutex::Lock lock(workMutex);
+            if (workError.empty())
+                workError = err.what();
+        }
+    }
+
+    return NULL;
 }
 
 
@@ -692,14 +1053,35 @@ template <typename PixelParam>
 void Builder<PixelParam>::
 update()
 {
+    double start = ConstruoStats::now();
     int depth = 0;
     int numPatches = static_cast<int>(imagePatchSources.size());
+
+    //an interrupted update can only be resumed with the same sources
+    const std::vector<std::string>& added = journal.getSources();
+    int numAdded = static_cast<int>(added.size());
+    bool isResumable = numAdded<=numPatches &&
+                       (numAdded==numPatches || !journal.hasCoarseLevel());
+    for (int i=0; isResumable && i<numAdded; ++i)
+        isResumable = added[i] == getJournalId(imagePatchSources[i]);
+    if (!isResumable)
+    {
+        Misc::throwStdErr("The globe file has an interrupted update with "
+                          "different source images. Resume it with the same "
+                          "sources or delete its construo.journal to start "
+                          "over");
+    }
+
     for (int i=0; i<numPatches; ++i)
     {
+        /* the patches added before an interruption are only traversed to
+           recover the nodes of the coarse levels that need updating */
+        sourcePatch = i >= numAdded;
         try
         {
-            std::cout << "*** Adding source image " << i+1 << " out of " <<
-                         numPatches << "\n\n";
+            std::cout << "*** " << (sourcePatch ? "Adding" : "Recovering") <<
+                         " source image " << i+1 << " out of " << numPatches <<
+                         "\n\n";
             std::cout.flush();
 
             int newDepth = updateFinestLevels(imagePatchSources[i]);
@@ -710,9 +1092,46 @@ update()
             std::cerr << "Ignoring image patch " << imagePatchSources[i].path <<
                          " due to exception " << err.what() << std::endl;
         }
+
+        if (sourcePatch)
+        {
+            globe->globeFile.checkpoint();
+            journal.addSource(getJournalId(imagePatchSources[i]));
+        }
     }
+    sourcePatch = true;
 
     updateCoarserLevels(depth);
+    //the update is complete and doesn't need to be resumed anymore
+    journal.remove();
+
+    if (blockCache.getBudget() != 0)
+        blockCache.printStats(std::cout);
+    kinCache.printStats(std::cout);
+    std::cout << "Peak of " << TreeNodeStats::peakResident << " tree nodes "
+                 "resident" << std::endl;
+
+    reportStats(ConstruoStats::now() - start);
+}
+
+template <typename PixelParam>
+void Builder<PixelParam>::
+reportStats(double seconds)
+{
+    ConstruoStats stats;
+    for (typename Scratches::iterator it=scratches.begin();
+         it!=scratches.end(); ++it)
+    {
+        stats.merge(it->stats);
+    }
+
+    size_t numTiles = stats.getNumTiles();
+    std::cout << "Processed " << numTiles << " tiles in " << seconds <<
+                 "s (" << (seconds>0.0 ? numTiles/seconds : 0.0) <<
+                 " tiles/s)" << std::endl;
+
+    if (statsStream != NULL)
+        stats.writeJson(*statsStream, seconds);
 }
 
 ///\todo remove
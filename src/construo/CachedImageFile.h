@@ -0,0 +1,146 @@
+#ifndef _CachedImageFile_H_
+#define _CachedImageFile_H_
+
+
+#include <list>
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include <construo/ImageFile.h>
+
+#include <construo/vrui.h>
+
+
+namespace crusta {
+
+
+/** LRU cache of blocks of source image pixels, shared by all the images of an
+    update and by all the threads sampling them. Blocks are read through the
+    images they belong to and the cache holds at most the given number of
+    bytes of pixel data. */
+template <typename PixelType>
+class ImageBlockCache
+{
+public:
+    ///access statistics of the cache
+    struct Stats
+    {
+        Stats();
+
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        ///amount of pixel data read from the images
+        size_t bytesRead;
+    };
+
+    ImageBlockCache(size_t iBudget);
+
+    ///retrieve the memory budget in bytes
+    size_t getBudget() const;
+
+    /** copy the part of a block that overlaps the rectangle into the buffer of
+        the rectangle. The block is read from the source if it isn't cached.
+        Blocks are identified by their owner and origin */
+    void read(const void* owner, const ImageFile<PixelType>* source,
+              const int blockOrigin[2], const int blockSize[2],
+              const int rectOrigin[2], const int rectSize[2],
+              PixelType* rectBuffer);
+    ///drop all the blocks of the given owner
+    void evict(const void* owner);
+
+    ///retrieve the access statistics
+    Stats getStats() const;
+    ///print the access statistics
+    void printStats(std::ostream& os) const;
+
+protected:
+    struct BlockKey
+    {
+        BlockKey(const void* iOwner, const int origin[2]);
+        bool operator<(const BlockKey& other) const;
+
+        const void* owner;
+        int x;
+        int y;
+    };
+
+    struct Block
+    {
+        Block(const BlockKey& iKey, const int iSize[2]);
+
+        BlockKey               key;
+        int                    size[2];
+        std::vector<PixelType> pixels;
+    };
+
+    typedef std::list<Block>                                 BlockList;
+    typedef std::map<BlockKey, typename BlockList::iterator> BlockMap;
+
+    ///copy the overlap of the block and the rectangle
+    void copy(const Block& block, const int rectOrigin[2],
+              const int rectSize[2], PixelType* rectBuffer) const;
+    ///make room for the given number of bytes (cacheMutex must be held)
+    void reserve(size_t numBytes);
+
+    ///maximum number of bytes of pixel data held by the cache
+    size_t budget;
+    ///number of bytes of pixel data currently held
+    size_t used;
+
+    ///the cached blocks ordered from most to least recently used
+    BlockList lru;
+    ///lookup of the cached blocks
+    BlockMap blocks;
+
+    ///access statistics
+    Stats stats;
+
+    ///serializes access to the cache
+    mutable Threads::Mutex cacheMutex;
+};
+
+
+/** image file serving rectangles from the blocks of a shared block cache. The
+    cache blocks are aligned with the native block layout of the wrapped image
+    such that reading a cache block only touches whole native blocks. */
+template <typename PixelType>
+class CachedImageFile : public ImageFile<PixelType>
+{
+public:
+    /** wraps the image. The wrapped image is deleted along with this one and
+        must not be modified after wrapping */
+    CachedImageFile(ImageFile<PixelType>* iSource,
+                    ImageBlockCache<PixelType>& iCache);
+    virtual ~CachedImageFile();
+
+//- inherited from ImageFile
+public:
+    virtual void getBlockSize(int blockSize[2]) const;
+    virtual void readRectangle(const int rectOrigin[2], const int rectSize[2],
+                               PixelType* rectBuffer) const;
+
+protected:
+    ///minimum size of the cached blocks along each dimension
+    static const int MIN_BLOCK_SIZE = 256;
+    /** maximum size of the cached blocks along each dimension. Native blocks
+        that are larger (e.g., whole scanlines) are split */
+    static const int MAX_BLOCK_SIZE = 1024;
+
+    ///the wrapped image
+    ImageFile<PixelType>* source;
+    ///the cache holding the blocks of the image
+    ImageBlockCache<PixelType>& cache;
+    ///size of the cached blocks
+    int cacheBlockSize[2];
+};
+
+
+} //namespace crusta
+
+
+#include <construo/CachedImageFile.hpp>
+
+
+#endif //_CachedImageFile_H_
@@ -0,0 +1,258 @@
+#include <algorithm>
+#include <iomanip>
+
+
+namespace crusta {
+
+
+template <typename PixelType>
+ImageBlockCache<PixelType>::Stats::
+Stats() :
+    hits(0), misses(0), evictions(0), bytesRead(0)
+{
+}
+
+template <typename PixelType>
+ImageBlockCache<PixelType>::BlockKey::
+BlockKey(const void* iOwner, const int origin[2]) :
+    owner(iOwner), x(origin[0]), y(origin[1])
+{
+}
+
+template <typename PixelType>
+bool ImageBlockCache<PixelType>::BlockKey::
+operator<(const BlockKey& other) const
+{
+    if (owner != other.owner)
+        return owner < other.owner;
+    if (y != other.y)
+        return y < other.y;
+    return x < other.x;
+}
+
+template <typename PixelType>
+ImageBlockCache<PixelType>::Block::
+Block(const BlockKey& iKey, const int iSize[2]) :
+    key(iKey)
+{
+    size[0] = iSize[0];
+    size[1] = iSize[1];
+}
+
+
+template <typename PixelType>
+ImageBlockCache<PixelType>::
+ImageBlockCache(size_t iBudget) :
+    budget(iBudget), used(0)
+{
+}
+
+template <typename PixelType>
+size_t ImageBlockCache<PixelType>::
+getBudget() const
+{
+    return budget;
+}
+
+template <typename PixelType>
+void ImageBlockCache<PixelType>::
+read(const void* owner, const ImageFile<PixelType>* source,
+     const int blockOrigin[2], const int blockSize[2],
+     const int rectOrigin[2], const int rectSize[2], PixelType* rectBuffer)
+{
+    BlockKey key(owner, blockOrigin);
+
+    {
+        Threads::Mutex::Lock lock(cacheMutex);
+        typename BlockMap::iterator it = blocks.find(key);
+        if (it != blocks.end())
+        {
+            ++stats.hits;
+            lru.splice(lru.begin(), lru, it->second);
+            copy(*it->second, rectOrigin, rectSize, rectBuffer);
+            return;
+        }
+        ++stats.misses;
+    }
+
+    /* read the block without holding the cache, such that other threads can
+       be served while the source is decoding */
+    size_t numBytes = size_t(blockSize[0])*blockSize[1]*sizeof(PixelType);
+    std::vector<PixelType> pixels(size_t(blockSize[0])*blockSize[1]);
+    source->readRectangle(blockOrigin, blockSize, &pixels.front());
+
+    Threads::Mutex::Lock lock(cacheMutex);
+    stats.bytesRead += numBytes;
+
+    //another thread might have read the same block in the meantime
+    typename BlockMap::iterator it = blocks.find(key);
+    if (it == blocks.end())
+    {
+        reserve(numBytes);
+        lru.push_front(Block(key, blockSize));
+        lru.front().pixels.swap(pixels);
+        it = blocks.insert(typename BlockMap::value_type(key,
+                                                         lru.begin())).first;
+        used += numBytes;
+    }
+    copy(*it->second, rectOrigin, rectSize, rectBuffer);
+}
+
+template <typename PixelType>
+void ImageBlockCache<PixelType>::
+evict(const void* owner)
+{
+    Threads::Mutex::Lock lock(cacheMutex);
+    for (typename BlockList::iterator it=lru.begin(); it!=lru.end();)
+    {
+        if (it->key.owner == owner)
+        {
+            used -= it->pixels.size() * sizeof(PixelType);
+            blocks.erase(it->key);
+            it = lru.erase(it);
+        }
+        else
+            ++it;
+    }
+}
+
+template <typename PixelType>
+typename ImageBlockCache<PixelType>::Stats ImageBlockCache<PixelType>::
+getStats() const
+{
+    Threads::Mutex::Lock lock(cacheMutex);
+    return stats;
+}
+
+template <typename PixelType>
+void ImageBlockCache<PixelType>::
+printStats(std::ostream& os) const
+{
+    Stats s = getStats();
+    size_t numAccesses = s.hits + s.misses;
+    double hitRate     = numAccesses==0 ? 0.0 : 100.0*s.hits/numAccesses;
+    os << "Source block cache: " << s.hits << " hits, " << s.misses <<
+          " misses (" << std::fixed << std::setprecision(1) << hitRate <<
+          "% hit rate), " << s.evictions << " evictions, " <<
+          s.bytesRead/(1024*1024) << "MB read from the sources" << std::endl;
+}
+
+
+template <typename PixelType>
+void ImageBlockCache<PixelType>::
+copy(const Block& block, const int rectOrigin[2], const int rectSize[2],
+     PixelType* rectBuffer) const
+{
+    const int blockOrigin[2] = { block.key.x, block.key.y };
+
+    int min[2], max[2];
+    for (int i=0; i<2; ++i)
+    {
+        min[i] = std::max(blockOrigin[i], rectOrigin[i]);
+        max[i] = std::min(blockOrigin[i]+block.size[i],
+                          rectOrigin[i]+rectSize[i]);
+        if (min[i] >= max[i])
+            return;
+    }
+
+    for (int y=min[1]; y<max[1]; ++y)
+    {
+        const PixelType* src = &block.pixels[
+            (y-blockOrigin[1])*block.size[0] + (min[0]-blockOrigin[0])];
+        PixelType* dst = rectBuffer + (y-rectOrigin[1])*rectSize[0] +
+                         (min[0]-rectOrigin[0]);
+        std::copy(src, src + (max[0]-min[0]), dst);
+    }
+}
+
+template <typename PixelType>
+void ImageBlockCache<PixelType>::
+reserve(size_t numBytes)
+{
+    //blocks larger than the budget simply replace the whole content
+    while (!lru.empty() && used+numBytes>budget)
+    {
+        Block& victim = lru.back();
+        used -= victim.pixels.size() * sizeof(PixelType);
+        blocks.erase(victim.key);
+        lru.pop_back();
+        ++stats.evictions;
+    }
+}
+
+
+template <typename PixelType>
+const int CachedImageFile<PixelType>::MIN_BLOCK_SIZE;
+template <typename PixelType>
+const int CachedImageFile<PixelType>::MAX_BLOCK_SIZE;
+
+template <typename PixelType>
+CachedImageFile<PixelType>::
+CachedImageFile(ImageFile<PixelType>* iSource,
+                ImageBlockCache<PixelType>& iCache) :
+    source(iSource), cache(iCache)
+{
+    this->pixelOffset = source->getPixelOffset();
+    this->pixelScale  = source->getPixelScale();
+    this->nodata      = source->getNodata();
+    this->size[0]     = source->getSize()[0];
+    this->size[1]     = source->getSize()[1];
+
+    /* aggregate small native blocks into cache blocks of at least the minimum
+       size, keeping them aligned with the native ones */
+    int nativeSize[2];
+    source->getBlockSize(nativeSize);
+    for (int i=0; i<2; ++i)
+    {
+        int native = std::max(nativeSize[i], 1);
+        int blocks = (MIN_BLOCK_SIZE + native - 1) / native;
+        cacheBlockSize[i] = std::min(blocks*native, MAX_BLOCK_SIZE);
+        cacheBlockSize[i] = std::max(std::min(cacheBlockSize[i],
+                                              this->size[i]), 1);
+    }
+}
+
+template <typename PixelType>
+CachedImageFile<PixelType>::
+~CachedImageFile()
+{
+    cache.evict(this);
+    delete source;
+}
+
+template <typename PixelType>
+void CachedImageFile<PixelType>::
+getBlockSize(int blockSize[2]) const
+{
+    blockSize[0] = cacheBlockSize[0];
+    blockSize[1] = cacheBlockSize[1];
+}
+
+template <typename PixelType>
+void CachedImageFile<PixelType>::
+readRectangle(const int rectOrigin[2], const int rectSize[2],
+              PixelType* rectBuffer) const
+{
+    int first[2], last[2];
+    for (int i=0; i<2; ++i)
+    {
+        first[i] = rectOrigin[i] / cacheBlockSize[i];
+        last[i]  = (rectOrigin[i]+rectSize[i]-1) / cacheBlockSize[i];
+    }
+
+    for (int y=first[1]; y<=last[1]; ++y)
+    {
+        for (int x=first[0]; x<=last[0]; ++x)
+        {
+            int blockOrigin[2] = { x*cacheBlockSize[0], y*cacheBlockSize[1] };
+            int blockSize[2]   = {
+                std::min(cacheBlockSize[0], this->size[0]-blockOrigin[0]),
+                std::min(cacheBlockSize[1], this->size[1]-blockOrigin[1]) };
+            cache.read(this, source, blockOrigin, blockSize, rectOrigin,
+                       rectSize, rectBuffer);
+        }
+    }
+}
+
+
+} //namespace crusta
@@ -23,10 +23,12 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <fstream>
 #include <stdexcept>
 #include <iostream>
 
 #include <construo/Builder.h>
+#include <construo/Repacker.h>
 
 #include <crustacore/LayerData.h>
 
@@ -59,6 +61,33 @@ int main(int argc, char* argv[])
     bool pointSampled = false;
     /* the current nodata string, initialized to the empty string */
     std::string nodata;
+    /* the number of threads used to process the nodes of the update */
+    int numThreads = 1;
+    /* flag whether a new globe file should store its tiles compressed */
+    bool compress = false;
+    /* flag whether the coarser levels are subsampled with the lanczos5 filter
+       instead of the pyramid filter */
+    bool lanczos = false;
+    /* size in megabytes of the cache of source image blocks (negative to use
+       the configured one) */
+    int sourceCacheSize = -1;
+    /* size in megabytes of the in-memory tree (negative to use the configured
+       one) */
+    int treeMemoryBudget = -1;
+    /* size in megabytes of the queue of the tile writers (negative to use the
+       configured one) */
+    int tileWriteBuffer = -1;
+    /* the name of the globe file to which the tiles of the specified one are
+       to be repacked instead of being updated */
+    std::string repackFileName;
+    /* the name of the file receiving the statistics of the update ("-" for
+       stdout, empty for none) */
+    std::string statsFileName;
+    /* the layout used for repacking */
+    RepackerBase::Layout repackLayout = RepackerBase::LAYOUT_BREADTH_FIRST;
+    /* the name of the globe file against which the specified one is to be
+       verified */
+    std::string verifyFileName;
 
     //the tile size should only be an internal parameter
     static const size_t tileSize[2] = {TILE_RESOLUTION, TILE_RESOLUTION};
@@ -183,6 +212,158 @@ int main(int argc, char* argv[])
         {
             pointSampled = false;
         }
+        else if (strcasecmp(argv[i], "-threads") == 0)
+        {
+            //read the number of threads to use for the update
+            ++i;
+            if (i<argc)
+            {
+                numThreads = atoi(argv[i]);
+                if (numThreads < 1)
+                {
+                    std::cerr << "Invalid number of threads " << argv[i] <<
+                                 std::endl;
+                    return 1;
+                }
+            }
+            else
+            {
+                std::cerr << "Dangling threads argument" << std::endl;
+                return 1;
+            }
+        }
+        else if (strcasecmp(argv[i], "-compress") == 0)
+        {
+            compress = true;
+        }
+        else if (strcasecmp(argv[i], "-lanczos") == 0)
+        {
+            lanczos = true;
+        }
+        else if (strcasecmp(argv[i], "-sourceCache") == 0)
+        {
+            //read the size of the source block cache
+            ++i;
+            if (i<argc)
+            {
+                sourceCacheSize = atoi(argv[i]);
+                if (sourceCacheSize < 0)
+                {
+                    std::cerr << "Invalid source cache size " << argv[i] <<
+                                 std::endl;
+                    return 1;
+                }
+            }
+            else
+            {
+                std::cerr << "Dangling source cache size argument" <<
+                             std::endl;
+                return 1;
+            }
+        }
+        else if (strcasecmp(argv[i], "-treeMemory") == 0)
+        {
+            //read the memory budget of the tree
+            ++i;
+            if (i<argc)
+            {
+                treeMemoryBudget = atoi(argv[i]);
+                if (treeMemoryBudget < 0)
+                {
+                    std::cerr << "Invalid tree memory budget " << argv[i] <<
+                                 std::endl;
+                    return 1;
+                }
+            }
+            else
+            {
+                std::cerr << "Dangling tree memory budget argument" <<
+                             std::endl;
+                return 1;
+            }
+        }
+        else if (strcasecmp(argv[i], "-writeBuffer") == 0)
+        {
+            //read the size of the queue of the tile writers
+            ++i;
+            if (i<argc)
+            {
+                tileWriteBuffer = atoi(argv[i]);
+                if (tileWriteBuffer < 0)
+                {
+                    std::cerr << "Invalid tile write buffer size " <<
+                                 argv[i] << std::endl;
+                    return 1;
+                }
+            }
+            else
+            {
+                std::cerr << "Dangling tile write buffer size argument" <<
+                             std::endl;
+                return 1;
+            }
+        }
+        else if (strcasecmp(argv[i], "-stats") == 0)
+        {
+            //read the name of the file receiving the statistics
+            ++i;
+            if (i<argc)
+                statsFileName = std::string(argv[i]);
+            else
+            {
+                std::cerr << "Dangling stats file name argument" << std::endl;
+                return 1;
+            }
+        }
+        else if (strcasecmp(argv[i], "-repack") == 0)
+        {
+            //read the name of the repacked globe file
+            ++i;
+            if (i<argc)
+            {
+                repackFileName = std::string(argv[i]);
+            }
+            else
+            {
+                std::cerr << "Dangling repack globe file name argument" <<
+                             std::endl;
+                return 1;
+            }
+        }
+        else if (strcasecmp(argv[i], "-layout") == 0)
+        {
+            //read the layout used for repacking
+            ++i;
+            if (i<argc && strcasecmp(argv[i], "breadth") == 0)
+            {
+                repackLayout = RepackerBase::LAYOUT_BREADTH_FIRST;
+            }
+            else if (i<argc && strcasecmp(argv[i], "depth") == 0)
+            {
+                repackLayout = RepackerBase::LAYOUT_DEPTH_FIRST;
+            }
+            else
+            {
+                std::cerr << "Expected breadth or depth as layout argument" <<
+                             std::endl;
+                return 1;
+            }
+        }
+        else if (strcasecmp(argv[i], "-verify") == 0)
+        {
+            //read the name of the globe file to compare against
+            ++i;
+            if (i<argc)
+            {
+                verifyFileName = std::string(argv[i]);
+            }
+            else
+            {
+                std::cerr << "Dangling verify globe file name argument" <<
+                             std::endl;
+                return 1;
+            }
+        }
         else if (strcasecmp(argv[i], "-settings") == 0)
         {
             //read the settings filename
@@ -217,8 +398,14 @@ int main(int argc, char* argv[])
         std::cerr << "Usage:\nconstruo -dem | -color | -layerf <globe file "
                      "name> [-offset <scalar> | -noOffset] [-scale <scalar> | "
                      "-noScale] [-nodata <value> | -defaultNodata] "
-                     "[-pointsampling] [-areasampling] [-settings <settings "
-                     "file>] [-version] <input files>\n";
+                     "[-pointsampling] [-areasampling] [-threads <count>] "
+                     "[-compress] [-lanczos] [-sourceCache <MB>] "
+                     "[-treeMemory <MB>] [-writeBuffer <MB>] "
+                     "[-stats <json file> | -stats -] "
+                     "[-settings <settings file>] [-version] <input files>\n"
+                     "construo -dem | -color | -layerf <globe file name> "
+                     "[-repack <new globe file name> [-layout breadth | depth] "
+                     "[-compress]] [-verify <other globe file name>]\n";
         return 1;
     }
 
@@ -234,26 +421,110 @@ int main(int argc, char* argv[])
             globeFileName.resize(globeFileName.size()-1);
     }
 
+    if (!repackFileName.empty() || !verifyFileName.empty())
+    {
+        //repack and/or verify the globe file instead of updating it
+        RepackerBase* repacker = NULL;
+        switch (buildType)
+        {
+            case DEM_BUILD:
+                repacker = new Repacker<DemHeight>;
+                break;
+            case COLORTEXTURE_BUILD:
+                repacker = new Repacker<TextureColor>;
+                break;
+            case LAYERF_BUILD:
+                repacker = new Repacker<LayerDataf>;
+                break;
+            default:
+                std::cerr << "Unsupported build type" << std::endl;
+                return 1;
+                break;
+        }
+
+        size_t numMismatches = 0;
+        try
+        {
+            if (!repackFileName.empty())
+            {
+                repacker->repack(globeFileName, repackFileName, repackLayout,
+                                 compress);
+            }
+            if (!verifyFileName.empty())
+            {
+                numMismatches = repacker->verify(globeFileName,
+                                                 verifyFileName);
+                std::cout << "Verification found " << numMismatches <<
+                             " mismatching nodes" << std::endl;
+            }
+        }
+        catch (std::runtime_error e)
+        {
+            std::cerr << e.what() << std::endl;
+            delete repacker;
+            return 1;
+        }
+
+        delete repacker;
+        return numMismatches==0 ? 0 : 1;
+    }
+
     if (imageSources.empty())
     {
         std::cerr << "No data sources provided" << std::endl;
         return 1;
     }
 
+    /* open the destination of the statistics. When they go to stdout, the
+       progress reports are sent to stderr, such that stdout only carries the
+       JSON summary */
+    std::ofstream statsFile;
+    std::ostream  statsStdout(std::cout.rdbuf());
+    std::ostream* statsStream = NULL;
+    if (statsFileName == "-")
+    {
+        statsStream = &statsStdout;
+        std::cout.rdbuf(std::cerr.rdbuf());
+    }
+    else if (!statsFileName.empty())
+    {
+        statsFile.open(statsFileName.c_str());
+        if (!statsFile)
+        {
+            std::cerr << "Unable to write the statistics to " <<
+                         statsFileName << std::endl;
+            return 1;
+        }
+        statsStream = &statsFile;
+    }
+
     CONSTRUO_SETTINGS.loadFromFile(settingsFileName);
+    if (compress)
+        CONSTRUO_SETTINGS.compressTiles = true;
+    if (lanczos)
+        CONSTRUO_SETTINGS.lanczosSubsampling = true;
+    if (sourceCacheSize >= 0)
+        CONSTRUO_SETTINGS.sourceCacheSize = sourceCacheSize;
+    if (treeMemoryBudget >= 0)
+        CONSTRUO_SETTINGS.treeMemoryBudget = treeMemoryBudget;
+    if (tileWriteBuffer >= 0)
+        CONSTRUO_SETTINGS.tileWriteBuffer = tileWriteBuffer;
 
     //reate the builder object
     BuilderBase* builder = NULL;
     switch (buildType)
     {
         case DEM_BUILD:
-            builder = new Builder<DemHeight>(globeFileName, tileSize);
+            builder = new Builder<DemHeight>(globeFileName, tileSize,
+                                             numThreads);
             break;
         case COLORTEXTURE_BUILD:
-            builder = new Builder<TextureColor>(globeFileName, tileSize);
+            builder = new Builder<TextureColor>(globeFileName, tileSize,
+                                                numThreads);
             break;
         case LAYERF_BUILD:
-            builder = new Builder<LayerDataf>(globeFileName, tileSize);
+            builder = new Builder<LayerDataf>(globeFileName, tileSize,
+                                              numThreads);
             break;
         default:
             std::cerr << "Unsupported build type" << std::endl;
@@ -262,9 +533,19 @@ int main(int argc, char* argv[])
     }
 
     builder->addImagePatches(imageSources);
+    builder->setStatsStream(statsStream);
 
     //update the spheroid
-    builder->update();
+    try
+    {
+        builder->update();
+    }
+    catch (std::runtime_error e)
+    {
+        std::cerr << e.what() << std::endl;
+        delete builder;
+        return 1;
+    }
 
     //clean up and return
     delete builder;
@@ -10,7 +10,9 @@ namespace crusta {
 
 ConstruoSettings::
 ConstruoSettings() :
-    globeName("Sphere_Earth"), globeRadius(6371000.0)
+    globeName("Sphere_Earth"), globeRadius(6371000.0), compressTiles(false),
+    sourceCacheSize(256), treeMemoryBudget(0), tileWriteBuffer(64),
+    lanczosSubsampling(false)
 {
 }
 
@@ -52,6 +54,18 @@ loadFromFile(std::string configurationFileName, bool merge)
     cfgFile.setCurrentSection("/Crusta/Globe");
     globeName   = cfgFile.retrieveString("./name", globeName);
     globeRadius = cfgFile.retrieveValue<double>("./radius", globeRadius);
+
+    cfgFile.setCurrentSection("/Crusta/Construo");
+    compressTiles = cfgFile.retrieveValue<bool>("./compressTiles",
+                                                compressTiles);
+    sourceCacheSize = cfgFile.retrieveValue<int>("./sourceCacheSize",
+                                                 sourceCacheSize);
+    treeMemoryBudget = cfgFile.retrieveValue<int>("./treeMemoryBudget",
+                                                  treeMemoryBudget);
+    tileWriteBuffer  = cfgFile.retrieveValue<int>("./tileWriteBuffer",
+                                                  tileWriteBuffer);
+    lanczosSubsampling = cfgFile.retrieveValue<bool>("./lanczosSubsampling",
+                                                     lanczosSubsampling);
 }
 
 } //namespace crusta
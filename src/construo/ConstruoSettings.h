@@ -21,6 +21,20 @@ public:
     std::string globeName;
     /** radius of the sphere onto which data is mapped */
     double globeRadius;
+    /** store the tiles of newly created globe files compressed */
+    bool compressTiles;
+    /** size in megabytes of the cache of source image blocks (0 disables
+        the cache) */
+    int sourceCacheSize;
+    /** size in megabytes of the in-memory tree above which finished subtrees
+        are released during an update (0 keeps the whole tree) */
+    int treeMemoryBudget;
+    /** size in megabytes of the tiles queued for the background writers of
+        the globe file (0 writes the tiles immediately) */
+    int tileWriteBuffer;
+    /** subsample the coarser levels with the lanczos5 filter instead of the
+        pyramid filter */
+    bool lanczosSubsampling;
 };
 
 
@@ -0,0 +1,172 @@
+#include <construo/ConstruoStats.h>
+
+#include <ctime>
+#include <iomanip>
+
+
+namespace crusta {
+
+
+static const char* stageNames[ConstruoStats::NUM_STAGES] = {
+    "transform", "readImage", "sample", "domain", "filter", "readTile",
+    "writeTile"
+};
+
+
+ConstruoStats::Counter::
+Counter() :
+    count(0), seconds(0.0), bytes(0)
+{
+}
+
+ConstruoStats::Level::
+Level() :
+    numSourced(0), sourceSeconds(0.0), numResampled(0), resampleSeconds(0.0)
+{
+}
+
+
+ConstruoStats::ScopedTimer::
+ScopedTimer(ConstruoStats& iStats, Stage iStage, uint64_t iBytes) :
+    stats(iStats), stage(iStage), bytes(iBytes), start(now())
+{
+}
+
+ConstruoStats::ScopedTimer::
+~ScopedTimer()
+{
+    stats.add(stage, now()-start, bytes);
+}
+
+
+double ConstruoStats::
+now()
+{
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return double(time.tv_sec) + double(time.tv_nsec)*1e-9;
+}
+
+void ConstruoStats::
+add(Stage stage, double seconds, uint64_t bytes)
+{
+    Counter& counter = stages[stage];
+    ++counter.count;
+    counter.seconds += seconds;
+    counter.bytes   += bytes;
+}
+
+void ConstruoStats::
+addSourced(int level, double seconds)
+{
+    if (levels.size() <= size_t(level))
+        levels.resize(level+1);
+    ++levels[level].numSourced;
+    levels[level].sourceSeconds += seconds;
+}
+
+void ConstruoStats::
+addResampled(int level, double seconds)
+{
+    if (levels.size() <= size_t(level))
+        levels.resize(level+1);
+    ++levels[level].numResampled;
+    levels[level].resampleSeconds += seconds;
+}
+
+void ConstruoStats::
+merge(const ConstruoStats& other)
+{
+    for (int i=0; i<NUM_STAGES; ++i)
+    {
+        stages[i].count   += other.stages[i].count;
+        stages[i].seconds += other.stages[i].seconds;
+        stages[i].bytes   += other.stages[i].bytes;
+    }
+
+    if (levels.size() < other.levels.size())
+        levels.resize(other.levels.size());
+    for (size_t i=0; i<other.levels.size(); ++i)
+    {
+        levels[i].numSourced      += other.levels[i].numSourced;
+        levels[i].sourceSeconds   += other.levels[i].sourceSeconds;
+        levels[i].numResampled    += other.levels[i].numResampled;
+        levels[i].resampleSeconds += other.levels[i].resampleSeconds;
+    }
+}
+
+void ConstruoStats::
+reset()
+{
+    for (int i=0; i<NUM_STAGES; ++i)
+        stages[i] = Counter();
+    levels.clear();
+}
+
+size_t ConstruoStats::
+getNumTiles() const
+{
+    size_t numTiles = 0;
+    for (size_t i=0; i<levels.size(); ++i)
+        numTiles += levels[i].numSourced + levels[i].numResampled;
+    return numTiles;
+}
+
+void ConstruoStats::
+writeJson(std::ostream& os, double seconds) const
+{
+    static const double MB = 1024.0*1024.0;
+
+    size_t numSourced   = 0;
+    size_t numResampled = 0;
+    for (size_t i=0; i<levels.size(); ++i)
+    {
+        numSourced   += levels[i].numSourced;
+        numResampled += levels[i].numResampled;
+    }
+    size_t numTiles = numSourced + numResampled;
+    double bytesRead = double(stages[STAGE_READ_IMAGE].bytes +
+                              stages[STAGE_READ_TILE].bytes);
+
+    std::ios::fmtflags flags = os.flags();
+    os << std::fixed << std::setprecision(6);
+
+    os << "{\n";
+    os << "  \"seconds\": " << seconds << ",\n";
+    os << "  \"tilesSourced\": " << numSourced << ",\n";
+    os << "  \"tilesResampled\": " << numResampled << ",\n";
+    os << "  \"tilesPerSecond\": " << (seconds>0.0 ? numTiles/seconds : 0.0) <<
+          ",\n";
+    os << "  \"mbRead\": " << bytesRead/MB << ",\n";
+    os << "  \"mbWritten\": " << stages[STAGE_WRITE_TILE].bytes/MB << ",\n";
+
+    //the stages are timed per worker, thus their times add up over threads
+    os << "  \"stages\": {\n";
+    for (int i=0; i<NUM_STAGES; ++i)
+    {
+        os << "    \"" << stageNames[i] << "\": { \"count\": " <<
+              stages[i].count << ", \"seconds\": " << stages[i].seconds <<
+              ", \"mb\": " << stages[i].bytes/MB << " }" <<
+              (i+1<NUM_STAGES ? ",\n" : "\n");
+    }
+    os << "  },\n";
+
+    os << "  \"levels\": [\n";
+    for (size_t i=0; i<levels.size(); ++i)
+    {
+        const Level& level = levels[i];
+        os << "    { \"level\": " << i << ", \"sourced\": " <<
+              level.numSourced << ", \"sourceSeconds\": " <<
+              level.sourceSeconds << ", \"resampled\": " <<
+              level.numResampled << ", \"resampleSeconds\": " <<
+              level.resampleSeconds << " }" <<
+              (i+1<levels.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n";
+    os << "}\n";
+
+    os.flags(flags);
+}
+
+
+} //namespace crusta
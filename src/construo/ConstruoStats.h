@@ -0,0 +1,108 @@
+#ifndef _ConstruoStats_H_
+#define _ConstruoStats_H_
+
+
+#include <ostream>
+#include <vector>
+
+#include <crustacore/basics.h>
+
+
+namespace crusta {
+
+
+/** counts and times the work done by the stages of a construo update. The
+    counters are cheap enough to always be collected. Each worker accumulates
+    into its own set and the sets are merged for reporting. */
+class ConstruoStats
+{
+public:
+    ///the stages of an update
+    enum Stage
+    {
+        ///transforming the sample positions of a node into image space
+        STAGE_TRANSFORM,
+        ///reading pixels from the source images
+        STAGE_READ_IMAGE,
+        ///sampling the source pixels into the tiles
+        STAGE_SAMPLE,
+        ///assembling the subsampling domains (including its tile reads)
+        STAGE_DOMAIN,
+        ///filtering the subsampling domains into the tiles
+        STAGE_FILTER,
+        ///reading tiles from the globe file
+        STAGE_READ_TILE,
+        ///writing tiles to the globe file
+        STAGE_WRITE_TILE,
+
+        NUM_STAGES
+    };
+
+    ///accumulated work of a stage
+    struct Counter
+    {
+        Counter();
+
+        size_t   count;
+        double   seconds;
+        uint64_t bytes;
+    };
+
+    ///accumulated work on the tiles of a level
+    struct Level
+    {
+        Level();
+
+        size_t numSourced;
+        double sourceSeconds;
+        size_t numResampled;
+        double resampleSeconds;
+    };
+
+    ///times a stage from construction to destruction
+    class ScopedTimer
+    {
+    public:
+        ScopedTimer(ConstruoStats& iStats, Stage iStage, uint64_t iBytes=0);
+        ~ScopedTimer();
+
+    protected:
+        ConstruoStats& stats;
+        Stage          stage;
+        uint64_t       bytes;
+        double         start;
+    };
+
+    ///returns a monotonic time stamp in seconds
+    static double now();
+
+    ///accumulates an execution of a stage
+    void add(Stage stage, double seconds, uint64_t bytes=0);
+    ///accumulates the sourcing of a tile of the given level
+    void addSourced(int level, double seconds);
+    ///accumulates the resampling of a tile of the given level
+    void addResampled(int level, double seconds);
+    ///accumulates the counters of another set
+    void merge(const ConstruoStats& other);
+    ///resets all the counters
+    void reset();
+
+    ///returns the number of tiles sourced and resampled over all the levels
+    size_t getNumTiles() const;
+
+    /** writes the counters as a JSON object, deriving the throughput from the
+        given duration of the update */
+    void writeJson(std::ostream& os, double seconds) const;
+
+protected:
+    ///the counters of the stages
+    Counter stages[NUM_STAGES];
+    ///the counters of the levels
+    std::vector<Level> levels;
+};
+
+
+} //namespace crusta
+
+
+#endif //_ConstruoStats_H_
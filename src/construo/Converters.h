@@ -24,6 +24,24 @@ cartesianToSpherical(const Geometry::Point<ScalarParam, 3>& p)
     return Geometry::Point<ScalarParam, 2>(phi, theta);
 }
 
+/** converts an array of packed cartesian coordinates (x,y,z triples) to
+    spherical ones */
+template <typename ScalarParam, typename PointScalarParam>
+inline void
+cartesianToSpherical(size_t numPoints, const ScalarParam* xyz,
+                     Geometry::Point<PointScalarParam, 2>* spherical)
+{
+    static const ScalarParam halfPi =
+        Math::Constants<ScalarParam>::pi*ScalarParam(0.5);
+
+    for (size_t i=0; i<numPoints; ++i, xyz+=3)
+    {
+        ScalarParam len = sqrt(xyz[0]*xyz[0] + xyz[1]*xyz[1] + xyz[2]*xyz[2]);
+        spherical[i][0] = atan2(xyz[1], xyz[0]);
+        spherical[i][1] = halfPi - acos(xyz[2]/len);
+    }
+}
+
 template <typename ScalarParam>
 inline Geometry::Point<ScalarParam, 3>
 sphericalToCartesian(const Geometry::Point<ScalarParam, 2>& p,
@@ -23,11 +23,15 @@
 #ifndef _GdalImageFile_H_
 #define _GdalImageFile_H_
 
+#include <vector>
+
 #include <gdal.h>
 #include <gdal_priv.h>
 
 #include <construo/ImageFile.h>
 
+#include <construo/vrui.h>
+
 
 namespace crusta {
 
@@ -43,8 +47,25 @@ public:
     ///closes the image file
     virtual ~GdalImageFileBase();
 
+    ///the block size of the first raster band
+    virtual void getBlockSize(int blockSize[2]) const;
+
 protected:
+    /** reads the given region of a band, which must lie inside the image, into
+        a buffer where consecutive pixels are pixelStride bytes apart. Bands
+        already storing the requested type are read by native blocks, others
+        through GDAL's generic conversion. The datasetMutex must be held */
+    void readBand(GDALRasterBand* band, GDALDataType type, const int origin[2],
+                  const int readSize[2], uint8_t* buffer, int pixelStride,
+                  int rowStride) const;
+
     GDALDataset* dataset;
+    ///raster bands providing the channels of the pixels
+    std::vector<GDALRasterBand*> bands;
+    ///temporary buffer holding a native block of a band
+    mutable std::vector<uint8_t> blockBuf;
+    ///mutex protecting the dataset during reading
+    mutable Threads::Mutex datasetMutex;
 };
 
 template <typename PixelType>
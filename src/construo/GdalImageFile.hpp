@@ -1,4 +1,5 @@
 #include <cassert>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
 #include <limits>
@@ -121,6 +122,98 @@ GdalImageFileBase<PixelType>::
         GDALClose((GDALDatasetH)dataset);
 }
 
+template <typename PixelType>
+void GdalImageFileBase<PixelType>::
+getBlockSize(int blockSize[2]) const
+{
+    Threads::Mutex::Lock lock(datasetMutex);
+    GDALRasterBand* band = dataset->GetRasterCount()<1 ? NULL :
+                           dataset->GetRasterBand(1);
+    if (band != NULL)
+        band->GetBlockSize(&blockSize[0], &blockSize[1]);
+    else
+        ImageFile<PixelType>::getBlockSize(blockSize);
+}
+
+template <typename PixelType>
+void GdalImageFileBase<PixelType>::
+readBand(GDALRasterBand* band, GDALDataType type, const int origin[2],
+         const int readSize[2], uint8_t* buffer, int pixelStride,
+         int rowStride) const
+{
+    if (readSize[0]<=0 || readSize[1]<=0)
+        return;
+
+    if (band->GetRasterDataType() != type)
+    {
+        band->RasterIO(GF_Read, origin[0], origin[1], readSize[0], readSize[1],
+                       buffer, readSize[0], readSize[1], type, pixelStride,
+                       rowStride);
+        return;
+    }
+
+    int typeSize = GDALGetDataTypeSize(type) / 8;
+    int blockSize[2];
+    band->GetBlockSize(&blockSize[0], &blockSize[1]);
+    blockBuf.resize(size_t(blockSize[0]) * blockSize[1] * typeSize);
+
+    int first[2], last[2];
+    for (int i=0; i<2; ++i)
+    {
+        first[i] = origin[i] / blockSize[i];
+        last[i]  = (origin[i]+readSize[i]-1) / blockSize[i];
+    }
+
+    for (int by=first[1]; by<=last[1]; ++by)
+    {
+        for (int bx=first[0]; bx<=last[0]; ++bx)
+        {
+            if (band->ReadBlock(bx, by, &blockBuf.front()) != CE_None)
+            {
+                Misc::throwStdErr("GdalImageFile: unable to read block "
+                                  "(%d, %d)", bx, by);
+            }
+
+            //copy the overlap of the block and the region
+            int blockOrigin[2] = { bx*blockSize[0], by*blockSize[1] };
+            int min[2], max[2];
+            for (int i=0; i<2; ++i)
+            {
+                min[i] = std::max(blockOrigin[i], origin[i]);
+                max[i] = std::min(blockOrigin[i]+blockSize[i],
+                                  origin[i]+readSize[i]);
+            }
+
+            int rowLen = max[0] - min[0];
+            for (int y=min[1]; y<max[1]; ++y)
+            {
+                const uint8_t* src = &blockBuf[typeSize *
+                    (size_t(y-blockOrigin[1])*blockSize[0] +
+                     (min[0]-blockOrigin[0]))];
+                uint8_t* dst = buffer + size_t(y-origin[1])*rowStride +
+                               size_t(min[0]-origin[0])*pixelStride;
+
+                if (pixelStride == typeSize)
+                    memcpy(dst, src, size_t(rowLen)*typeSize);
+                else if (typeSize == 1)
+                {
+                    //interleave the channel into the pixels
+                    for (int x=0; x<rowLen; ++x, dst+=pixelStride)
+                        *dst = src[x];
+                }
+                else
+                {
+                    for (int x=0; x<rowLen; ++x, src+=typeSize,
+                         dst+=pixelStride)
+                    {
+                        memcpy(dst, src, typeSize);
+                    }
+                }
+            }
+        }
+    }
+}
+
 
 //- single channel float -------------------------------------------------------
 
@@ -138,10 +231,10 @@ public:
         if (numBands < 1)
             Misc::throwStdErr("GdalImageFile:DEM: no raster bands in the file");
 
-        GDALRasterBand* band = dataset->GetRasterBand(1);
+        bands.push_back(dataset->GetRasterBand(1));
 
         //try to retrieve the nodata value from the band
-        nodata = float(band->GetNoDataValue());
+        nodata = float(bands[0]->GetNoDataValue());
 
         //output the no-data value
         std::cout << "Internal nodata value:\n" << nodata << "\n";
@@ -152,12 +245,8 @@ public:
     virtual void readRectangle(const int rectOrigin[2], const int rectSize[2],
                                float* rectBuffer) const
     {
-        //retrieve raster bands from the data set
-        int numBands = dataset->GetRasterCount();
-        if (numBands < 1)
-            Misc::throwStdErr("GdalImageFile:DEM: no raster bands in the file");
-
-        GDALRasterBand* band = dataset->GetRasterBand(1);
+        //GDAL datasets must not be accessed concurrently
+        Threads::Mutex::Lock lock(datasetMutex);
 
         //clip the rectangle against the image's valid region
         int min[2], max[2];
@@ -176,9 +265,8 @@ assert(rectOrigin[i]+rectSize[i]-1 < size[i]);
         float* dst = rectBuffer + ( (min[1]-rectOrigin[1])*rectSize[0] +
                                         (min[0]-rectOrigin[0]) );
 
-        band->RasterIO(GF_Read, min[0], min[1], readSize[0], readSize[1],
-                       dst, readSize[0], readSize[1], GDT_Float32,
-                       sizeof(float), rowWidth);
+        readBand(bands[0], GDT_Float32, min, readSize,
+                 reinterpret_cast<uint8_t*>(dst), sizeof(float), rowWidth);
 
         //scale the pixel values
         if (pixelOffset!=0.0 || pixelScale!=1.0)
@@ -214,7 +302,6 @@ public:
                               "the file");
         }
 
-        std::vector<GDALRasterBand*> bands;
         bands.push_back(dataset->GetRasterBand(1));
 
         for (int i=1; i<Geometry::Vector<uint8_t,3>::dimension; ++i)
@@ -235,22 +322,8 @@ public:
     virtual void readRectangle(const int rectOrigin[2], const int rectSize[2],
                                Geometry::Vector<uint8_t,3>* rectBuffer) const
     {
-        //retrieve raster bands from the data set
-        int numBands = dataset->GetRasterCount();
-        if (numBands < 1)
-        {
-            Misc::throwStdErr("GdalImageFile:Color: no raster bands in "
-                              "the file");
-        }
-
-        std::vector<GDALRasterBand*> bands;
-        bands.push_back(dataset->GetRasterBand(1));
-
-        for (int i=1; i<Geometry::Vector<uint8_t,3>::dimension; ++i)
-        {
-            bands.push_back(numBands<i+1 ? bands[i-1] :
-                                           dataset->GetRasterBand(i+1));
-        }
+        //GDAL datasets must not be accessed concurrently
+        Threads::Mutex::Lock lock(datasetMutex);
 
         //clip the rectangle against the image's valid region
         int min[2], max[2];
@@ -271,9 +344,8 @@ assert(rectOrigin[i]+rectSize[i]-1 < size[i]);
 
         for (int i=0; i<Geometry::Vector<uint8_t,3>::dimension; ++i)
         {
-            bands[i]->RasterIO(GF_Read, min[0], min[1], readSize[0],readSize[1],
-                               &dst[0][i], readSize[0], readSize[1], GDT_Byte,
-                               sizeof(Geometry::Vector<uint8_t,3>), rowWidth);
+            readBand(bands[i], GDT_Byte, min, readSize, &dst[0][i],
+                     sizeof(Geometry::Vector<uint8_t,3>), rowWidth);
         }
 
         //scale the pixel values
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <vector>
 
 #include <construo/construoGlobals.h>
 #include <construo/Converters.h>
@@ -138,25 +139,7 @@ systemToImage(const Point& systemPoint) const
 {
     Point res = geoToPixel.transform(systemPoint);
     if (!pointSampled)
-    {
-        for (int i=0; i<2; ++i)
-        {
-            //map it to cell centered pixel look-up
-            res[i] -= Point::Scalar(0.5);
-
-            /* now we can have valid values half a pixel beyong the boundaries.
-               Snap these to the boundary pixel */
-            if (res[i]<Point::Scalar(0) && res[i]>=Point::Scalar(-0.5))
-            {
-                res[i] = Point::Scalar(0);
-            }
-            else if (res[i] >  Point::Scalar(imageSize[i]-1) &&
-                     res[i] <= Point::Scalar(imageSize[i]-1)+Point::Scalar(0.5))
-            {
-                res[i] = Point::Scalar(imageSize[i]-1);
-            }
-        }
-    }
+        snapToPixelCenters(res);
     return res;
 }
 
@@ -185,6 +168,7 @@ Point GdalTransform::
 systemToWorld(const Point& systemPoint) const
 {
     Point res = systemPoint;
+    Threads::Mutex::Lock lock(ogrMutex);
     if (!geoToWorld->Transform(1, &res[0], &res[1]))
     {
         std::cout << "GdalTransform::systemToWorld: failed to transform ("
@@ -198,6 +182,7 @@ Point GdalTransform::
 worldToSystem(const Point& worldPoint) const
 {
     Point res = worldPoint;
+    Threads::Mutex::Lock lock(ogrMutex);
     if (!worldToGeo->Transform(1, &res[0], &res[1]))
     {
         std::cout << "GdalTransform::systemToWorld: failed to transform ("
@@ -213,6 +198,7 @@ systemToWorld(const Box& systemBox) const
     Box::Scalar xs[2] = { systemBox.min[0], systemBox.max[0] };
     Box::Scalar ys[2] = { systemBox.min[1], systemBox.max[1] };
 
+    Threads::Mutex::Lock lock(ogrMutex);
     if (!geoToWorld->Transform(2, xs, ys))
     {
         std::cout << "GdalTransform::systemToWorld(Box): failed to transform {("
@@ -233,6 +219,7 @@ worldToSystem(const Box& worldBox) const
     Box::Scalar xs[2] = { worldBox.min[0], worldBox.max[0] };
     Box::Scalar ys[2] = { worldBox.min[1], worldBox.max[1] };
 
+    Threads::Mutex::Lock lock(ogrMutex);
     if (!worldToGeo->Transform(2, xs, ys))
     {
         std::cout << "GdalTransform::worldToSystem(Box): failed to transform {("
@@ -270,6 +257,57 @@ worldToImage(const Point& worldPoint) const
     return systemToImage(p);
 }
 
+void GdalTransform::
+worldToImage(const Point* worldPoints, Point* imagePoints,
+             size_t numPoints) const
+{
+    if (numPoints == 0)
+        return;
+
+    //the OGR transformation works on separate coordinate arrays
+    std::vector<Point::Scalar> xs(numPoints);
+    std::vector<Point::Scalar> ys(numPoints);
+    for (size_t i=0; i<numPoints; ++i)
+    {
+        xs[i] = worldPoints[i][0];
+        ys[i] = worldPoints[i][1];
+    }
+
+    {
+        Threads::Mutex::Lock lock(ogrMutex);
+        worldToGeo->Transform(int(numPoints), &xs.front(), &ys.front());
+    }
+
+    //apply the affine geo to pixel transformation
+    const Transform::Matrix& m = geoToPixel.getMatrix();
+    const Point::Scalar m00 = m(0,0), m01 = m(0,1), m02 = m(0,2);
+    const Point::Scalar m10 = m(1,0), m11 = m(1,1), m12 = m(1,2);
+    for (size_t i=0; i<numPoints; ++i)
+    {
+        imagePoints[i][0] = m00*xs[i] + m01*ys[i] + m02;
+        imagePoints[i][1] = m10*xs[i] + m11*ys[i] + m12;
+    }
+
+    /* OGR flags the points it failed to transform with HUGE_VAL. Keep them
+       out of the image */
+    size_t numFailed = 0;
+    for (size_t i=0; i<numPoints; ++i)
+    {
+        if (xs[i]==HUGE_VAL || ys[i]==HUGE_VAL)
+        {
+            imagePoints[i] = Point(HUGE_VAL, HUGE_VAL);
+            ++numFailed;
+        }
+        else if (!pointSampled)
+            snapToPixelCenters(imagePoints[i]);
+    }
+    if (numFailed != 0)
+    {
+        std::cout << "GdalTransform::worldToImage: failed to transform " <<
+                     numFailed << " of " << numPoints << " points" << std::endl;
+    }
+}
+
 Box GdalTransform::
 imageToWorld(const Box& imageBox) const
 {
@@ -303,4 +341,29 @@ getFileSize() const
     return 0;
 }
 
+
+void GdalTransform::
+snapToPixelCenters(Point& imagePoint) const
+{
+    for (int i=0; i<2; ++i)
+    {
+        //map it to cell centered pixel look-up
+        imagePoint[i] -= Point::Scalar(0.5);
+
+        /* now we can have valid values half a pixel beyong the boundaries.
+           Snap these to the boundary pixel */
+        if (imagePoint[i]<Point::Scalar(0) &&
+            imagePoint[i]>=Point::Scalar(-0.5))
+        {
+            imagePoint[i] = Point::Scalar(0);
+        }
+        else if (imagePoint[i] >  Point::Scalar(imageSize[i]-1) &&
+                 imagePoint[i] <= Point::Scalar(imageSize[i]-1) +
+                                  Point::Scalar(0.5))
+        {
+            imagePoint[i] = Point::Scalar(imageSize[i]-1);
+        }
+    }
+}
+
 } //namespace crusta
@@ -60,6 +60,8 @@ public:
     virtual Point imageToWorld(const Point& imagePoint) const;
     virtual Point imageToWorld(int imageX,int imageY) const;
     virtual Point worldToImage(const Point& worldPoint) const;
+    virtual void worldToImage(const Point* worldPoints, Point* imagePoints,
+                              size_t numPoints) const;
 	virtual Box imageToWorld(const Box& imageBox) const;
 	virtual Box worldToImage(const Box& worldBox) const;
 
@@ -69,6 +71,10 @@ public:
 private:
     typedef Geometry::AffineTransformation<Point::Scalar, 2> Transform;
 
+    /** maps pixel corner coordinates to pixel centers for area sampled images,
+        snapping samples within half a pixel of the boundary onto it */
+    void snapToPixelCenters(Point& imagePoint) const;
+
     /** converts from pixel coordinates to georeferenced ones */
     Transform pixelToGeo;
     /** converts from georeferenced coordinates to pixel ones */
@@ -77,6 +83,8 @@ private:
     OGRCoordinateTransformation* geoToWorld;
     /** converts from construo world coordinates to georeferenced ones */
     OGRCoordinateTransformation* worldToGeo;
+    /** serializes use of the OGR transformations, which are not reentrant */
+    mutable Threads::Mutex ogrMutex;
 };
 
 } //namespace crusta
@@ -110,6 +110,20 @@ worldToImage(const Point& worldPoint) const
                  (Math::deg(worldPoint[1]) - offset[1]) / scale[1]);
 }
 
+void GeoTransform::
+worldToImage(const Point* worldPoints, Point* imagePoints,
+             size_t numPoints) const
+{
+    //same arithmetic as the single point version, to match it exactly
+    for (size_t i=0; i<numPoints; ++i)
+    {
+        imagePoints[i][0] = (Math::deg(worldPoints[i][0]) - offset[0]) /
+                            scale[0];
+        imagePoints[i][1] = (Math::deg(worldPoints[i][1]) - offset[1]) /
+                            scale[1];
+    }
+}
+
 Box GeoTransform::
 imageToWorld(const Box& imageBox) const
 {
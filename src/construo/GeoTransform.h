@@ -44,6 +44,8 @@ public:
 	virtual Point imageToWorld(const Point& imagePoint) const;
 	virtual Point imageToWorld(int imageX,int imageY) const;
 	virtual Point worldToImage(const Point& worldPoint) const;
+	virtual void worldToImage(const Point* worldPoints, Point* imagePoints,
+	                          size_t numPoints) const;
 	virtual Box imageToWorld(const Box& imageBox) const;
 	virtual Box worldToImage(const Box& worldBox) const;
 	virtual bool isCompatible(const ImageTransform& other) const;
@@ -54,6 +54,9 @@ public:
     void setNodata(const PixelType& nodataValue);
     /** returns image size */
     const int* getSize() const;
+    /** retrieve the size of the blocks in which the image is stored natively.
+        Reading rectangles aligned with the blocks is most efficient */
+    virtual void getBlockSize(int blockSize[2]) const;
     /** reads a rectangle of pixel data into the given buffer */
     virtual void readRectangle(const int rectOrigin[2], const int rectSize[2],
                                PixelType* rectBuffer) const = 0;
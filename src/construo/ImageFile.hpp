@@ -97,4 +97,14 @@ getSize() const
     return size;
 }
 
+template <class PixelType>
+inline
+void ImageFile<PixelType>::
+getBlockSize(int blockSize[2]) const
+{
+    //no particular layout, favor square blocks
+    blockSize[0] = 256;
+    blockSize[1] = 256;
+}
+
 } //namespace crusta
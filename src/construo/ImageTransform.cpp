@@ -141,6 +141,14 @@ worldToImage(const Point& worldPoint) const
                  (systemPoint[1]-offset[1]) / scale[1]);
 }
 
+void ImageTransform::
+worldToImage(const Point* worldPoints, Point* imagePoints,
+             size_t numPoints) const
+{
+    for (size_t i=0; i<numPoints; ++i)
+        imagePoints[i] = worldToImage(worldPoints[i]);
+}
+
 Box ImageTransform::
 imageToWorld(const Box& imageBox) const
 {
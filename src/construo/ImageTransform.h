@@ -80,6 +80,11 @@ public:
     virtual Point imageToWorld(int imageX, int imageY) const;
     ///directly converts a point from world to image coordinates
     virtual Point worldToImage(const Point& worldPoint) const;
+    /** directly converts an array of points from world to image coordinates.
+        The two arrays may be the same. Derived transformations should
+        override this to amortize per point costs over the whole array */
+    virtual void worldToImage(const Point* worldPoints, Point* imagePoints,
+                              size_t numPoints) const;
     ///directly converts a box from image to world coordinates
     virtual Box imageToWorld(const Box& imageBox) const;
     ///directly converts a box from world to image coordinates
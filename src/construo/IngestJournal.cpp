@@ -0,0 +1,131 @@
+#include <construo/IngestJournal.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <unistd.h>
+
+#include <construo/vrui.h>
+
+
+namespace crusta {
+
+
+IngestJournal::
+IngestJournal() :
+    file(NULL), coarseLevel(-1)
+{
+}
+
+IngestJournal::
+~IngestJournal()
+{
+    if (file != NULL)
+        fclose(file);
+}
+
+void IngestJournal::
+open(const std::string& globePath)
+{
+    path = globePath + std::string("/construo.journal");
+    sources.clear();
+    coarseLevel = -1;
+
+    //load the entries of an interrupted update
+    std::ifstream journal(path.c_str());
+    std::string line;
+    while (std::getline(journal, line))
+    {
+        if (line.compare(0, 7, "source ") == 0)
+        {
+            if (coarseLevel != -1)
+            {
+                Misc::throwStdErr("IngestJournal: source entry following a "
+                                  "coarse level entry in %s", path.c_str());
+            }
+            sources.push_back(line.substr(7));
+        }
+        else if (line.compare(0, 7, "coarse ") == 0)
+            coarseLevel = atoi(line.c_str() + 7);
+        else if (!line.empty())
+        {
+            Misc::throwStdErr("IngestJournal: invalid entry \"%s\" in %s",
+                              line.c_str(), path.c_str());
+        }
+    }
+
+    file = fopen(path.c_str(), "a");
+    if (file == NULL)
+    {
+        Misc::throwStdErr("IngestJournal: unable to open %s (%s)",
+                          path.c_str(), strerror(errno));
+    }
+}
+
+void IngestJournal::
+remove()
+{
+    if (file != NULL)
+    {
+        fclose(file);
+        file = NULL;
+    }
+    unlink(path.c_str());
+
+    sources.clear();
+    coarseLevel = -1;
+}
+
+const std::vector<std::string>& IngestJournal::
+getSources() const
+{
+    return sources;
+}
+
+bool IngestJournal::
+hasCoarseLevel() const
+{
+    return coarseLevel != -1;
+}
+
+int IngestJournal::
+getCoarseLevel() const
+{
+    return coarseLevel;
+}
+
+void IngestJournal::
+addSource(const std::string& source)
+{
+    append(std::string("source ") + source);
+    sources.push_back(source);
+}
+
+void IngestJournal::
+addCoarseLevel(int level)
+{
+    char entry[32];
+    snprintf(entry, sizeof(entry), "coarse %d", level);
+    append(entry);
+    coarseLevel = level;
+}
+
+
+void IngestJournal::
+append(const std::string& entry)
+{
+    if (file == NULL)
+        Misc::throwStdErr("IngestJournal: journal is not open");
+
+    if (fprintf(file, "%s\n", entry.c_str()) < 0 || fflush(file) != 0 ||
+        fsync(fileno(file)) != 0)
+    {
+        Misc::throwStdErr("IngestJournal: unable to write to %s (%s)",
+                          path.c_str(), strerror(errno));
+    }
+}
+
+
+} //namespace crusta
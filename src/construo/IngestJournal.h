@@ -0,0 +1,64 @@
+#ifndef _IngestJournal_H_
+#define _IngestJournal_H_
+
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+
+namespace crusta {
+
+
+/** records the progress of an update of a globe file, such that an update
+    that was interrupted can be resumed without redoing the finished work. The
+    journal is a text file next to the configuration of the globe file listing
+    the source images that have been added and the coarser levels that have
+    been resampled since, in that order. Entries are synced to disk as they
+    are added. */
+class IngestJournal
+{
+public:
+    IngestJournal();
+    ~IngestJournal();
+
+    /** opens the journal of the given globe file, loading the entries of an
+        interrupted update if there are any */
+    void open(const std::string& globePath);
+    /** removes the journal once the update has completed */
+    void remove();
+
+    /** returns the identifiers of the source images that have been added */
+    const std::vector<std::string>& getSources() const;
+    /** checks if the resampling of the coarser levels has started */
+    bool hasCoarseLevel() const;
+    /** returns the last coarser level that has been resampled */
+    int getCoarseLevel() const;
+
+    /** records a source image as added. The data of the globe file must have
+        been committed to disk beforehand */
+    void addSource(const std::string& source);
+    /** records a coarser level as resampled. The data of the globe file must
+        have been committed to disk beforehand */
+    void addCoarseLevel(int level);
+
+protected:
+    ///appends an entry to the journal file and syncs it to disk
+    void append(const std::string& entry);
+
+    ///path of the journal file
+    std::string path;
+    ///handle of the journal file opened for appending (NULL if not open)
+    FILE* file;
+
+    ///identifiers of the added source images
+    std::vector<std::string> sources;
+    ///last resampled coarser level (-1 if none)
+    int coarseLevel;
+};
+
+
+} //namespace crusta
+
+
+#endif //_IngestJournal_H_
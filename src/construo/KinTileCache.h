@@ -0,0 +1,81 @@
+#ifndef _KinTileCache_H_
+#define _KinTileCache_H_
+
+
+#include <list>
+#include <map>
+#include <ostream>
+#include <vector>
+
+#include <crustacore/GlobeData.h>
+#include <crustacore/TileIndex.h>
+
+#include <construo/vrui.h>
+
+
+namespace crusta {
+
+
+/** small LRU cache of the tiles read to assemble the subsampling domains of
+    the coarse levels. Neighboring nodes share most of their kin, such that
+    resampling them in tree order reads the same tiles repeatedly. The cached
+    tiles must not be modified while the cache is in use. */
+template <typename PixelParam>
+class KinTileCache
+{
+public:
+    typedef typename PixelParam::Type  PixelType;
+    typedef GlobeData<PixelParam>      gd;
+    typedef typename gd::File          File;
+
+    KinTileCache(size_t iCapacity, size_t iTileNumPixels);
+
+    /** copies the tile of the given patch into the buffer, reading it from the
+        file if it isn't cached */
+    void readTile(File* file, uint8_t patch, TileIndex tileIndex,
+                  PixelType* buffer);
+    ///drops all the cached tiles
+    void clear();
+
+    ///print the access statistics
+    void printStats(std::ostream& os) const;
+
+protected:
+    typedef std::pair<uint8_t, TileIndex> TileKey;
+
+    struct Tile
+    {
+        TileKey                key;
+        std::vector<PixelType> pixels;
+    };
+
+    typedef std::list<Tile>                              TileList;
+    typedef std::map<TileKey, typename TileList::iterator> TileMap;
+
+    ///maximum number of cached tiles
+    size_t capacity;
+    ///number of pixels in a tile
+    size_t tileNumPixels;
+
+    ///the cached tiles ordered from most to least recently used
+    TileList lru;
+    ///lookup of the cached tiles
+    TileMap tiles;
+
+    ///number of reads served from the cache
+    size_t hits;
+    ///number of reads that went to the files
+    size_t misses;
+
+    ///serializes access to the cache
+    mutable Threads::Mutex cacheMutex;
+};
+
+
+} //namespace crusta
+
+
+#include <construo/KinTileCache.hpp>
+
+
+#endif //_KinTileCache_H_
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <iomanip>
+
+
+namespace crusta {
+
+
+template <typename PixelParam>
+KinTileCache<PixelParam>::
+KinTileCache(size_t iCapacity, size_t iTileNumPixels) :
+    capacity(iCapacity), tileNumPixels(iTileNumPixels), hits(0), misses(0)
+{
+}
+
+template <typename PixelParam>
+void KinTileCache<PixelParam>::
+readTile(File* file, uint8_t patch, TileIndex tileIndex, PixelType* buffer)
+{
+    TileKey key(patch, tileIndex);
+
+    {
+        Threads::Mutex::Lock lock(cacheMutex);
+        typename TileMap::iterator it = tiles.find(key);
+        if (it != tiles.end())
+        {
+            ++hits;
+            lru.splice(lru.begin(), lru, it->second);
+            std::copy(it->second->pixels.begin(), it->second->pixels.end(),
+                      buffer);
+            return;
+        }
+        ++misses;
+    }
+
+    //read the tile without holding the cache
+    file->readTile(tileIndex, buffer);
+    if (capacity == 0)
+        return;
+
+    Threads::Mutex::Lock lock(cacheMutex);
+    //another thread might have read the same tile in the meantime
+    if (tiles.find(key) != tiles.end())
+        return;
+
+    //recycle the least recently used tile if the cache is full
+    if (tiles.size() >= capacity)
+    {
+        tiles.erase(lru.back().key);
+        lru.splice(lru.begin(), lru, --lru.end());
+    }
+    else
+    {
+        lru.push_front(Tile());
+        lru.front().pixels.resize(tileNumPixels);
+    }
+
+    Tile& tile = lru.front();
+    tile.key   = key;
+    std::copy(buffer, buffer+tileNumPixels, tile.pixels.begin());
+    tiles.insert(typename TileMap::value_type(key, lru.begin()));
+}
+
+template <typename PixelParam>
+void KinTileCache<PixelParam>::
+clear()
+{
+    Threads::Mutex::Lock lock(cacheMutex);
+    tiles.clear();
+    lru.clear();
+}
+
+template <typename PixelParam>
+void KinTileCache<PixelParam>::
+printStats(std::ostream& os) const
+{
+    Threads::Mutex::Lock lock(cacheMutex);
+    size_t numReads = hits + misses;
+    double hitRate  = numReads==0 ? 0.0 : 100.0*hits/numReads;
+    os << "Kin tile cache: " << hits << " hits, " << misses << " misses (" <<
+          std::fixed << std::setprecision(1) << hitRate << "% hit rate)" <<
+          std::endl;
+}
+
+
+} //namespace crusta
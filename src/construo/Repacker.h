@@ -0,0 +1,85 @@
+#ifndef _Repacker_H_
+#define _Repacker_H_
+
+#include <string>
+#include <vector>
+
+#include <crustacore/GlobeFile.h>
+#include <crustacore/TreeIndex.h>
+
+#include <construo/vrui.h>
+
+
+namespace crusta {
+
+
+class RepackerBase
+{
+public:
+    ///order in which the tiles of a patch are laid out in the repacked file
+    enum Layout
+    {
+        /** level by level. Siblings are contiguous and the levels are stored
+            coarse to fine */
+        LAYOUT_BREADTH_FIRST,
+        /** the four children of a node are stored contiguously, followed by
+            the subtrees of each of the children. Keeps subtrees clustered */
+        LAYOUT_DEPTH_FIRST
+    };
+
+    virtual ~RepackerBase(){}
+
+    /** rewrites the tiles of the source globe file into a new globe file using
+        the specified layout. Tiles that are not reachable from the roots are
+        dropped. New globe files are compressed if requested or if the source
+        file is */
+    virtual void repack(const std::string& sourceName,
+                        const std::string& destinationName,
+                        Layout layout, bool compress) = 0;
+    /** walks the trees of the two globe files and checks that they have the
+        same structure and identical tiles. Returns the number of mismatching
+        nodes */
+    virtual size_t verify(const std::string& firstName,
+                          const std::string& secondName) = 0;
+};
+
+template <typename PixelParam>
+class Repacker : public RepackerBase
+{
+public:
+    void repack(const std::string& sourceName,
+                const std::string& destinationName, Layout layout,
+                bool compress);
+    size_t verify(const std::string& firstName, const std::string& secondName);
+
+protected:
+    typedef typename PixelParam::Type    PixelType;
+    typedef GlobeFile<PixelParam>        Globe;
+    typedef typename Globe::File         File;
+    typedef typename File::TileHeader    TileHeader;
+    typedef std::vector<TileIndex>       TileIndices;
+
+    /** determines the order of the tiles reachable from the root of the file.
+        Returns the old indices in their new order along with the child
+        pointers of the reachable tiles (four per old index) */
+    void computeOrder(File* file, Layout layout, TileIndices& order,
+                      TileIndices& children);
+    /** computes the average distance, in tiles, between the parents and their
+        children when the tiles are stored at the given indices. An empty set
+        of indices refers to the current layout */
+    double computeParentChildDistance(const TileIndices& order,
+                                      const TileIndices& children,
+                                      const TileIndices& newIndices);
+    ///compares the tiles of the two subtrees rooted at the given tiles
+    size_t verifySubtree(File* first, File* second, TileIndex firstTile,
+                         TileIndex secondTile, const TreeIndex& node);
+};
+
+
+} //namespace crusta
+
+
+#include <construo/Repacker.hpp>
+
+
+#endif //_Repacker_H_
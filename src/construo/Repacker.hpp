@@ -0,0 +1,291 @@
+#include <cassert>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <sys/stat.h>
+
+
+namespace crusta {
+
+
+template <typename PixelParam>
+void Repacker<PixelParam>::
+repack(const std::string& sourceName, const std::string& destinationName,
+       Layout layout, bool compress)
+{
+    //never merge into existing data
+    struct stat statBuffer;
+    if (stat(destinationName.c_str(), &statBuffer) == 0)
+    {
+        Misc::throwStdErr("Repack destination %s already exists",
+                          destinationName.c_str());
+    }
+
+    //the source is read in tree order, serve it from a mapping if possible
+    Globe source(false, true);
+    source.open(sourceName);
+
+    Globe destination(true);
+    destination.setCompressed(compress || source.isCompressed());
+    destination.open(destinationName);
+
+    //the destination is created with the defaults, make sure they match
+    if (destination.getPolyhedronType() != source.getPolyhedronType() ||
+        memcmp(&destination.getNodata(), &source.getNodata(),
+               sizeof(PixelType)) != 0)
+    {
+        Misc::throwStdErr("Unable to repack %s: its polyhedron or nodata value "
+                          "differ from the defaults of new globe files",
+                          sourceName.c_str());
+    }
+
+    const int* tileSize = source.getTileSize();
+    std::vector<PixelType> pixels(tileSize[0]*tileSize[1]);
+
+    int numPatches = source.getNumPatches();
+    for (int patch=0; patch<numPatches; ++patch)
+    {
+        File* src = source.getPatch(patch);
+        File* dst = destination.getPatch(patch);
+
+        std::cout << "Repacking patch " << patch+1 << " out of " <<
+                     numPatches;
+        std::cout.flush();
+
+        TileIndices order;
+        TileIndices children;
+        computeOrder(src, layout, order, children);
+
+        TileIndices newIndices(src->getNumTiles(), INVALID_TILEINDEX);
+        for (size_t i=0; i<order.size(); ++i)
+            newIndices[order[i]] = TileIndex(i);
+
+        for (size_t i=0; i<order.size(); ++i)
+        {
+            TileIndex  childPointers[4];
+            TileHeader header;
+            src->readTile(order[i], childPointers, header, &pixels.front());
+
+            for (int c=0; c<4; ++c)
+            {
+                if (childPointers[c] != INVALID_TILEINDEX)
+                    childPointers[c] = newIndices[childPointers[c]];
+            }
+
+            //the root already exists in the new file
+            if (i == 0)
+            {
+                dst->writeTile(0, childPointers, header, &pixels.front());
+            }
+            else
+            {
+                TileIndex tile = dst->appendTile(&pixels.front());
+                assert(tile == TileIndex(i));
+                dst->writeTile(tile, childPointers, header);
+            }
+        }
+
+        std::cout << ": " << order.size() << " tiles";
+        if (order.size() != size_t(src->getNumTiles()))
+        {
+            std::cout << " (dropped " << src->getNumTiles()-order.size() <<
+                         " unreachable)";
+        }
+        std::cout << ", average parent to child distance " <<
+                     computeParentChildDistance(order, children,
+                                                TileIndices()) << " -> " <<
+                     computeParentChildDistance(order, children, newIndices) <<
+                     " tiles" << std::endl;
+    }
+}
+
+template <typename PixelParam>
+size_t Repacker<PixelParam>::
+verify(const std::string& firstName, const std::string& secondName)
+{
+    Globe first(false);
+    first.open(firstName);
+    Globe second(false);
+    second.open(secondName);
+
+    if (first.getNumPatches() != second.getNumPatches())
+    {
+        Misc::throwStdErr("Globe files %s and %s have different numbers of "
+                          "patches", firstName.c_str(), secondName.c_str());
+    }
+
+    size_t numMismatches = 0;
+    for (int patch=0; patch<first.getNumPatches(); ++patch)
+    {
+        numMismatches += verifySubtree(first.getPatch(patch),
+                                       second.getPatch(patch), 0, 0,
+                                       TreeIndex(patch));
+    }
+    return numMismatches;
+}
+
+
+template <typename PixelParam>
+void Repacker<PixelParam>::
+computeOrder(File* file, Layout layout, TileIndices& order,
+             TileIndices& children)
+{
+    TileIndex numTiles = file->getNumTiles();
+    children.clear();
+    children.resize(4*size_t(numTiles), INVALID_TILEINDEX);
+
+    order.clear();
+    order.reserve(numTiles);
+    if (numTiles == 0)
+        return;
+
+    std::vector<bool> visited(numTiles, false);
+
+    /* breadth-first visits the pending tiles in FIFO order, depth-first in
+       LIFO order. In both cases all the children of a visited tile are added
+       to the order together, keeping the siblings contiguous */
+    std::deque<TileIndex> pending;
+    pending.push_back(0);
+    order.push_back(0);
+    visited[0] = true;
+    while (!pending.empty())
+    {
+        TileIndex tile;
+        if (layout == LAYOUT_BREADTH_FIRST)
+        {
+            tile = pending.front();
+            pending.pop_front();
+        }
+        else
+        {
+            tile = pending.back();
+            pending.pop_back();
+        }
+
+        TileIndex* childPointers = &children[4*size_t(tile)];
+        TileHeader header;
+        file->readTile(tile, childPointers, header);
+
+        for (int c=0; c<4; ++c)
+        {
+            TileIndex child = childPointers[c];
+            if (child == INVALID_TILEINDEX)
+                continue;
+            if (child>=numTiles || visited[child])
+            {
+                Misc::throwStdErr("Tile %u references invalid or already "
+                                  "referenced child tile %u", tile, child);
+            }
+            visited[child] = true;
+            order.push_back(child);
+        }
+
+        //depth-first must process the first child first, so push in reverse
+        if (layout == LAYOUT_BREADTH_FIRST)
+        {
+            for (int c=0; c<4; ++c)
+            {
+                if (childPointers[c] != INVALID_TILEINDEX)
+                    pending.push_back(childPointers[c]);
+            }
+        }
+        else
+        {
+            for (int c=3; c>=0; --c)
+            {
+                if (childPointers[c] != INVALID_TILEINDEX)
+                    pending.push_back(childPointers[c]);
+            }
+        }
+    }
+}
+
+template <typename PixelParam>
+double Repacker<PixelParam>::
+computeParentChildDistance(const TileIndices& order,
+                           const TileIndices& children,
+                           const TileIndices& newIndices)
+{
+    double distance    = 0.0;
+    size_t numChildren = 0;
+    for (typename TileIndices::const_iterator it=order.begin();
+         it!=order.end(); ++it)
+    {
+        for (int c=0; c<4; ++c)
+        {
+            TileIndex child = children[4*size_t(*it) + c];
+            if (child == INVALID_TILEINDEX)
+                continue;
+
+            double parentPos = newIndices.empty() ? *it : newIndices[*it];
+            double childPos  = newIndices.empty() ? child : newIndices[child];
+            distance += Math::abs(childPos - parentPos);
+            ++numChildren;
+        }
+    }
+    return numChildren==0 ? 0.0 : distance / numChildren;
+}
+
+template <typename PixelParam>
+size_t Repacker<PixelParam>::
+verifySubtree(File* first, File* second, TileIndex firstTile,
+              TileIndex secondTile, const TreeIndex& node)
+{
+    TileIndex  firstChildren[4];
+    TileIndex  secondChildren[4];
+    TileHeader firstHeader;
+    TileHeader secondHeader;
+
+    const uint32_t* tileSize = first->getTileSize();
+    size_t numPixels = tileSize[0] * tileSize[1];
+    std::vector<PixelType> firstPixels(numPixels);
+    std::vector<PixelType> secondPixels(numPixels);
+
+    if (!first->readTile(firstTile, firstChildren, firstHeader,
+                         &firstPixels.front()) ||
+        !second->readTile(secondTile, secondChildren, secondHeader,
+                          &secondPixels.front()))
+    {
+        std::cerr << "Node " << node << ": missing tile" << std::endl;
+        return 1;
+    }
+
+    size_t numMismatches = 0;
+
+    //compare the headers by their raw encoding
+    uint8_t firstHeaderBuf[64];
+    uint8_t secondHeaderBuf[64];
+    assert(TileHeader::getSize() <= sizeof(firstHeaderBuf));
+    firstHeader.write(firstHeaderBuf);
+    secondHeader.write(secondHeaderBuf);
+    if (memcmp(firstHeaderBuf, secondHeaderBuf, TileHeader::getSize())!=0 ||
+        memcmp(&firstPixels.front(), &secondPixels.front(),
+               numPixels*sizeof(PixelType)) != 0)
+    {
+        std::cerr << "Node " << node << ": tile data differs" << std::endl;
+        ++numMismatches;
+    }
+
+    for (int c=0; c<4; ++c)
+    {
+        bool hasFirst  = firstChildren[c]  != INVALID_TILEINDEX;
+        bool hasSecond = secondChildren[c] != INVALID_TILEINDEX;
+        if (hasFirst != hasSecond)
+        {
+            std::cerr << "Node " << node.down(c) << ": only present in " <<
+                         (hasFirst ? "the first" : "the second") <<
+                         " globe file" << std::endl;
+            ++numMismatches;
+        }
+        else if (hasFirst)
+        {
+            numMismatches += verifySubtree(first, second, firstChildren[c],
+                                           secondChildren[c], node.down(c));
+        }
+    }
+
+    return numMismatches;
+}
+
+
+} //namespace crusta
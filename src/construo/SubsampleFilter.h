@@ -38,6 +38,23 @@ struct SubsampleFilter
                              const PixelType& globeNodata);
 };
 
+/** fixed subsampled lookups for a whole tile. The tile samples every other
+    pixel of the domain starting at the first lookup. By default the lookups
+    are performed one at a time using the corresponding SubsampleFilter. */
+template <typename PixelType, SubsampleFilterType FilterParam>
+struct SubsampleTileFilter
+{
+    /** number of scratch values required to subsample a tile of the given
+        size */
+    static size_t scratchSize(const size_t size[2]);
+
+    /** subsample a tile of the given size into out (requires knowledge on the
+        row length of the domain) */
+    static void sample(PixelType* at, int rowLen, const size_t size[2],
+                       PixelType* out, const PixelType& globeNodata,
+                       double* scratch);
+};
+
 
 } //namespace crusta
 
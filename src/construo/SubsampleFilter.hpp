@@ -379,6 +379,235 @@ struct SubsampleFilter<Geometry::Vector<uint8_t,3>, SUBSAMPLEFILTER_LANCZOS5>
 };
 
 
+//- tile lookups ----------------------------------------------------------------
+
+template <typename PixelType, SubsampleFilterType FilterParam>
+size_t SubsampleTileFilter<PixelType, FilterParam>::
+scratchSize(const size_t[2])
+{
+    return 0;
+}
+
+template <typename PixelType, SubsampleFilterType FilterParam>
+void SubsampleTileFilter<PixelType, FilterParam>::
+sample(PixelType* at, int rowLen, const size_t size[2], PixelType* out,
+       const PixelType& globeNodata, double*)
+{
+    typedef SubsampleFilter<PixelType, FilterParam> Filter;
+
+    for (size_t y=0; y<size[1]; ++y)
+    {
+        PixelType* row = at + 2*y*rowLen;
+        for (size_t x=0; x<size[0]; ++x, ++out)
+            *out = Filter::sample(row + 2*x, rowLen, globeNodata);
+    }
+}
+
+
+/** separable evaluation of the lanczos5 kernel over a tile. The domain region
+    covered by the tile is split into planes holding the channel values and
+    the validity mask of the pixels, with the invalid values zeroed. Each plane
+    is then filtered with a horizontal pass followed by a vertical one.
+    Normalizing the filtered values by the filtered mask is equivalent to the
+    per pixel lookups that skip the invalid pixels. */
+struct Lanczos5TileKernel
+{
+    static const int radius = 10;
+
+    static const double* weights()
+    {
+        static const double weightStorage[21] = {
+             7.60213661720011e-34,  0.00386785330198227,  -4.5610817871754e-18,
+              -0.0167391813072476, 9.83998047615722e-18,    0.0405539013275657,
+            -1.47599707142358e-17,  -0.0911355426727928,  1.82443271487016e-17,
+                0.313296117460564,    0.500313703779858,     0.313296117460564,
+             1.82443271487016e-17,  -0.0911355426727928, -1.47599707142358e-17,
+               0.0405539013275657, 9.83998047615722e-18,   -0.0167391813072476,
+             -4.5610817871754e-18,  0.00386785330198227,  7.60213661720011e-34};
+        return weightStorage;
+    }
+
+    ///size of the domain region covered by a tile
+    static void getPlaneSize(const size_t size[2], size_t planeSize[2])
+    {
+        planeSize[0] = 2*(size[0]-1) + 2*radius + 1;
+        planeSize[1] = 2*(size[1]-1) + 2*radius + 1;
+    }
+
+    /** scratch required for the given number of value planes plus the mask
+        plane */
+    static size_t scratchSize(const size_t size[2], int numChannels)
+    {
+        size_t planeSize[2];
+        getPlaneSize(size, planeSize);
+        return (numChannels+1) * (planeSize[0]*planeSize[1] + size[0]*size[1]) +
+               size[0]*planeSize[1];
+    }
+
+    /** filter a plane of the size covered by the tile. The horizontal buffer
+        holds the intermediate results (size[0] x planeSize[1]) */
+    static void filter(const double* plane, const size_t size[2],
+                       double* horizontal, double* out)
+    {
+        const double* w = weights();
+        size_t planeSize[2];
+        getPlaneSize(size, planeSize);
+
+        //horizontal pass over all the rows of the plane
+        for (size_t y=0; y<planeSize[1]; ++y)
+        {
+            const double* row = plane + y*planeSize[0];
+            double* h         = horizontal + y*size[0];
+            for (size_t x=0; x<size[0]; ++x)
+                h[x] = 0.0;
+            for (int t=0; t<2*radius+1; ++t)
+            {
+                const double  wt  = w[t];
+                const double* src = row + t;
+                for (size_t x=0; x<size[0]; ++x)
+                    h[x] += wt * src[2*x];
+            }
+        }
+
+        //vertical pass over every other row of the intermediate results
+        for (size_t y=0; y<size[1]; ++y)
+        {
+            double* o = out + y*size[0];
+            for (size_t x=0; x<size[0]; ++x)
+                o[x] = 0.0;
+            for (int t=0; t<2*radius+1; ++t)
+            {
+                const double  wt  = w[t];
+                const double* src = horizontal + (2*y+t)*size[0];
+                for (size_t x=0; x<size[0]; ++x)
+                    o[x] += wt * src[x];
+            }
+        }
+    }
+};
+
+template <>
+struct SubsampleTileFilter<float, SUBSAMPLEFILTER_LANCZOS5>
+{
+    static size_t scratchSize(const size_t size[2])
+    {
+        return Lanczos5TileKernel::scratchSize(size, 1);
+    }
+
+    static void sample(float* at, int rowLen, const size_t size[2], float* out,
+                       const float& globeNodata, double* scratch)
+    {
+        typedef Lanczos5TileKernel Kernel;
+
+        size_t planeSize[2];
+        Kernel::getPlaneSize(size, planeSize);
+        const size_t planeLen = planeSize[0]*planeSize[1];
+        const size_t tileLen  = size[0]*size[1];
+
+        double* mask       = scratch;
+        double* values     = mask   + planeLen;
+        double* horizontal = values + planeLen;
+        double* weightSums = horizontal + size[0]*planeSize[1];
+        double* valueSums  = weightSums + tileLen;
+
+        //split the covered domain into the masked value and mask planes
+        const float* base = at - Kernel::radius*rowLen - Kernel::radius;
+        for (size_t y=0; y<planeSize[1]; ++y)
+        {
+            const float* row = base + y*rowLen;
+            double* m        = mask   + y*planeSize[0];
+            double* v        = values + y*planeSize[0];
+            for (size_t x=0; x<planeSize[0]; ++x)
+            {
+                m[x] = row[x]!=globeNodata ? 1.0 : 0.0;
+                v[x] = row[x]!=globeNodata ? double(row[x]) : 0.0;
+            }
+        }
+
+        Kernel::filter(mask,   size, horizontal, weightSums);
+        Kernel::filter(values, size, horizontal, valueSums);
+
+        for (size_t i=0; i<tileLen; ++i)
+        {
+            out[i] = weightSums[i]==0.0 ? globeNodata :
+                                          float(valueSums[i] / weightSums[i]);
+        }
+    }
+};
+
+template <>
+struct SubsampleTileFilter<Geometry::Vector<uint8_t,3>,SUBSAMPLEFILTER_LANCZOS5>
+{
+    typedef Geometry::Vector<uint8_t,3> PixelType;
+
+    static size_t scratchSize(const size_t size[2])
+    {
+        return Lanczos5TileKernel::scratchSize(size, PixelType::dimension);
+    }
+
+    static void sample(PixelType* at, int rowLen, const size_t size[2],
+                       PixelType* out, const PixelType& globeNodata,
+                       double* scratch)
+    {
+        typedef Lanczos5TileKernel Kernel;
+        static const int numChannels = PixelType::dimension;
+
+        size_t planeSize[2];
+        Kernel::getPlaneSize(size, planeSize);
+        const size_t planeLen = planeSize[0]*planeSize[1];
+        const size_t tileLen  = size[0]*size[1];
+
+        double* mask = scratch;
+        double* values[numChannels];
+        for (int c=0; c<numChannels; ++c)
+            values[c] = mask + (c+1)*planeLen;
+        double* horizontal = mask + (numChannels+1)*planeLen;
+        double* weightSums = horizontal + size[0]*planeSize[1];
+        double* valueSums[numChannels];
+        for (int c=0; c<numChannels; ++c)
+            valueSums[c] = weightSums + (c+1)*tileLen;
+
+        //split the covered domain into the masked channel and mask planes
+        const PixelType* base = at - Kernel::radius*rowLen - Kernel::radius;
+        for (size_t y=0; y<planeSize[1]; ++y)
+        {
+            const PixelType* row = base + y*rowLen;
+            const size_t     off = y*planeSize[0];
+            for (size_t x=0; x<planeSize[0]; ++x)
+            {
+                double m      = row[x]!=globeNodata ? 1.0 : 0.0;
+                mask[off + x] = m;
+                for (int c=0; c<numChannels; ++c)
+                    values[c][off + x] = m * double(row[x][c]);
+            }
+        }
+
+        Kernel::filter(mask, size, horizontal, weightSums);
+        for (int c=0; c<numChannels; ++c)
+            Kernel::filter(values[c], size, horizontal, valueSums[c]);
+
+        for (size_t i=0; i<tileLen; ++i)
+        {
+            if (weightSums[i] == 0.0)
+            {
+                out[i] = globeNodata;
+                continue;
+            }
+
+            //snap to nearest integer and clamp
+            for (int c=0; c<numChannels; ++c)
+            {
+                double value = valueSums[c][i] / weightSums[i];
+                value        = std::max(value, 0.0);
+                value        = std::min(value, 255.0);
+
+                out[i][c] = PixelType::Scalar(value+0.5);
+            }
+        }
+    }
+};
+
+
 } //namespace crusta
 
 
@@ -39,6 +39,8 @@ public:
     ///opens an image file by name
     TpmImageFile(const char* imageFileName);
 
+    ///the tile size of the TPM file
+    void getBlockSize(int blockSize[2]) const;
     ///reads a portion of the image
     void readRectangle(const int rectOrigin[2], const int rectSize[2],
                        PixelType* rectBuffer) const;
@@ -51,6 +51,12 @@ public:
     }
 
 public:
+    void getBlockSize(int blockSize[2]) const
+    {
+        blockSize[0] = static_cast<int>(tpmFile.getTileSize(0));
+        blockSize[1] = static_cast<int>(tpmFile.getTileSize(1));
+    }
+
     void readRectangle(const int rectOrigin[2], const int rectSize[2],
                        float* rectBuffer) const
     {
@@ -134,6 +140,12 @@ public:
     }
 
 public:
+    void getBlockSize(int blockSize[2]) const
+    {
+        blockSize[0] = static_cast<int>(tpmFile.getTileSize(0));
+        blockSize[1] = static_cast<int>(tpmFile.getTileSize(1));
+    }
+
     void readRectangle(const int rectOrigin[2], const int rectSize[2],
                        Geometry::Vector<uint8_t,3>* rectBuffer) const
     {
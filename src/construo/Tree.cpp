@@ -6,6 +6,9 @@
 
 namespace crusta {
 
+size_t TreeNodeStats::numResident  = 0;
+size_t TreeNodeStats::peakResident = 0;
+
 
 template <>
 GlobeFile<DemHeight>* TreeNode<DemHeight>::globeFile = NULL;
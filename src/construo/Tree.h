@@ -15,6 +15,16 @@ namespace crusta {
 template <typename PixelParam>
 class TreeNode;
 
+/** keeps track of the number of tree nodes held in memory. Nodes are only
+    created and released during the serial traversals of the builder */
+struct TreeNodeStats
+{
+    ///number of nodes currently allocated as children of other nodes
+    static size_t numResident;
+    ///highest number of resident nodes so far
+    static size_t peakResident;
+};
+
 /**\todo having to specialize this helper breaks the whole separation into
 traits that deal with the specifics of the PixelParam. Fix this eventually.
 This had to be done to avoid a cyclic include where Tree includes GlobeData that
@@ -57,6 +67,10 @@ public:
     /** create in-memory representations for the children nodes if they are
         reflected in the quadtree file */
     void loadMissingChildren();
+    /** drop the in-memory representation of the node's descendance. Their
+        tiles are not affected and they can be reloaded through
+        loadMissingChildren */
+    void releaseChildren();
     /** determine the approximate resolution of the node. This is only computed
         for the step off the middle of an edge as we assume the sphere to be
         worst approximated away from the corners of the scope */
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cassert>
 #include <sstream>
 #include <sys/stat.h>
@@ -91,7 +92,7 @@ template <typename PixelParam>
 TreeNode<PixelParam>::
 ~TreeNode()
 {
-    delete[] children;
+    releaseChildren();
     delete[] data;
 }
 
@@ -310,6 +311,9 @@ createChildren()
 
     //allocate and initialize the children
     children = new TreeNode<PixelParam>[4];
+    TreeNodeStats::numResident += 4;
+    TreeNodeStats::peakResident = std::max(TreeNodeStats::peakResident,
+                                           TreeNodeStats::numResident);
     for (size_t i=0; i<4; ++i)
     {
         TreeNode<PixelParam>& child = children[i];
@@ -344,6 +348,18 @@ loadMissingChildren()
         children[i].tileIndex = childIndices[i];
 }
 
+template <typename PixelParam>
+void TreeNode<PixelParam>::
+releaseChildren()
+{
+    if (children == NULL)
+        return;
+
+    delete[] children;
+    children = NULL;
+    TreeNodeStats::numResident -= 4;
+}
+
 static Scope::Vertex
 mid(const Scope::Vertex& one, const Scope::Vertex& two,
     const Scope::Scalar& radius)
@@ -408,7 +424,8 @@ Spheroid(const std::string& baseName, const size_t tileResolution[2]):
     globeFile(true) // Request a writable globe file that is created if it
         // doesn't exist already. TODO: Better way to do this?
 {
-    //open the globe file
+    //open the globe file, new ones are created in the configured format
+    globeFile.setCompressed(CONSTRUO_SETTINGS.compressTiles);
     globeFile.open(baseName);
 
     //create the base nodes
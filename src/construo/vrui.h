@@ -12,3 +12,4 @@
 #include <Misc/StandardValueCoders.h>
 #include <Misc/ThrowStdErr.h>
 #include <Threads/Mutex.h>
+#include <Threads/Thread.h>
@@ -14,7 +14,6 @@
     #include <hash_map>
 #endif
 
-#include <list>
 #include <vector>
 
 #include <crusta/DataIndex.h>
@@ -38,6 +37,33 @@ namespace crusta {
 template <typename BufferParam>
 class CacheUnit;
 
+/** intrusive doubly-linked list of cache buffers, ordered from the most to the
+    least recently used. The links are stored in the buffers themselves, such
+    that no allocations are required to maintain the order. A buffer can be
+    part of at most one list */
+template <typename BufferParam>
+class CacheLruList
+{
+public:
+    CacheLruList();
+
+    /** unlink all the buffers */
+    void clear();
+    /** insert a buffer as the most recently used */
+    void pushFront(BufferParam* buffer);
+    /** insert a buffer as the least recently used */
+    void pushBack(BufferParam* buffer);
+    /** insert a buffer right after the given one (at the front if NULL) */
+    void insertAfter(BufferParam* position, BufferParam* buffer);
+    /** unlink a buffer from the list */
+    void remove(BufferParam* buffer);
+
+    /** most recently used buffer (NULL if empty) */
+    BufferParam* head;
+    /** least recently used buffer (NULL if empty) */
+    BufferParam* tail;
+};
+
 template <typename DataParam>
 class CacheBufferBase
 {
@@ -69,6 +95,9 @@ protected:
     State state;
     /** frame stamp used to evaluate LRU prioritization */
     FrameStamp frameStamp;
+    /** stamp of the frame that touched the buffer last, reset when the buffer
+        is aged or recycled. Read without locking to skip repeated touches */
+    FrameStamp touchStamp;
     /** unique key for the data entry */
     DataIndex index;
 
@@ -80,36 +109,47 @@ template <typename DataParam>
 class CacheBuffer : public CacheBufferBase<DataParam>
 {
     friend class CacheUnit< CacheBuffer<DataParam> >;
+    friend class CacheLruList< CacheBuffer<DataParam> >;
 
 public:
-    typedef std::list<CacheBuffer*>    LruList;
-    typedef typename LruList::iterator LruHandle;
+    CacheBuffer();
 
 protected:
-    /** handle of the buffer in the LRU control container */
-    LruHandle lruHandle;
+    /**\{ neighbors of the buffer in the LRU control list */
+    CacheBuffer* lruPrev;
+    CacheBuffer* lruNext;
+    /**\}*/
+    /** LRU control list the buffer is part of (NULL if none) */
+    CacheLruList<CacheBuffer>* lruList;
 };
 
 template <typename DataParam>
 class CacheArrayBuffer : public CacheBufferBase<DataParam*>
 {
-    friend class  CacheUnit< CacheArrayBuffer<DataParam> >;
+    friend class CacheUnit< CacheArrayBuffer<DataParam> >;
+    friend class CacheLruList< CacheArrayBuffer<DataParam> >;
 
 public:
     typedef DataParam*                   DataType;
     typedef DataParam                    DataArrayType;
-    typedef std::list<CacheArrayBuffer*> LruList;
-    typedef typename LruList::iterator   LruHandle;
 
+    CacheArrayBuffer();
     ~CacheArrayBuffer();
 
 protected:
-    /** handle of the buffer in the LRU control container */
-    LruHandle lruHandle;
+    /**\{ neighbors of the buffer in the LRU control list */
+    CacheArrayBuffer* lruPrev;
+    CacheArrayBuffer* lruNext;
+    /**\}*/
+    /** LRU control list the buffer is part of (NULL if none) */
+    CacheLruList<CacheArrayBuffer>* lruList;
 };
 
 
-/** underlying LRU cache functionality */
+/** underlying LRU cache functionality. The index of the cached buffers is
+    split into shards with separate locks, such that lookups from the render
+    and the fetch threads rarely contend. The LRU order is maintained in an
+    intrusive list protected by its own lock */
 template <typename BufferParam>
 class CacheUnit
 {
@@ -135,11 +175,21 @@ public:
     /** check to see if the buffer has been touched in this frame */
     bool isCurrent(const BufferParam* const buffer) const;
 
-    /** confirm use of the buffer for the current frame */
+    /** confirm use of the buffer for the current frame. Only the first touch
+        within a frame affects the LRU order */
     void touch(BufferParam* buffer);
+    /** keep the buffer from being recycled until the given age has passed,
+        without marking it as used by the current frame. Buffers with a more
+        recent stamp are left alone. The age must not be older than the one
+        used in previous calls */
+    void retain(BufferParam* buffer, const FrameStamp age);
     /** pin the element in the cache such that it cannot be swaped out */
     void pin(BufferParam* buffer);
-    /** unpin the element in the cache */
+    /** pin the element only if it still holds valid data for the given index.
+        Returns false, leaving the buffer alone, if it has been recycled */
+    bool pin(BufferParam* buffer, const DataIndex& index);
+    /** unpin the element in the cache. Its frame stamp is kept: unless it has
+        been touched in the current frame it ranks with the aged buffers */
     void unpin(BufferParam* buffer);
 
     /** find a buffer within the cached set. Returns NULL if not found. */
@@ -155,8 +205,13 @@ public:
     /** return a buffer to the cache. The buffer will be reinserted into the
         cache with the given index */
     void releaseBuffer(const DataIndex& index, BufferParam* buffer);
+    /** return a grabbed buffer to the cache without validating it, when its
+        data could not be provided after all. The buffer is filed under the
+        given index and is the first to be recycled */
+    void discardBuffer(const DataIndex& index, BufferParam* buffer);
 
-    /** age the given number of most recently used entries */
+    /** age the given number of most recently used entries. The age must not
+        be older than the one used in previous calls */
     void ageMRU(int numBuffers, const FrameStamp age);
 
 ///\todo move back to the protected group
@@ -165,11 +220,31 @@ public:
 
 protected:
     typedef PortableTable<DataIndex,BufferParam*,DataIndex::hash> BufferPtrMap;
-    typedef typename BufferParam::LruList LruList;
+    typedef CacheLruList<BufferParam> LruList;
+
+    /** number of partitions of the index of the cached buffers */
+    static const int NUM_SHARDS = 16;
+
+    /** a partition of the index of the cached buffers */
+    struct Shard
+    {
+        /** the buffers of the partition */
+        BufferPtrMap cached;
+        /** synchronize access to the partition */
+        Threads::Mutex mutex;
+    };
+
+    /** retrieve the partition responsible for an index */
+    Shard& getShard(const DataIndex& index) const;
+    /** retrieve the total number of cached buffers (for debugging) */
+    size_t getNumCached() const;
 
     /** updates buffers to reflect having been touched. (internal use, locks are
         left to the calling method) */
     void touchBuffer(BufferParam* buffer);
+    /** atomically update the stamp checked by the lock-free path of touch
+        (internal use, locks are left to the calling method) */
+    void setTouchStamp(BufferParam* buffer, FrameStamp stamp);
 
     /** prints the state of the LRU */
     void printLru(const char* cause);
@@ -178,12 +253,16 @@ protected:
     std::string name;
 
     /** keep a record of all the buffers cached by the unit */
-    BufferPtrMap cached;
+    mutable Shard shards[NUM_SHARDS];
     /** keep a LRU prioritized view of the cached buffers */
     LruList lru;
+    /** the buffers aged by ageMRU. They are ordered by age and rank before
+        the buffers of the LRU list of the same age */
+    LruList aged;
 
-    /** synchronize access to the cache */
-    Threads::Mutex cacheMutex;
+    /** synchronize access to the LRU lists and the buffer states. Must be
+        acquired before the lock of a shard */
+    Threads::Mutex lruMutex;
 };
 
 
@@ -1,4 +1,3 @@
-#include <algorithm>
 #include <iostream>
 #include <cassert>
 
@@ -14,7 +13,8 @@ OLDEST_FRAMESTAMP(0);
 template <typename DataParam>
 CacheBufferBase<DataParam>::
 CacheBufferBase() :
-    frameStamp(OLDEST_FRAMESTAMP), index(DataIndex::invalid)
+    frameStamp(OLDEST_FRAMESTAMP), touchStamp(OLDEST_FRAMESTAMP),
+    index(DataIndex::invalid)
 {
     state.grabbed = 0;
     state.valid   = 0;
@@ -50,6 +50,21 @@ getData() const
 }
 
 
+template <typename DataParam>
+CacheBuffer<DataParam>::
+CacheBuffer() :
+    lruPrev(NULL), lruNext(NULL), lruList(NULL)
+{
+}
+
+
+template <typename DataParam>
+CacheArrayBuffer<DataParam>::
+CacheArrayBuffer() :
+    lruPrev(NULL), lruNext(NULL), lruList(NULL)
+{
+}
+
 template <typename DataParam>
 CacheArrayBuffer<DataParam>::
 ~CacheArrayBuffer()
@@ -58,14 +73,98 @@ CacheArrayBuffer<DataParam>::
 }
 
 
+template <typename BufferParam>
+CacheLruList<BufferParam>::
+CacheLruList() :
+    head(NULL), tail(NULL)
+{
+}
+
+template <typename BufferParam>
+void CacheLruList<BufferParam>::
+clear()
+{
+    for (BufferParam* buffer=head; buffer!=NULL;)
+    {
+        BufferParam* next = buffer->lruNext;
+        buffer->lruPrev = NULL;
+        buffer->lruNext = NULL;
+        buffer->lruList = NULL;
+        buffer          = next;
+    }
+    head = tail = NULL;
+}
+
+template <typename BufferParam>
+void CacheLruList<BufferParam>::
+pushFront(BufferParam* buffer)
+{
+    insertAfter(NULL, buffer);
+}
+
+template <typename BufferParam>
+void CacheLruList<BufferParam>::
+pushBack(BufferParam* buffer)
+{
+    insertAfter(tail, buffer);
+}
+
+template <typename BufferParam>
+void CacheLruList<BufferParam>::
+insertAfter(BufferParam* position, BufferParam* buffer)
+{
+    assert(buffer->lruList == NULL);
+    assert(position==NULL || position->lruList==this);
+
+    buffer->lruPrev = position;
+    buffer->lruNext = position!=NULL ? position->lruNext : head;
+    buffer->lruList = this;
+
+    if (buffer->lruPrev != NULL)
+        buffer->lruPrev->lruNext = buffer;
+    else
+        head = buffer;
+    if (buffer->lruNext != NULL)
+        buffer->lruNext->lruPrev = buffer;
+    else
+        tail = buffer;
+}
+
+template <typename BufferParam>
+void CacheLruList<BufferParam>::
+remove(BufferParam* buffer)
+{
+    assert(buffer->lruList == this);
+
+    if (buffer->lruPrev != NULL)
+        buffer->lruPrev->lruNext = buffer->lruNext;
+    else
+        head = buffer->lruNext;
+    if (buffer->lruNext != NULL)
+        buffer->lruNext->lruPrev = buffer->lruPrev;
+    else
+        tail = buffer->lruPrev;
+
+    buffer->lruPrev = NULL;
+    buffer->lruNext = NULL;
+    buffer->lruList = NULL;
+}
+
+
 template <typename BufferParam>
 CacheUnit<BufferParam>::
 ~CacheUnit()
 {
     //deallocate all the cached buffers
     typedef typename BufferPtrMap::const_iterator iterator;
-    for (iterator it=cached.begin(); it!=cached.end(); ++it)
-        delete it->second;
+    for (int s=0; s<NUM_SHARDS; ++s)
+    {
+        for (iterator it=shards[s].cached.begin(); it!=shards[s].cached.end();
+             ++it)
+        {
+            delete it->second;
+        }
+    }
 }
 
 template <typename BufferParam>
@@ -74,15 +173,20 @@ init(const std::string& iName, int size)
 {
     name = iName;
 
-    Threads::Mutex::Lock lock(cacheMutex);
+    Threads::Mutex::Lock lock(lruMutex);
 
     //fill the cache with buffers with no valid content
     for (int i=0; i<size; ++i)
     {
         BufferParam* buffer = new BufferParam;
         buffer->index = DataIndex(~0, TreeIndex(~0,~0,~0,i));
-        cached.insert(typename BufferPtrMap::value_type(buffer->index,buffer));
-        buffer->lruHandle = lru.insert(lru.end(), buffer);
+        Shard& shard = getShard(buffer->index);
+        {
+            Threads::Mutex::Lock shardLock(shard.mutex);
+            shard.cached.insert(
+                typename BufferPtrMap::value_type(buffer->index,buffer));
+        }
+        lru.pushBack(buffer);
         initData(buffer->getData());
     }
 }
@@ -99,16 +203,23 @@ clear()
 {
     typedef typename BufferPtrMap::const_iterator iterator;
 
-    Threads::Mutex::Lock lock(cacheMutex);
+    Threads::Mutex::Lock lock(lruMutex);
 
     lru.clear();
-    for (iterator it=cached.begin(); it!=cached.end(); ++it)
+    aged.clear();
+    for (int s=0; s<NUM_SHARDS; ++s)
     {
-        it->second->state.grabbed = 0;
-        it->second->state.valid   = 0;
-        it->second->state.pinned  = 0;
-        it->second->frameStamp    = BufferParam::OLDEST_FRAMESTAMP;
-        it->second->lruHandle     = lru.insert(lru.end(), it->second);
+        Threads::Mutex::Lock shardLock(shards[s].mutex);
+        for (iterator it=shards[s].cached.begin(); it!=shards[s].cached.end();
+             ++it)
+        {
+            it->second->state.grabbed = 0;
+            it->second->state.valid   = 0;
+            it->second->state.pinned  = 0;
+            it->second->frameStamp    = BufferParam::OLDEST_FRAMESTAMP;
+            setTouchStamp(it->second, BufferParam::OLDEST_FRAMESTAMP);
+            lru.pushBack(it->second);
+        }
     }
 }
 
@@ -145,19 +256,52 @@ template <typename BufferParam>
 void CacheUnit<BufferParam>::
 touch(BufferParam* buffer)
 {
-    Threads::Mutex::Lock lock(cacheMutex);
+    /* a buffer that has already been touched this frame is at the front of the
+       LRU with respect to all the buffers not touched this frame. Reordering it
+       within the current frame doesn't affect eviction. The touch stamp is
+       reset whenever the buffer leaves that position, such that the common
+       case of repeated touches doesn't contend for the lock */
+    FrameStamp touchStamp;
+    __atomic_load(&buffer->touchStamp, &touchStamp, __ATOMIC_ACQUIRE);
+    if (touchStamp == CURRENT_FRAME)
+        return;
+
+    Threads::Mutex::Lock lock(lruMutex);
+
+    //another thread might have touched the buffer in the meantime
+    if (isCurrent(buffer) && buffer->lruList!=&aged)
+        return;
+
     touchBuffer(buffer);
 }
 
+template <typename BufferParam>
+void CacheUnit<BufferParam>::
+retain(BufferParam* buffer, const FrameStamp age)
+{
+    Threads::Mutex::Lock lock(lruMutex);
+
+    //pinned and grabbed buffers are out of reach of the recycling already
+    if (!isValid(buffer) || buffer->lruList==NULL || buffer->frameStamp>=age)
+        return;
+
+    /* the retained buffers rank with the aged ones, behind all the buffers
+       used by the current frame */
+    buffer->lruList->remove(buffer);
+    buffer->frameStamp = age;
+    setTouchStamp(buffer, BufferParam::OLDEST_FRAMESTAMP);
+    aged.pushFront(buffer);
+CRUSTA_DEBUG(17, printLru("Retain");)
+}
+
 template <typename BufferParam>
 void CacheUnit<BufferParam>::
 pin(BufferParam* buffer)
 {
-    Threads::Mutex::Lock lock(cacheMutex);
-    if (buffer->lruHandle != lru.end())
+    Threads::Mutex::Lock lock(lruMutex);
+    if (buffer->lruList != NULL)
     {
-        lru.erase(buffer->lruHandle);
-        buffer->lruHandle = lru.end();
+        buffer->lruList->remove(buffer);
 CRUSTA_DEBUG(17, printLru("Pin");)
     }
     ++buffer->state.pinned;
@@ -166,19 +310,48 @@ CRUSTA_DEBUG(17, printLru("Pin");)
         Misc::throwStdErr("CacheUnit::pin: overflow on pin request");
 }
 
+template <typename BufferParam>
+bool CacheUnit<BufferParam>::
+pin(BufferParam* buffer, const DataIndex& index)
+{
+    Threads::Mutex::Lock lock(lruMutex);
+    /* grabbing invalidates the buffer and releasing it updates its index, both
+       under the LRU lock */
+    if (!isValid(buffer) || !(buffer->index==index))
+        return false;
+
+    if (buffer->lruList != NULL)
+    {
+        buffer->lruList->remove(buffer);
+CRUSTA_DEBUG(17, printLru("Pin");)
+    }
+    ++buffer->state.pinned;
+    if (buffer->state.pinned==0)
+        Misc::throwStdErr("CacheUnit::pin: overflow on pin request");
+    return true;
+}
+
 template <typename BufferParam>
 void CacheUnit<BufferParam>::
 unpin(BufferParam* buffer)
 {
-    Threads::Mutex::Lock lock(cacheMutex);
+    Threads::Mutex::Lock lock(lruMutex);
     //unpin must be matched by a previous pin
     if (!isPinned(buffer))
         Misc::throwStdErr("CacheUnit::unpin: buffer was not pinned");
     --buffer->state.pinned;
     if (!(isPinned(buffer) || isGrabbed(buffer)))
     {
-        buffer->frameStamp = CURRENT_FRAME;
-        buffer->lruHandle  = lru.insert(lru.begin(), buffer);
+        /* a buffer that hasn't been used by the current frame must not be
+           mistaken for part of the current hierarchy. It is queued with the
+           aged buffers instead: last if it is the oldest, first otherwise,
+           which at worst changes when it gets recycled */
+        if (isCurrent(buffer))
+            lru.pushFront(buffer);
+        else if (aged.tail!=NULL && buffer->frameStamp<=aged.tail->frameStamp)
+            aged.pushBack(buffer);
+        else
+            aged.pushFront(buffer);
 CRUSTA_DEBUG(17, printLru("Unpin");)
     }
 }
@@ -188,19 +361,22 @@ template <typename BufferParam>
 BufferParam* CacheUnit<BufferParam>::
 find(const DataIndex& index) const
 {
-    typename BufferPtrMap::const_iterator it = cached.find(index);
-    if (it!=cached.end())
+    Shard& shard = getShard(index);
+    Threads::Mutex::Lock lock(shard.mutex);
+
+    typename BufferPtrMap::const_iterator it = shard.cached.find(index);
+    if (it!=shard.cached.end())
     {
 CRUSTA_DEBUG(20, CRUSTA_DEBUG_OUT <<
-name << "Cache" << cached.size() << "::find: found " <<
+name << "Cache" << shard.cached.size() << "::find: found " <<
 (isPinned(it->second) ? '*' : ' ') << index.med_str() << "\n";)
         return it->second;
     }
     else
     {
 CRUSTA_DEBUG(19, CRUSTA_DEBUG_OUT <<
-name << "Cache" << cached.size() << "::find: missed " << index.med_str() <<
-"\n";)
+name << "Cache" << shard.cached.size() << "::find: missed " <<
+index.med_str() << "\n";)
         return NULL;
     }
 }
@@ -209,37 +385,45 @@ template <typename BufferParam>
 BufferParam* CacheUnit<BufferParam>::
 grabBuffer(const FrameStamp older)
 {
-    BufferParam* buffer = NULL;
+    Threads::Mutex::Lock lock(lruMutex);
+CRUSTA_DEBUG(17, printLru("PreGrab");)
 
-    Threads::Mutex::Lock lock(cacheMutex);
-    if (!lru.empty())
+    /* the least recently used buffer is the older of the tails of the two
+       lists. Aged buffers go first when the stamps are the same */
+    BufferParam* buffer = lru.tail;
+    if (aged.tail!=NULL &&
+        (buffer==NULL || aged.tail->frameStamp<=buffer->frameStamp))
     {
-CRUSTA_DEBUG(17, printLru("PreGrab");)
-        buffer = lru.back();
-        //make sure the tail is older then the age specified
-        if (buffer->frameStamp>=older)
-            buffer = NULL;
+        buffer = aged.tail;
     }
+    //make sure the tail is older then the age specified
+    if (buffer!=NULL && buffer->frameStamp>=older)
+        buffer = NULL;
 
     //if we found a valid buffer remove it from the map and the lru
     if (buffer != NULL)
     {
 CRUSTA_DEBUG(15, CRUSTA_DEBUG_OUT <<
-name << "Cache" << cached.size() << "::grabbed " << buffer->index.med_str() <<
+name << "Cache" << getNumCached() << "::grabbed " << buffer->index.med_str() <<
 "\n";)
-        assert(cached.find(buffer->index)!=cached.end());
+        buffer->lruList->remove(buffer);
         buffer->state.valid   = 0;
         buffer->state.grabbed = 1;
-        cached.erase(buffer->index);
+        setTouchStamp(buffer, BufferParam::OLDEST_FRAMESTAMP);
+
+        Shard& shard = getShard(buffer->index);
+        {
+            Threads::Mutex::Lock shardLock(shard.mutex);
+            assert(shard.cached.find(buffer->index)!=shard.cached.end());
+            shard.cached.erase(buffer->index);
+        }
 CRUSTA_DEBUG(18, printCache();)
-        buffer->lruHandle = lru.end();
-        lru.pop_back();
 CRUSTA_DEBUG(17, printLru("Grab");)
     }
     else
     {
 CRUSTA_DEBUG(12, CRUSTA_DEBUG_OUT <<
-name << "Cache" << cached.size() << ":: unable to provide buffer\n";)
+name << "Cache" << getNumCached() << ":: unable to provide buffer\n";)
     }
 
     return buffer;
@@ -257,55 +441,76 @@ releaseBuffer(const DataIndex& index, BufferParam* buffer)
         return;
     }
 
-    Threads::Mutex::Lock lock(cacheMutex);
-    assert(cached.find(index)==cached.end());
+    Threads::Mutex::Lock lock(lruMutex);
 
     //update the index carried by the buffer
     buffer->index = index;
 
 CRUSTA_DEBUG(15, CRUSTA_DEBUG_OUT <<
-name << "Cache" << cached.size() << "::released " <<
+name << "Cache" << getNumCached() << "::released " <<
         buffer->index.med_str() << "\n";)
 
-    cached.insert(typename BufferPtrMap::value_type(buffer->index, buffer));
+    Shard& shard = getShard(index);
+    {
+        Threads::Mutex::Lock shardLock(shard.mutex);
+        assert(shard.cached.find(index)==shard.cached.end());
+        shard.cached.insert(typename BufferPtrMap::value_type(index, buffer));
+    }
     buffer->state.grabbed = 0;
-    assert(cached.find(buffer->index)!=cached.end());
 
     //validate the buffer
     touchBuffer(buffer);
 }
 
+template <typename BufferParam>
+void CacheUnit<BufferParam>::
+discardBuffer(const DataIndex& index, BufferParam* buffer)
+{
+    assert(isGrabbed(buffer));
+
+    Threads::Mutex::Lock lock(lruMutex);
+
+    buffer->index = index;
+
+CRUSTA_DEBUG(15, CRUSTA_DEBUG_OUT <<
+name << "Cache" << getNumCached() << "::discarded " <<
+        buffer->index.med_str() << "\n";)
+
+    Shard& shard = getShard(index);
+    {
+        Threads::Mutex::Lock shardLock(shard.mutex);
+        assert(shard.cached.find(index)==shard.cached.end());
+        shard.cached.insert(typename BufferPtrMap::value_type(index, buffer));
+    }
+    buffer->state.grabbed = 0;
+
+    //leave the buffer invalid and queue it up for recycling
+    buffer->frameStamp = BufferParam::OLDEST_FRAMESTAMP;
+    setTouchStamp(buffer, BufferParam::OLDEST_FRAMESTAMP);
+    if (!isPinned(buffer))
+        lru.pushBack(buffer);
+CRUSTA_DEBUG(17, printLru("Discard");)
+}
+
 
 template <typename BufferParam>
 void CacheUnit<BufferParam>::
 ageMRU(int numBuffers, const FrameStamp age)
 {
-    typedef typename LruList::iterator Iterator;
-
-    Threads::Mutex::Lock lock(cacheMutex);
-    if (lru.empty())
-        return;
+    Threads::Mutex::Lock lock(lruMutex);
 
-//-- find the appropriate re-insertion point
-    Iterator insertIte;
-    for (insertIte=--lru.end();
-         insertIte!=lru.begin() && (*insertIte)->frameStamp<age;
-         --insertIte)
-    {}
-    //we've move 1 past our target (insertion is before insertIte, adjust
-    ++insertIte;
-
-/*-- artificially age numBuffers starting at the head of the LRU, reinserting
-     them at the appropriate point */
-    Iterator lit = lru.begin();
-    for (int i=0; i<numBuffers && lit!=lru.end(); ++i)
+    /* move numBuffers from the head of the LRU to the front of the aged list
+       keeping their order. The buffers already in the aged list have been
+       aged before and thus are at most as recent */
+    BufferParam* insertPos = NULL;
+    for (int i=0; i<numBuffers && lru.head!=NULL; ++i)
     {
-        BufferParam* buffer = *lit;
+        BufferParam* buffer = lru.head;
+        lru.remove(buffer);
         buffer->frameStamp = age;
-        buffer->lruHandle = lru.insert(insertIte, buffer);
-        Iterator toRemove = lit;
-        ++lit;
-        lru.erase(toRemove);
+        setTouchStamp(buffer, BufferParam::OLDEST_FRAMESTAMP);
+        aged.insertAfter(insertPos, buffer);
+        insertPos = buffer;
     }
 CRUSTA_DEBUG(17, printLru("ageMRU");)
 }
@@ -319,47 +524,84 @@ printCache()
 if (name != std::string("GpuGeometry"))
     return;
 
-    CRUSTA_DEBUG_OUT << "print__" << name << "__Cache" << cached.size() <<
+    typedef typename BufferPtrMap::const_iterator iterator;
+
+    CRUSTA_DEBUG_OUT << "print__" << name << "__Cache" << getNumCached() <<
                         ": frame " << CURRENT_FRAME << "\n";
-    for (typename BufferPtrMap::const_iterator it=cached.begin();
-         it!=cached.end(); ++it)
+    for (int s=0; s<NUM_SHARDS; ++s)
     {
-        if (isPinned(it->second))
+        for (iterator it=shards[s].cached.begin();
+             it!=shards[s].cached.end(); ++it)
         {
-            CRUSTA_DEBUG_OUT << (it->second->state.valid==0 ? '#' : ' ') <<
-                                it->first.med_str() << " " <<
-                                it->second->frameStamp << " ";
+            if (isPinned(it->second))
+            {
+                CRUSTA_DEBUG_OUT << (it->second->state.valid==0 ? '#' : ' ') <<
+                                    it->first.med_str() << " " <<
+                                    it->second->frameStamp << " ";
+            }
         }
     }
     CRUSTA_DEBUG_OUT << "\n-------\n";
-    for (typename BufferPtrMap::const_iterator it=cached.begin();
-         it!=cached.end(); ++it)
+    for (int s=0; s<NUM_SHARDS; ++s)
     {
-        if (!isPinned(it->second))
+        for (iterator it=shards[s].cached.begin();
+             it!=shards[s].cached.end(); ++it)
         {
-            CRUSTA_DEBUG_OUT << (it->second->state.valid==0 ? '#' : ' ') <<
-                                it->first.med_str() << " " <<
-                                it->second->frameStamp << " ";
+            if (!isPinned(it->second))
+            {
+                CRUSTA_DEBUG_OUT << (it->second->state.valid==0 ? '#' : ' ') <<
+                                    it->first.med_str() << " " <<
+                                    it->second->frameStamp << " ";
+            }
         }
     }
     CRUSTA_DEBUG_OUT << "\n\n";
 #endif //CRUSTA_ENABLE_DEBUG
 }
 
+template <typename BufferParam>
+typename CacheUnit<BufferParam>::Shard& CacheUnit<BufferParam>::
+getShard(const DataIndex& index) const
+{
+    /* the tables hash on the low bits already, pick the shard from the high
+       ones to not cluster the entries of a shard into a few buckets */
+    uint32_t hash = static_cast<uint32_t>(DataIndex::hash()(index));
+    return shards[(hash>>28) % NUM_SHARDS];
+}
+
+template <typename BufferParam>
+size_t CacheUnit<BufferParam>::
+getNumCached() const
+{
+    size_t numCached = 0;
+    for (int s=0; s<NUM_SHARDS; ++s)
+        numCached += shards[s].cached.size();
+    return numCached;
+}
+
 template <typename BufferParam>
 void CacheUnit<BufferParam>::
 touchBuffer(BufferParam* buffer)
 {
     buffer->frameStamp  = CURRENT_FRAME;
     buffer->state.valid = 1;
-    
-    if (buffer->lruHandle != lru.end())
-        lru.erase(buffer->lruHandle);
+
+    if (buffer->lruList != NULL)
+        buffer->lruList->remove(buffer);
     if (!(isPinned(buffer) || isGrabbed(buffer)))
-        buffer->lruHandle = lru.insert(lru.begin(), buffer);
+        lru.pushFront(buffer);
+    //publish the touch only once the buffer is in place
+    setTouchStamp(buffer, CURRENT_FRAME);
 CRUSTA_DEBUG(17, printLru("Touch");)
 }
 
+template <typename BufferParam>
+void CacheUnit<BufferParam>::
+setTouchStamp(BufferParam* buffer, FrameStamp stamp)
+{
+    __atomic_store(&buffer->touchStamp, &stamp, __ATOMIC_RELEASE);
+}
+
 template <typename BufferParam>
 void CacheUnit<BufferParam>::
 printLru(const char* cause)
@@ -368,15 +610,20 @@ printLru(const char* cause)
 if (name != std::string("GpuGeometry"))
     return;
 
-    CRUSTA_DEBUG_OUT << "__" << name << "__LRU_" << cause << cached.size() <<
+    CRUSTA_DEBUG_OUT << "__" << name << "__LRU_" << cause << getNumCached() <<
                         ": frame " << CURRENT_FRAME << "\n";
-    for (typename LruList::const_iterator it=lru.begin(); it!=lru.end(); ++it)
+    const LruList* lists[2] = {&lru, &aged};
+    for (int l=0; l<2; ++l)
     {
-        CRUSTA_DEBUG_OUT << ((*it)->state.valid==0 ? '#' : ' ') <<
-                             (*it)->index.med_str() << " " <<
-                             (*it)->frameStamp << " ";
+        for (const BufferParam* b=lists[l]->head; b!=NULL; b=b->lruNext)
+        {
+            CRUSTA_DEBUG_OUT << (b->state.valid==0 ? '#' : ' ') <<
+                                b->index.med_str() << " " << b->frameStamp <<
+                                " ";
+        }
+        CRUSTA_DEBUG_OUT << "\n";
     }
-    CRUSTA_DEBUG_OUT << "\n\n";
+    CRUSTA_DEBUG_OUT << "\n";
 #endif //CRUSTA_ENABLE_DEBUG
 }
 
@@ -13,6 +13,7 @@
 #include <crusta/SurfaceProbeTool.h>
 #include <crusta/SliceTool.h>
 #include <crusta/SurfaceTool.h>
+#include <crusta/TerrainTraversal.h>
 #include <crusta/LayerToggleTool.h>
 #include <crusta/SGToggleTool.h>
 #include <crusta/Tool.h>
@@ -141,7 +142,7 @@ CrustaGlData::
 
 
 Crusta::Crusta(const std::string& exePath, const std::string& resourcePath):
-  mapMan(NULL),
+  mapMan(NULL), hasPredictedNavigation(false), traversal(NULL),
   sceneGraphViewer(NULL)
 {
 ///\todo split crusta and planet
@@ -187,6 +188,7 @@ Crusta::~Crusta()
     if (sceneGraphViewer){ delete sceneGraphViewer; sceneGraphViewer=NULL; }
     delete lightSettings;
     delete mapMan;
+    delete traversal;
     for (RenderPatches::iterator it=renderPatches.begin();
          it!=renderPatches.end(); ++it)
     {
@@ -237,6 +239,11 @@ void Crusta::start()
     DATAMANAGER->startFetching();
     COLORMAPPER->load();
 
+    //the traversal threads are kept across data reloads
+    if (traversal == NULL)
+        traversal = new TerrainTraversal;
+    traversal->start(SETTINGS->terrainNumTraversalThreads);
+
     globalElevationRange[0] =  Math::Constants<Scalar>::max;
     globalElevationRange[1] = -Math::Constants<Scalar>::max;
 
@@ -345,7 +352,7 @@ snapToSurface(const Geometry::Point<double,3>& pos, Scalar elevationOffset)
         childId    |= vpos*horizontal < 0 ? 0x2 : 0x0;
 
         //is it even possible to retrieve higher res data?
-        if (!DATAMANAGER->existsChildData(nodeData))
+        if (!DATAMANAGER->existsChildData(*nodeData.node))
             break;
 
         //try to grab the child for evaluation
@@ -629,6 +636,36 @@ intersect(const Geometry::Ray<double,3>& ray) const
     if (renderPatches.empty())
         return SurfacePoint();
 
+    RootNodes roots;
+    getRootNodes(roots);
+    return intersectPatches(ray, roots);
+}
+
+void Crusta::
+intersect(const Rays& rays, SurfacePoints& surfacePoints) const
+{
+    surfacePoints.assign(rays.size(), SurfacePoint());
+    if (renderPatches.empty())
+        return;
+
+    RootNodes roots;
+    getRootNodes(roots);
+    for (size_t i=0; i<rays.size(); ++i)
+        surfacePoints[i] = intersectPatches(rays[i], roots);
+}
+
+void Crusta::
+getRootNodes(RootNodes& roots) const
+{
+    roots.resize(renderPatches.size());
+    for (size_t i=0; i<renderPatches.size(); ++i)
+        roots[i] = renderPatches[i]->getRootNode().node;
+}
+
+SurfacePoint Crusta::
+intersectPatches(const Geometry::Ray<double,3>& ray,
+                 const RootNodes& roots) const
+{
     const Scalar& verticalScale = getVerticalScale();
 
     Scalar gin, gout;
@@ -649,22 +686,17 @@ intersect(const Geometry::Ray<double,3>& ray) const
 
     //find the patch containing the entry point
     Geometry::Point<double,3> entry = ray(gin);
-    const QuadTerrain* patch = NULL;
-    NodeData*          node  = NULL;
-    NodeMainData nodeData;
-    for (RenderPatches::const_iterator it=renderPatches.begin();
-         it!=renderPatches.end(); ++it)
+    int patchId = -1;
+    for (size_t i=0; i<roots.size(); ++i)
     {
-        nodeData = (*it)->getRootNode();
-        node     = nodeData.node;
-        if (node->scope.contains(entry))
+        if (roots[i]->scope.contains(entry))
         {
-            patch = *it;
+            patchId = static_cast<int>(i);
             break;
         }
     }
 
-    assert(patch!=NULL && node!=NULL);
+    assert(patchId != -1);
 
     //traverse terrain patches until intersection or ray exit
     SurfacePoint surfacePoint;
@@ -675,7 +707,8 @@ intersect(const Geometry::Ray<double,3>& ray) const
     int    mapSide[4][4] = {{2,3,0,1}, {1,2,3,0}, {0,1,2,3}, {3,0,1,2}};
     while (true)
     {
-        surfacePoint = patch->intersect(ray, tin, sideIn, tout, sideOut, gout);
+        surfacePoint = renderPatches[patchId]->intersect(ray, tin, sideIn,
+                                                         tout, sideOut, gout);
         if (surfacePoint.isValid())
             break;
 
@@ -690,10 +723,9 @@ Still this should be handled more robustly */
 
         const Polyhedron* const polyhedron = DATAMANAGER->getPolyhedron();
         Polyhedron::Connectivity neighbors[4];
-        polyhedron->getConnectivity(patch->getRootNode().node->index.patch(),
-                                    neighbors);
-        patch  = renderPatches[neighbors[sideOut][0]];
-        sideIn = mapSide[neighbors[sideOut][1]][sideOut];
+        polyhedron->getConnectivity(roots[patchId]->index.patch(), neighbors);
+        patchId = neighbors[sideOut][0];
+        sideIn  = mapSide[neighbors[sideOut][1]][sideOut];
     }
 
     return surfacePoint;
@@ -731,6 +763,19 @@ getVerticalScale() const
     return verticalScale;
 }
 
+Scalar Crusta::
+getHorizonOccluderRadius() const
+{
+    /* the flat triangles of the tessellation sag below the sphere through
+       their vertices. Shrink the occluder to stay clear of the coarsest ones */
+    static const Scalar tessellationSag = 1.0e-4;
+
+    Scalar radius = SETTINGS->globeRadius +
+                    std::min(globalElevationRange[0]*verticalScale,
+                             globalElevationRange[1]*verticalScale);
+    return radius * (Scalar(1) - tessellationSag);
+}
+
 void Crusta::setOpacity(double newOpacity)
 {
     SETTINGS->terrainDiffuseColor[3] = newOpacity;
@@ -741,6 +786,12 @@ double Crusta::getOpacity(double newOpacity) const
     return SETTINGS->terrainDiffuseColor[3];
 }
 
+bool Crusta::
+isOpaque() const
+{
+    return SETTINGS->terrainDiffuseColor[3] >= 0.95f;
+}
+
 Geometry::Point<double,3> Crusta::
 mapToScaledGlobe(const Geometry::Point<double,3>& pos)
 {
@@ -769,6 +820,20 @@ mapToUnscaledGlobe(const Geometry::Point<double,3>& pos)
     return Geometry::Point<double,3>(toPoint[0], toPoint[1], toPoint[2]);
 }
 
+bool Crusta::
+getPredictedInverseNavigation(Vrui::NavTransform& xform) const
+{
+    if (hasPredictedNavigation)
+        xform = predictedInverseNavigation;
+    return hasPredictedNavigation;
+}
+
+const FrustumVisibility::Stats& Crusta::
+getVisibilityStats() const
+{
+    return traversal->getVisibilityStats();
+}
+
 MapManager* Crusta::
 getMapManager() const
 {
@@ -844,31 +909,66 @@ CRUSTA_DEBUG(8, CRUSTA_DEBUG_OUT <<
         changedVerticalScale = newVerticalScale;
     }
 
+    /* extrapolate the motion of the navigation since the last frame over the
+       prefetch horizon: the incremental (physical space) motion D satisfies
+       current=last*D, thus the prediction is current*D^k */
+    const Vrui::NavTransform& curInverseNavigation =
+        Vrui::getInverseNavigationTransformation();
+    double frameTime = CURRENT_FRAME - LAST_FRAME;
+    hasPredictedNavigation = false;
+    if (SETTINGS->dataManPrefetchHorizon>0.0 && frameTime>0.0 &&
+        frameTime<SETTINGS->dataManPrefetchHorizon)
+    {
+        Vrui::NavTransform motion =
+            Geometry::invert(lastInverseNavigation) * curInverseNavigation;
+        Vrui::Vector rotation = motion.getRotation().getScaledAxis();
+        //don't bother predicting a (nearly) static navigation
+        if (Geometry::mag(motion.getTranslation()) > 1.0e-6 ||
+            Geometry::mag(rotation) > 1.0e-9 ||
+            Math::abs(Math::log(motion.getScaling())) > 1.0e-9)
+        {
+            double k = SETTINGS->dataManPrefetchHorizon / frameTime;
+            Vrui::NavTransform extrapolated(motion.getTranslation() * k,
+                Vrui::Rotation::rotateScaledAxis(rotation * k),
+                Math::pow(motion.getScaling(), k));
+            predictedInverseNavigation = curInverseNavigation * extrapolated;
+            hasPredictedNavigation     = true;
+        }
+    }
+    lastInverseNavigation = curInverseNavigation;
+
     //let the map manager update all the mapping stuff
     mapMan->frame();
 }
 
-struct DistanceToEyeSorter
+/** order the visible nodes by their distance to the eye */
+static void
+orderVisibles(SurfaceApproximation& surface,
+              const Geometry::Point<double,3>& eyePosition, bool farToNear,
+              std::vector<std::pair<double, int> >& distances)
 {
-    DistanceToEyeSorter(SurfaceApproximation* approx, const Geometry::Point<double,3>& eye) :
-        surface(approx), eyePosition(eye)
-    {}
-    void sortVisibles()
+    typedef SurfaceApproximation::Indices Indices;
+
+    //compute the distances once instead of for every comparison
+    distances.clear();
+    for (Indices::const_iterator it=surface.visibles.begin();
+         it!=surface.visibles.end(); ++it)
     {
-        std::sort(surface->visibles.begin(), surface->visibles.end(), *this);
+        const NodeData& node = *surface.nodes[*it].node;
+        distances.push_back(std::make_pair(
+            Geometry::sqrDist(eyePosition, node.boundingCenter), *it));
     }
 
-    bool operator()(int i, int j)
+    std::sort(distances.begin(), distances.end());
+
+    size_t numVisibles = distances.size();
+    surface.visibles.resize(numVisibles);
+    for (size_t i=0; i<numVisibles; ++i)
     {
-        double distI = Geometry::dist(eyePosition,
-                                      surface->nodes[i].node->boundingCenter);
-        double distJ = Geometry::dist(eyePosition,
-                                      surface->nodes[j].node->boundingCenter);
-        return distI > distJ;
+        size_t order = farToNear ? numVisibles-1-i : i;
+        surface.visibles[i] = distances[order].second;
     }
-    SurfaceApproximation* surface;
-    Geometry::Point<double,3> eyePosition;
-};
+}
 
 void Crusta::
 display(GLContextData& contextData)
@@ -889,23 +989,27 @@ display(GLContextData& contextData)
     glData->gpuCache = &CACHE->getGpuCache(contextData);
 
 //- prepare the surface approximation and renderable representation
-    SurfaceApproximation surface;
+    SurfaceApproximation& surface = glData->surface;
+    surface.clear();
 
     //generate the terrain representation
-    for (RenderPatches::const_iterator it=renderPatches.begin();
-         it!=renderPatches.end(); ++it)
-    {
-        (*it)->prepareDisplay(contextData, surface);
-        CHECK_GLA
-    }
+    traversal->prepareDisplay(contextData, this, renderPatches, surface);
+    CHECK_GLA
+
+CRUSTA_DEBUG(9, CRUSTA_DEBUG_OUT <<
+"Nodes rejected by the frustum: " <<
+getVisibilityStats().frustumRejects << ", by the horizon: " <<
+getVisibilityStats().horizonRejects << "\n";)
 
-    //sort the visible tiles with respect to the distance to the camera
     Geometry::Point<double,3> eyePosition =
         Vrui::getDisplayState(contextData).viewer->getHeadPosition();
     eyePosition =
         Vrui::getInverseNavigationTransformation().transform(eyePosition);
-    DistanceToEyeSorter sorter(&surface, eyePosition);
-    sorter.sortVisibles();
+
+    /* an opaque terrain is drawn front to back to make the most of the depth
+       test. A transparent one must be blended back to front. The nodes behind
+       the horizon have already been rejected by the traversal */
+    orderVisibles(surface, eyePosition, !isOpaque(), glData->visibleDistances);
 
 statsMan.extractTileStats(surface);
 
@@ -2,6 +2,7 @@
 #define _Crusta_H_
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <crustavrui/GL/VruiGlew.h>
@@ -9,6 +10,8 @@
 #include <crustacore/basics.h>
 #include <crusta/glbasics.h>
 #include <crusta/CrustaSettings.h>
+#include <crusta/DataManager.h>
+#include <crusta/FrustumVisibility.h>
 #include <crusta/LightingShader.h>
 #include <crusta/map/Shape.h>
 #include <crusta/QuadCache.h>
@@ -38,6 +41,7 @@ class MapManager;
 class NodeData;
 class QuadTerrain;
 class SceneGraphViewer;
+class TerrainTraversal;
 
 struct CrustaGlData : public GLObject::DataItem
 {
@@ -57,6 +61,15 @@ struct CrustaGlData : public GLObject::DataItem
 
     /** the surface rendering shader */
     LightingShader terrainShader;
+
+    /** the surface approximation of the current frame. Kept with the context
+        such that its storage is reused from frame to frame */
+    SurfaceApproximation surface;
+    /** the batch of nodes streamed to the gpu caches for rendering */
+    DataManager::Batch batch;
+    /** squared eye distances of the visible nodes paired with their indices.
+        Used to order the visible nodes for rendering */
+    std::vector<std::pair<double, int> > visibleDistances;
 };
 
 ///\todo separate crusta the application from a planet instance (current)
@@ -65,6 +78,9 @@ class Crusta : public GLObject
 {
 public:
     typedef std::vector<std::string> Strings;
+    typedef std::vector<Geometry::Ray<double,3> > Rays;
+    typedef std::vector<SurfacePoint> SurfacePoints;
+
     Crusta(const std::string& exePath, const std::string& resourcePath="");
     ~Crusta();
 
@@ -81,6 +97,9 @@ public:
     SurfacePoint snapToSurface(const Geometry::Point<double,3>& pos, Scalar offset=Scalar(0));
     /** intersect a ray with the crusta globe */
     SurfacePoint intersect(const Geometry::Ray<double,3>& ray) const;
+    /** intersect a batch of rays with the crusta globe. The lookup of the
+        patches is shared by all the rays */
+    void intersect(const Rays& rays, SurfacePoints& surfacePoints) const;
 
     /** determine the coverage of a single segment with the global hierarchy */
     void segmentCoverage(const Geometry::Point<double,3>& start, const Geometry::Point<double,3>& end,
@@ -93,9 +112,14 @@ public:
     void setVerticalScale(double newVerticalScale);
     /** retrieve the vertical exaggeration factor */
     double getVerticalScale() const;
+    /** retrieve the radius of a sphere contained in the (scaled) terrain
+        surface, usable to occlude what lies behind the horizon */
+    Scalar getHorizonOccluderRadius() const;
 
     void setOpacity(double newOpacity);
     double getOpacity(double newOpacity) const;
+    /** check if the terrain is opaque enough to be drawn without blending */
+    bool isOpaque() const;
 
     /** map a 3D cartesian point specified wrt an unscaled globe representation
         to the corresponding point in a scaled representation */
@@ -106,6 +130,14 @@ public:
 
     MapManager* getMapManager()  const;
 
+    /** retrieve the inverse navigation transformation extrapolated over the
+        prefetch horizon. Returns false if there is no prediction, e.g. because
+        the navigation didn't change since the last frame */
+    bool getPredictedInverseNavigation(Vrui::NavTransform& xform) const;
+    /** retrieve the counters of the nodes rejected as invisible by the last
+        terrain traversal */
+    const FrustumVisibility::Stats& getVisibilityStats() const;
+
     void frame();
     void display(GLContextData& contextData);
 
@@ -129,6 +161,13 @@ void validateLineCoverage();
 
 protected:
     typedef std::vector<QuadTerrain*> RenderPatches;
+    typedef std::vector<const NodeData*> RootNodes;
+
+    /** collect the root nodes of the render patches */
+    void getRootNodes(RootNodes& roots) const;
+    /** intersect a ray with the patches given their root nodes */
+    SurfacePoint intersectPatches(const Geometry::Ray<double,3>& ray,
+                                  const RootNodes& roots) const;
 
     /** keep track of the last stamp at which the vertical scale was modified.
         The vertical scale affects the bounding primitives for the nodes and
@@ -147,8 +186,19 @@ protected:
     /** the mapping management component */
     MapManager* mapMan;
 
+    /** inverse navigation transformation of the last frame. Used to estimate
+        the velocity of the navigation */
+    Vrui::NavTransform lastInverseNavigation;
+    /** inverse navigation transformation extrapolated over the prefetch
+        horizon */
+    Vrui::NavTransform predictedInverseNavigation;
+    /** flags whether the predicted navigation is valid for this frame */
+    bool hasPredictedNavigation;
+
     /** the spheroid base patches used for rendering */
     RenderPatches renderPatches;
+    /** generates the surface approximation of the patches */
+    TerrainTraversal* traversal;
 
     /** the global height range */
     Scalar globalElevationRange[2];
@@ -25,6 +25,7 @@ CrustaSettings::CrustaSettings() :
     terrainEmissiveColor(0.0f, 0.0f, 0.0f, 1.0f),
     terrainSpecularColor(0.0f, 0.0f, 0.0f, 1.0f),
     terrainShininess(55.0f),
+    terrainNumTraversalThreads(2),
 
     // /Crusta/Cache
     cacheMainNodeSize(4096),
@@ -40,6 +41,9 @@ CrustaSettings::CrustaSettings() :
     // /Crusta/DataManager
     dataManMaxDataLayers(32),
     dataManMaxFetchRequests(8),
+    dataManNumFetchThreads(2),
+    dataManMapGlobeFiles(true),
+    dataManPrefetchHorizon(0.3),
 
     // /Crusta/ColorMapper
     colorMapTexSize(1024),
@@ -119,6 +123,7 @@ void CrustaSettings::setFromCfg()
     terrainEmissiveColor = cfgFile.retrieveValue<Color>("emissiveColor", terrainEmissiveColor);
     terrainSpecularColor = cfgFile.retrieveValue<Color>("specularColor", terrainSpecularColor);
     terrainShininess = cfgFile.retrieveValue<double>("shininess", terrainShininess);
+    terrainNumTraversalThreads = cfgFile.retrieveValue<int>("numTraversalThreads", terrainNumTraversalThreads);
 
     //try to extract the cache settings
     cfgFile.setCurrentSection("/Crusta/Cache");
@@ -136,6 +141,9 @@ void CrustaSettings::setFromCfg()
     cfgFile.setCurrentSection("/Crusta/DataManager");
     dataManMaxDataLayers = cfgFile.retrieveValue<int>("maxDataLayers", dataManMaxDataLayers);
     dataManMaxFetchRequests = cfgFile.retrieveValue<int>("maxFetchRequests", dataManMaxFetchRequests);
+    dataManNumFetchThreads = cfgFile.retrieveValue<int>("numFetchThreads", dataManNumFetchThreads);
+    dataManMapGlobeFiles = cfgFile.retrieveValue<bool>("mapGlobeFiles", dataManMapGlobeFiles);
+    dataManPrefetchHorizon = cfgFile.retrieveValue<double>("prefetchHorizon", dataManPrefetchHorizon);
 
     //try to extract the color mapper settings
     cfgFile.setCurrentSection("/Crusta/ColorMapper");
@@ -39,6 +39,9 @@ public:
     float terrainShininess;
     ///\}
 
+    ///number of threads helping with the per-frame terrain traversal
+    int terrainNumTraversalThreads;
+
     ///\{ cache settings
     int cacheMainNodeSize;
     int cacheMainGeometrySize;
@@ -58,6 +61,14 @@ public:
     /** impose a limit on the number of outstanding fetch requests. This
         minimizes processing outdated requests */
     int dataManMaxFetchRequests;
+    /** number of threads concurrently processing the fetch requests */
+    int dataManNumFetchThreads;
+    /** memory-map the globe files instead of reading the tiles through
+        positional file I/O */
+    bool dataManMapGlobeFiles;
+    /** time span in seconds over which the navigation is extrapolated to
+        prefetch the data of the predicted view. 0 disables prefetching */
+    double dataManPrefetchHorizon;
     ///\}
 
     ///\{ color mapper settings
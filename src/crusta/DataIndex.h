@@ -25,6 +25,9 @@ struct DataIndex : public TreeIndex
     TreeIndex getTreeIndex() const;
 
     static const DataIndex invalid;
+    /** number of distinct data ids, limited by the reserved bits of the tree
+        index */
+    static const int MAX_DATA_IDS = 32;
 };
 
 
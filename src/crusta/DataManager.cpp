@@ -1,5 +1,7 @@
 #include <crusta/DataManager.h>
 
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 #include <crusta/Crusta.h>
@@ -51,33 +53,24 @@ reset()
 
 DataManager::Request::
 Request() :
-    crusta(NULL), lod(0), child(~0)
+    crusta(NULL), lod(0), childMask(0), prefetch(false)
 {
 }
 
 DataManager::Request::
 Request(Crusta* iCrusta, float iLod, const NodeMainBuffer& iParent,
-        uint8_t iChild) :
-    crusta(iCrusta), lod(iLod), parent(iParent), child(iChild)
+        uint8_t iChildMask, bool iPrefetch) :
+    crusta(iCrusta), lod(iLod), parent(iParent), childMask(iChildMask),
+    prefetch(iPrefetch)
 {
 }
 
-bool DataManager::Request::
-operator ==(const Request& other) const
+DataManager::PrefetchStats::
+PrefetchStats() :
+    prefetched(0), hits(0), demandLoads(0)
 {
-    /* since everything is fetched on a node basis the tree index and the child
-       identifier is all that is needed to coalesce requests */
-    return parent.node->getData().index==other.parent.node->getData().index &&
-           child==other.child;
 }
 
-bool DataManager::Request::
-operator >(const Request& other) const
-{
-    return Math::abs(lod) > Math::abs(other.lod);
-}
-
-
 DataManager::
 DataManager() :
     demFile(NULL), polyhedron(NULL),
@@ -109,7 +102,7 @@ void DataManager::loadGlobe(const std::string& path)
         //only a single DEM is supported so check we haven't one already
         if (demFile == NULL)
         {
-            demFile = new DemFile(false);
+            demFile = new DemFile(false, SETTINGS->dataManMapGlobeFiles);
             try
             {
                 demFile->open(path);
@@ -126,31 +119,43 @@ void DataManager::loadGlobe(const std::string& path)
           std::cerr << "Warning: only one DEM file is usable at a time; skipping " << path << std::endl;
         }
     } else if (ColorFile::isCompatible(path)) {
-        ColorFile* file = new ColorFile(false);
-        try
+        //the node data bundles hold a bounded number of layers
+        if (colorFiles.size() < size_t(NODE_MAX_DATA_LAYERS))
         {
-            file->open(path);
-            colorFiles.push_back(file);
-            colorFilePaths.push_back(path.substr(0, path.find_last_not_of("/")+1));
-        }
-        catch (std::runtime_error e)
-        {
-            delete file;
-            std::cerr << e.what();
+            ColorFile* file = new ColorFile(false, SETTINGS->dataManMapGlobeFiles);
+            try
+            {
+                file->open(path);
+                colorFiles.push_back(file);
+                colorFilePaths.push_back(path.substr(0, path.find_last_not_of("/")+1));
+            }
+            catch (std::runtime_error e)
+            {
+                delete file;
+                std::cerr << e.what();
+            }
+        } else {
+          std::cerr << "Warning: at most " << NODE_MAX_DATA_LAYERS << " color layers are usable at a time; skipping " << path << std::endl;
         }
     } else if (LayerfFile::isCompatible(path)) {
-        LayerfFile* file = new LayerfFile(false);
-        try
-        {
-            file->open(path);
-            layerfFiles.push_back(file);
-            layerfFilePaths.push_back(path.substr(0, path.find_last_not_of("/")+1));
-            layerfPaletteFilePaths.push_back(curPaletteFilePath);
-        }
-        catch (std::runtime_error e)
+        //data id 0 of the layerf caches is taken by the heights
+        if (layerfFiles.size() < size_t(NODE_MAX_DATA_LAYERS-1))
         {
-            delete file;
-            std::cerr << e.what();
+            LayerfFile* file = new LayerfFile(false, SETTINGS->dataManMapGlobeFiles);
+            try
+            {
+                file->open(path);
+                layerfFiles.push_back(file);
+                layerfFilePaths.push_back(path.substr(0, path.find_last_not_of("/")+1));
+                layerfPaletteFilePaths.push_back(curPaletteFilePath);
+            }
+            catch (std::runtime_error e)
+            {
+                delete file;
+                std::cerr << e.what();
+            }
+        } else {
+          std::cerr << "Warning: at most " << NODE_MAX_DATA_LAYERS-1 << " layerf layers are usable at a time; skipping " << path << std::endl;
         }
     } else {
         std::cerr << "Warning: ignoring unrecognized globe file " << path << std::endl;
@@ -225,21 +230,42 @@ void DataManager::startFetching()
     ///\todo get the polyhedron from the files and check compatibility
     if (!polyhedron) polyhedron = new Triacontahedron(SETTINGS->globeRadius);
 
+    //the pool might already be running
+    if (!fetchThreads.empty())
+        return;
+
     terminateFetch = false;
-    fetchThread.start(this, &DataManager::fetchThreadFunc);
+    int numFetchThreads = std::max(1, SETTINGS->dataManNumFetchThreads);
+    for (int i=0; i<numFetchThreads; ++i)
+    {
+        Threads::Thread* thread = new Threads::Thread;
+        thread->start(this, &DataManager::fetchThreadFunc);
+        fetchThreads.push_back(thread);
+    }
 }
 
 void DataManager::stopFetching()
 {
-    if (!fetchThread.isJoined())
+    if (fetchThreads.empty())
+        return;
+
     {
-        //let the fetch thread know that it should terminate
+        //let the fetch threads know that they should terminate
+        Threads::Mutex::Lock lock(requestMutex);
         terminateFetch = true;
-        //make sure the thread is not stuck waiting for requests
-        fetchCond.signal();
-        //wait for the termination
-        fetchThread.join();
     }
+    //make sure no thread is stuck waiting for requests
+    fetchCond.broadcast();
+
+    //wait for the termination
+    for (FetchThreads::iterator it=fetchThreads.begin();
+         it!=fetchThreads.end(); ++it)
+    {
+        (*it)->join();
+        delete *it;
+    }
+    fetchThreads.clear();
+    inFlightRequests.clear();
 }
 
 bool DataManager::
@@ -402,14 +428,15 @@ loadRoot(Crusta* crusta, TreeIndex rootIndex, const Scope& scope)
     nodeData.lineData.clear();
 
     //initialize
-    nodeData.index = rootIndex;
-    nodeData.scope = scope;
+    nodeData.index      = rootIndex;
+    nodeData.scope      = scope;
+    nodeData.prefetched = false;
 
 //- Geometry data
     {
         DataIndex index(0, rootIndex);
         GRAB_BUFFER(GeometryCache, geometry, mc.geometry, index)
-        generateGeometry(crusta, &nodeData, geometryData);
+        generateGeometry(crusta, &nodeData, geometryData, tempGeometryBuf);
         RELEASE_PIN_BUFFER(mc.geometry, index, geometryBuf)
     }
 
@@ -422,7 +449,9 @@ loadRoot(Crusta* crusta, TreeIndex rootIndex, const Scope& scope)
         //topography reserves the first data id of the layerf cache
         DataIndex index(0, rootIndex);
         GRAB_BUFFER(LayerfCache, height, mc.layerf, index)
-        sourceDem(NULL, NULL, &nodeData, heightData);
+        NodeData*        nodes[4]   = {&nodeData, NULL, NULL, NULL};
+        DemHeight::Type* heights[4] = {heightData, NULL, NULL, NULL};
+        sourceDem(NULL, NULL, nodes, heights);
         RELEASE_PIN_BUFFER(mc.layerf, index, heightBuf)
     }
 
@@ -439,7 +468,9 @@ loadRoot(Crusta* crusta, TreeIndex rootIndex, const Scope& scope)
         //read in the color data
         DataIndex index(l, rootIndex);
         GRAB_BUFFER(ColorCache, layer, mc.color, index)
-        sourceColor(NULL, NULL, &nodeData, l, layerData);
+        NodeData*           nodes[4]  = {&nodeData, NULL, NULL, NULL};
+        TextureColor::Type* colors[4] = {layerData, NULL, NULL, NULL};
+        sourceColor(NULL, NULL, nodes, l, colors);
         RELEASE_PIN_BUFFER(mc.color, index, layerBuf)
     }
 
@@ -457,7 +488,9 @@ loadRoot(Crusta* crusta, TreeIndex rootIndex, const Scope& scope)
         //read in the layer
         DataIndex index(l+1, rootIndex);
         GRAB_BUFFER(LayerfCache, layer, mc.layerf, index)
-        sourceLayerf(NULL, NULL, &nodeData, l, layerData);
+        NodeData*         nodes[4]  = {&nodeData, NULL, NULL, NULL};
+        LayerDataf::Type* layers[4] = {layerData, NULL, NULL, NULL};
+        sourceLayerf(NULL, NULL, nodes, l, layers);
         RELEASE_PIN_BUFFER(mc.layerf, index, layerBuf)
     }
 
@@ -502,7 +535,7 @@ request(const Requests& reqs)
         for (Requests::const_iterator it=reqs.begin(); it!=reqs.end(); ++it)
             addRequest(*it);
         if (!childRequests.empty())
-            fetchCond.signal();
+            fetchCond.broadcast();
     }
 }
 
@@ -548,10 +581,8 @@ getData(const NodeGpuBuffer& gpuBuf) const
 }
 
 bool DataManager::
-existsChildData(const NodeMainData& parent)
+existsChildData(const NodeData& node)
 {
-    const NodeData& node = *parent.node;
-
     for (int i=0; i<4; ++i)
     {
         if (node.demTile.children[i] != INVALID_TILEINDEX)
@@ -707,6 +738,45 @@ touch(NodeMainBuffer& mainBuf) const
         mc.layerf.touch(*it);
 }
 
+void DataManager::
+retain(NodeMainBuffer& mainBuf) const
+{
+    MainCache& mc = CACHE->getMainCache();
+    mc.node.retain(mainBuf.node, LAST_FRAME);
+    mc.geometry.retain(mainBuf.geometry, LAST_FRAME);
+    mc.layerf.retain(mainBuf.height, LAST_FRAME);
+
+    typedef NodeMainBuffer::ColorBufferPtrs::iterator ColorIte;
+    for (ColorIte it=mainBuf.colors.begin(); it!=mainBuf.colors.end(); ++it)
+        mc.color.retain(*it, LAST_FRAME);
+
+    typedef NodeMainBuffer::LayerBufferPtrs::iterator LayerIte;
+    for (LayerIte it=mainBuf.layers.begin(); it!=mainBuf.layers.end(); ++it)
+        mc.layerf.retain(*it, LAST_FRAME);
+}
+
+
+void DataManager::
+addPrefetchHits(uint64_t numHits)
+{
+    Threads::Mutex::Lock lock(requestMutex);
+    prefetchStats.hits += numHits;
+}
+
+DataManager::PrefetchStats DataManager::
+getPrefetchStats()
+{
+    Threads::Mutex::Lock lock(requestMutex);
+    return prefetchStats;
+}
+
+void DataManager::
+resetPrefetchStats()
+{
+    Threads::Mutex::Lock lock(requestMutex);
+    prefetchStats = PrefetchStats();
+}
+
 
 DataManager::GlItem::
 GlItem() :
@@ -715,13 +785,19 @@ GlItem() :
 }
 
 
-#define GRABMAINBUFFER(ret, cache, index, older)\
-ret = cache.find(index);\
-if (ret == NULL)\
+/* the buffers grabbed along the way are tracked separately from the ones that
+   were found, such that a failure only returns the former to the cache */
+#define GRABMAINBUFFER(part, cache, dataIndex, older)\
+mainBuf.part = cache.find(dataIndex);\
+if (mainBuf.part == NULL)\
 {\
-    ret = cache.grabBuffer(older);\
-    if (ret == NULL)\
+    mainBuf.part = grabbed.part = cache.grabBuffer(older);\
+    if (mainBuf.part == NULL)\
+    {\
+        discardMainBuffer(index, grabbed);\
+        mainBuf = NodeMainBuffer();\
         return false;\
+    }\
 }
 
 bool DataManager::
@@ -730,22 +806,26 @@ grabMainBuffer(const TreeIndex& index, const FrameStamp older,
 {
     MainCache& mc = CACHE->getMainCache();
 
-    GRABMAINBUFFER(    mainBuf.node,     mc.node, DataIndex(0,index), older);
-    GRABMAINBUFFER(mainBuf.geometry, mc.geometry, DataIndex(0,index), older);
-    GRABMAINBUFFER(  mainBuf.height,   mc.layerf, DataIndex(0,index), older);
-
     size_t numColorLayers = colorFiles.size();
+    size_t numFloatLayers = layerfFiles.size();
+    NodeMainBuffer grabbed;
+    grabbed.colors.resize(numColorLayers, NULL);
+    grabbed.layers.resize(numFloatLayers, NULL);
+
+    GRABMAINBUFFER(    node,     mc.node, DataIndex(0,index), older);
+    GRABMAINBUFFER(geometry, mc.geometry, DataIndex(0,index), older);
+    GRABMAINBUFFER(  height,   mc.layerf, DataIndex(0,index), older);
+
     mainBuf.colors.resize(numColorLayers, NULL);
     for (size_t i=0; i<numColorLayers; ++i)
     {
-        GRABMAINBUFFER(mainBuf.colors[i],mc.color,DataIndex(i,index),older);
+        GRABMAINBUFFER(colors[i], mc.color, DataIndex(i,index), older);
     }
 
-    size_t numFloatLayers = layerfFiles.size();
     mainBuf.layers.resize(numFloatLayers, NULL);
     for (size_t i=0; i<numFloatLayers; ++i)
     {
-        GRABMAINBUFFER(mainBuf.layers[i],mc.layerf,DataIndex(i+1,index),older);
+        GRABMAINBUFFER(layers[i], mc.layerf, DataIndex(i+1,index), older);
     }
 
     return true;
@@ -778,6 +858,97 @@ releaseMainBuffer(const TreeIndex& index, const NodeMainBuffer& buffer) const
     }
 }
 
+void DataManager::
+discardMainBuffer(const TreeIndex& index, const NodeMainBuffer& buffer) const
+{
+    MainCache& mc = CACHE->getMainCache();
+
+    if (buffer.node != NULL)
+        mc.node.discardBuffer(DataIndex(0,index), buffer.node);
+    if (buffer.geometry != NULL)
+        mc.geometry.discardBuffer(DataIndex(0,index), buffer.geometry);
+    if (buffer.height != NULL)
+        mc.layerf.discardBuffer(DataIndex(0,index), buffer.height);
+
+    const int numColorLayers = static_cast<int>(buffer.colors.size());
+    for (int l=0; l<numColorLayers; ++l)
+    {
+        if (buffer.colors[l] != NULL)
+            mc.color.discardBuffer(DataIndex(l,index), buffer.colors[l]);
+    }
+
+    const int numFloatLayers = static_cast<int>(buffer.layers.size());
+    for (int l=0; l<numFloatLayers; ++l)
+    {
+        if (buffer.layers[l] != NULL)
+            mc.layerf.discardBuffer(DataIndex(l+1,index), buffer.layers[l]);
+    }
+}
+
+
+bool DataManager::
+pinMainBuffer(const TreeIndex& index, const NodeMainBuffer& buffer) const
+{
+    MainCache& mc = CACHE->getMainCache();
+
+    NodeMainBuffer pinned;
+    bool success = mc.node.pin(buffer.node, DataIndex(0,index));
+    if (success)
+    {
+        pinned.node = buffer.node;
+        success     = mc.geometry.pin(buffer.geometry, DataIndex(0,index));
+    }
+    if (success)
+    {
+        pinned.geometry = buffer.geometry;
+        success         = mc.layerf.pin(buffer.height, DataIndex(0,index));
+    }
+    if (success)
+        pinned.height = buffer.height;
+
+    const size_t numColorLayers = buffer.colors.size();
+    for (size_t l=0; success && l<numColorLayers; ++l)
+    {
+        success = mc.color.pin(buffer.colors[l], DataIndex(l,index));
+        if (success)
+            pinned.colors.push_back(buffer.colors[l]);
+    }
+
+    const size_t numFloatLayers = buffer.layers.size();
+    for (size_t l=0; success && l<numFloatLayers; ++l)
+    {
+        success = mc.layerf.pin(buffer.layers[l], DataIndex(l+1,index));
+        if (success)
+            pinned.layers.push_back(buffer.layers[l]);
+    }
+
+    //undo the partial pinning
+    if (!success)
+        unpinMainBuffer(pinned);
+    return success;
+}
+
+void DataManager::
+unpinMainBuffer(const NodeMainBuffer& buffer) const
+{
+    MainCache& mc = CACHE->getMainCache();
+
+    if (buffer.node != NULL)
+        mc.node.unpin(buffer.node);
+    if (buffer.geometry != NULL)
+        mc.geometry.unpin(buffer.geometry);
+    if (buffer.height != NULL)
+        mc.layerf.unpin(buffer.height);
+
+    typedef NodeMainBuffer::ColorBufferPtrs::const_iterator ColorIte;
+    for (ColorIte it=buffer.colors.begin(); it!=buffer.colors.end(); ++it)
+        mc.color.unpin(*it);
+
+    typedef NodeMainBuffer::LayerBufferPtrs::const_iterator LayerIte;
+    for (LayerIte it=buffer.layers.begin(); it!=buffer.layers.end(); ++it)
+        mc.layerf.unpin(*it);
+}
+
 
 #define FINDGPUBUFFER(buf, cache, index)\
 {\
@@ -954,11 +1125,10 @@ streamGpuData(GLContextData& contextData, BatchElement& batchel,
 }
 
 void DataManager::
-loadChild(Crusta* crusta, NodeMainData& parent,
-          uint8_t which,    NodeMainData& child)
+loadChildren(Crusta* crusta, NodeMainData& parent, NodeMainData children[4],
+             bool prefetched, double* geometryBuf)
 {
     NodeData& parentNode = *parent.node;
-    NodeData& childNode  = *child.node;
 
     //compute the child scopes
     Scope childScopes[4];
@@ -967,66 +1137,93 @@ loadChild(Crusta* crusta, NodeMainData& parent,
     int numColorLayers = static_cast<int>(colorFiles.size());
     int numFloatLayers = static_cast<int>(layerfFiles.size());
 
-//- Node data
-    //clear the data layers
-    childNode.colorTiles.resize(numColorLayers, NodeData::Tile());
-    child.colors.resize(numColorLayers, NULL);
-    childNode.layerTiles.resize(numFloatLayers, NodeData::Tile());
-    child.layers.resize(numFloatLayers, NULL);
+    NodeData* childNodes[4];
+    for (int which=0; which<4; ++which)
+    {
+        childNodes[which] = children[which].node;
+        if (childNodes[which] == NULL)
+            continue;
 
-    //clear the old line data
-    childNode.lineCoverage.clear();
-    childNode.lineNumSegments = 0;
-    childNode.lineData.clear();
+        NodeMainData& child = children[which];
+        NodeData& childNode = *child.node;
 
-    //initialize
-    childNode.index     = parentNode.index.down(which);
-    childNode.scope     = childScopes[which];
+//- Node data
+        //clear the data layers
+        childNode.colorTiles.resize(numColorLayers, NodeData::Tile());
+        child.colors.resize(numColorLayers, NULL);
+        childNode.layerTiles.resize(numFloatLayers, NodeData::Tile());
+        child.layers.resize(numFloatLayers, NULL);
+
+        //clear the old line data
+        childNode.lineCoverage.clear();
+        childNode.lineNumSegments = 0;
+        childNode.lineData.clear();
+
+        //initialize
+        childNode.index      = parentNode.index.down(which);
+        childNode.scope      = childScopes[which];
+        childNode.prefetched = prefetched;
 
 //- Geometry data
-    generateGeometry(crusta, &childNode, child.geometry);
+        generateGeometry(crusta, &childNode, child.geometry, geometryBuf);
+
+//- Tile indices of the data layers
+        //topography reserves the first data id of the layerf cache
+        childNode.demTile.dataId = 0;
+        childNode.demTile.node   = parentNode.demTile.children[which];
+        for (int i=0; i<4; ++i)
+            childNode.demTile.children[i] = INVALID_TILEINDEX;
+
+        for (int l=0; l<numColorLayers; ++l)
+        {
+            NodeData::Tile& tile = childNode.colorTiles[l];
+            tile.dataId = l;
+            tile.node   = parentNode.colorTiles[l].children[which];
+            for (int c=0; c<4; ++c)
+                tile.children[c] = INVALID_TILEINDEX;
+        }
+
+        for (int l=0; l<numFloatLayers; ++l)
+        {
+            NodeData::Tile& tile = childNode.layerTiles[l];
+            tile.dataId = l+1;
+            tile.node   = parentNode.layerTiles[l].children[which];
+            for (int c=0; c<4; ++c)
+                tile.children[c] = INVALID_TILEINDEX;
+        }
+    }
 
 //- Topography data
-    //topography reserves the first data id of the layerf cache
-    childNode.demTile.dataId = 0;
-    childNode.demTile.node   = parentNode.demTile.children[which];
+    DemHeight::Type* heights[4];
     for (int i=0; i<4; ++i)
-        childNode.demTile.children[i] = INVALID_TILEINDEX;
-
-    sourceDem(&parentNode, parent.height, &childNode, child.height);
+        heights[i] = children[i].height;
+    sourceDem(&parentNode, parent.height, childNodes, heights);
 
 //- Texture color layer data
     for (int l=0; l<numColorLayers; ++l)
     {
-        //generate and save the tile indices for this data
-        NodeData::Tile& tile = childNode.colorTiles[l];
-        tile.dataId = l;
-        tile.node   = parentNode.colorTiles[l].children[which];
-        for (int c=0; c<4; ++c)
-            tile.children[c] = INVALID_TILEINDEX;
-
-        //read in the color data
-        sourceColor(&parentNode,   parent.colors[l],
-                     &childNode, l, child.colors[l]);
+        TextureColor::Type* colors[4];
+        for (int i=0; i<4; ++i)
+            colors[i] = childNodes[i]!=NULL ? children[i].colors[l] : NULL;
+        sourceColor(&parentNode, parent.colors[l], childNodes, l, colors);
     }
 
 //- Layerf layer data
     for (int l=0; l<numFloatLayers; ++l)
     {
-        //generate and save the tile indices for this data
-        NodeData::Tile& tile = childNode.layerTiles[l];
-        tile.dataId = l+1;
-        tile.node   = parentNode.layerTiles[l].children[which];
-        for (int c=0; c<4; ++c)
-            tile.children[c] = INVALID_TILEINDEX;
-
-        //read in the layer
-        sourceLayerf(&parentNode,    parent.layers[l],
-                      &childNode, l,  child.layers[l]);
+        LayerDataf::Type* layers[4];
+        for (int i=0; i<4; ++i)
+            layers[i] = childNodes[i]!=NULL ? children[i].layers[l] : NULL;
+        sourceLayerf(&parentNode, parent.layers[l], childNodes, l, layers);
     }
 
-//- Finalize the node
-    childNode.init(SETTINGS->globeRadius, crusta->getVerticalScale());
+//- Finalize the nodes
+    for (int i=0; i<4; ++i)
+    {
+        if (childNodes[i] != NULL)
+            childNodes[i]->init(SETTINGS->globeRadius,
+                                crusta->getVerticalScale());
+    }
 
 /**\todo Vis2010 This is where the coverage data should be propagated to the
 child. But, here I only see individual children, thus I'd have to split the
@@ -1037,11 +1234,12 @@ that to pass along the proper data */
 
 
 void DataManager::
-generateGeometry(Crusta* crusta, NodeData* child, Vertex* v)
+generateGeometry(Crusta* crusta, NodeData* child, Vertex* v,
+                 double* geometryBuf)
 {
 ///\todo use average height to offset from the spheroid
     double shellRadius = SETTINGS->globeRadius;
-    child->scope.getRefinement(shellRadius, TILE_RESOLUTION, tempGeometryBuf);
+    child->scope.getRefinement(shellRadius, TILE_RESOLUTION, geometryBuf);
 
     /* compute and store the centroid here, since node-creation level generation
      of these values only happens after the data load step */
@@ -1050,8 +1248,8 @@ generateGeometry(Crusta* crusta, NodeData* child, Vertex* v)
     child->centroid[1] = scopeCentroid[1];
     child->centroid[2] = scopeCentroid[2];
 
-    for (double* g=tempGeometryBuf;
-         g<tempGeometryBuf+TILE_RESOLUTION*TILE_RESOLUTION*3; g+=3, ++v)
+    for (double* g=geometryBuf;
+         g<geometryBuf+TILE_RESOLUTION*TILE_RESOLUTION*3; g+=3, ++v)
     {
         v->position[0] = DemHeight::Type(g[0] - child->centroid[0]);
         v->position[1] = DemHeight::Type(g[1] - child->centroid[1]);
@@ -1125,176 +1323,291 @@ sampleParent(int child, LayerDataf::Type* dst,
     sampleParentBase(child, range, dst, src, nodata);
 }
 
+/** hint the (mapped) file that the children of a freshly read tile are likely
+    to be requested next, such that their pages can be faulted in ahead */
+template <typename FileType>
+inline void
+prefetchChildren(FileType* file, const TileIndex children[4])
+{
+    for (int i=0; i<4; ++i)
+    {
+        if (children[i] != INVALID_TILEINDEX)
+            file->willNeedTile(children[i]);
+    }
+}
+
+/** read the tiles of a group of siblings (NULL tiles are skipped). Siblings
+    stored next to each other in the file are gathered with a single read */
+template <typename FileType>
+inline bool
+readSiblingTiles(FileType* file, NodeData::Tile* const tiles[4],
+                 typename FileType::TileHeader headers[4],
+                 typename FileType::Pixel* const buffers[4])
+{
+    TileIndex indices[4];
+    TileIndex childPointers[4][4];
+    for (int i=0; i<4; ++i)
+        indices[i] = tiles[i]!=NULL ? tiles[i]->node : INVALID_TILEINDEX;
+
+    if (!file->readTiles(4, indices, &childPointers[0][0], headers, buffers))
+        return false;
+
+    for (int i=0; i<4; ++i)
+    {
+        if (tiles[i] == NULL)
+            continue;
+        memcpy(tiles[i]->children, childPointers[i], 4*sizeof(TileIndex));
+        prefetchChildren(file, tiles[i]->children);
+    }
+    return true;
+}
+
 void DataManager::
 sourceDem(const NodeData* const parent,
           const DemHeight::Type* const parentHeight,
-          NodeData* child, DemHeight::Type* childHeight)
+          NodeData* const children[4], DemHeight::Type* const childHeights[4])
 {
     typedef DemFile::File    File;
     typedef File::TileHeader TileHeader;
 
-    DemHeight::Type* range = &child->elevationRange[0];
+    //read the tiles of the children for which data exists
+    NodeData::Tile* tiles[4];
+    const NodeData* sourced = NULL;
+    for (int i=0; i<4; ++i)
+    {
+        tiles[i] = NULL;
+        if (children[i]!=NULL && children[i]->demTile.node!=INVALID_TILEINDEX)
+        {
+            tiles[i] = &children[i]->demTile;
+            sourced  = children[i];
+        }
+    }
 
-    if (child->demTile.node != INVALID_TILEINDEX)
+    TileHeader headers[4];
+    if (sourced != NULL)
     {
-        TileHeader header;
-        File* file = demFile->getPatch(child->index.patch());
-        if (!file->readTile(child->demTile.node, child->demTile.children,
-                            header, childHeight))
+        File* file = demFile->getPatch(sourced->index.patch());
+        if (!readSiblingTiles(file, tiles, headers, childHeights))
         {
             Misc::throwStdErr("DataManager::sourceDem: Invalid DEM file: "
                               "could not read node %s's data",
-                              child->index.med_str().c_str());
+                              sourced->index.med_str().c_str());
         }
-        range[0] = header.range[0];
-        range[1] = header.range[1];
     }
-    else
+
+    for (int i=0; i<4; ++i)
     {
-        if (parent != NULL)
+        NodeData* child = children[i];
+        if (child == NULL)
+            continue;
+
+        DemHeight::Type* range = &child->elevationRange[0];
+        if (tiles[i] != NULL)
+        {
+            range[0] = headers[i].range[0];
+            range[1] = headers[i].range[1];
+        }
+        else if (parent != NULL)
         {
             sampleParent(child->index.child(), range,
-                         childHeight, parentHeight, demNodata);
+                         childHeights[i], parentHeight, demNodata);
         }
         else
         {
             range[0] =  Math::Constants<DemHeight::Type>::max;
             range[1] = -Math::Constants<DemHeight::Type>::max;
-            for (size_t i=0; i<TILE_RESOLUTION*TILE_RESOLUTION; ++i)
-                childHeight[i] = demNodata;
+            for (size_t p=0; p<TILE_RESOLUTION*TILE_RESOLUTION; ++p)
+                childHeights[i][p] = demNodata;
         }
+
+        //the ray intersections use the block ranges to skip empty space
+        child->heightPyramid.build(*child, childHeights[i]);
     }
 }
 
 void DataManager::
 sourceColor(const NodeData* const parent,
             const TextureColor::Type* const parentColor,
-            NodeData* child, uint8_t layer,
-            TextureColor::Type* childColor)
+            NodeData* const children[4], uint8_t layer,
+            TextureColor::Type* const childColors[4])
 {
-    typedef ColorFile::File File;
+    typedef ColorFile::File  File;
+    typedef File::TileHeader TileHeader;
 
-    if (child->colorTiles[layer].node != INVALID_TILEINDEX)
+    //read the tiles of the children for which data exists
+    NodeData::Tile* tiles[4];
+    const NodeData* sourced = NULL;
+    for (int i=0; i<4; ++i)
+    {
+        tiles[i] = NULL;
+        if (children[i]!=NULL &&
+            children[i]->colorTiles[layer].node!=INVALID_TILEINDEX)
+        {
+            tiles[i] = &children[i]->colorTiles[layer];
+            sourced  = children[i];
+        }
+    }
+
+    if (sourced != NULL)
     {
         assert(layer < colorFiles.size());
-        //get the color data into a temporary storage
-        File* file = colorFiles[layer]->getPatch(child->index.patch());
-        if (!file->readTile(child->colorTiles[layer].node,
-                            child->colorTiles[layer].children, childColor))
+        TileHeader headers[4];
+        File* file = colorFiles[layer]->getPatch(sourced->index.patch());
+        if (!readSiblingTiles(file, tiles, headers, childColors))
         {
             Misc::throwStdErr("DataManager::sourceColor: Invalid Color "
                               "file: could not read node %s's data",
-                              child->index.med_str().c_str());
+                              sourced->index.med_str().c_str());
         }
     }
-    else
+
+    for (int i=0; i<4; ++i)
     {
+        if (children[i]==NULL || tiles[i]!=NULL)
+            continue;
+
         if (parent != NULL)
         {
-            sampleParent(child->index.child(), childColor, parentColor,
-                         colorNodata);
+            sampleParent(children[i]->index.child(), childColors[i],
+                         parentColor, colorNodata);
         }
         else
         {
-            for (size_t i=0; i<TILE_RESOLUTION*TILE_RESOLUTION; ++i)
-                childColor[i] = colorNodata;
+            for (size_t p=0; p<TILE_RESOLUTION*TILE_RESOLUTION; ++p)
+                childColors[i][p] = colorNodata;
         }
     }
 }
 
 void DataManager::
 sourceLayerf(const NodeData* const parent,
-                  const LayerDataf::Type* const parentLayerf,
-                  NodeData* child, uint8_t layer, LayerDataf::Type* childLayerf)
+             const LayerDataf::Type* const parentLayerf,
+             NodeData* const children[4], uint8_t layer,
+             LayerDataf::Type* const childLayerfs[4])
 {
     typedef LayerfFile::File File;
+    typedef File::TileHeader TileHeader;
+
+    //read the tiles of the children for which data exists
+    NodeData::Tile* tiles[4];
+    const NodeData* sourced = NULL;
+    for (int i=0; i<4; ++i)
+    {
+        tiles[i] = NULL;
+        if (children[i]!=NULL &&
+            children[i]->layerTiles[layer].node!=INVALID_TILEINDEX)
+        {
+            tiles[i] = &children[i]->layerTiles[layer];
+            sourced  = children[i];
+        }
+    }
 
-    if (child->layerTiles[layer].node != INVALID_TILEINDEX)
+    if (sourced != NULL)
     {
         assert(layer<layerfFiles.size());
-        File* file = layerfFiles[layer]->getPatch(child->index.patch());
-        if (!file->readTile(child->layerTiles[layer].node,
-                            child->layerTiles[layer].children,
-                            childLayerf))
+        TileHeader headers[4];
+        File* file = layerfFiles[layer]->getPatch(sourced->index.patch());
+        if (!readSiblingTiles(file, tiles, headers, childLayerfs))
         {
             Misc::throwStdErr("DataManager::sourceLayerf: Invalid Layerf "
                               "file: could not read node %s's data",
-                              child->index.med_str().c_str());
+                              sourced->index.med_str().c_str());
         }
     }
-    else
+
+    for (int i=0; i<4; ++i)
     {
+        if (children[i]==NULL || tiles[i]!=NULL)
+            continue;
+
         if (parent != NULL)
         {
-            sampleParent(child->index.child(), childLayerf, parentLayerf,
-                         layerfNodata);
+            sampleParent(children[i]->index.child(), childLayerfs[i],
+                         parentLayerf, layerfNodata);
         }
         else
         {
-            for (size_t i=0; i<TILE_RESOLUTION*TILE_RESOLUTION; ++i)
-                childLayerf[i] = layerfNodata;
+            for (size_t p=0; p<TILE_RESOLUTION*TILE_RESOLUTION; ++p)
+                childLayerfs[i][p] = layerfNodata;
         }
     }
 }
 
 
 void DataManager::
-addRequest(Request req)
+addRequest(const Request& req)
 {
-    typedef std::list<Request> ReqList;
-
-    //find where to insert the request and coalesce duplicates
-    ReqList::iterator insertIte;
-    for (insertIte=childRequests.begin(); insertIte!=childRequests.end();)
-    {
-        //remove existing entry, but update the LOD as necessary
-        if (req == *insertIte)
-        {
-            req.lod = std::min(req.lod, insertIte->lod);
-            childRequests.erase(insertIte++);
-            continue;
-        }
-        //stop at the right LOD insertion point
-        if (req > *insertIte)
-            break;
-        else
-            ++insertIte;
-    }
-
-    //insert the request
-    childRequests.insert(insertIte, req);
-    //keep the request list manageable
-    while (static_cast<int>(childRequests.size()) >
-           SETTINGS->dataManMaxFetchRequests)
-    {
-        childRequests.pop_front();
-    }
-    assert(!childRequests.empty());
+    //requests for the children of the same parent are merged
+    childRequests.push(req.parent.node->getData().index.raw, req,
+                       static_cast<size_t>(SETTINGS->dataManMaxFetchRequests));
 }
 
 void* DataManager::
 fetchThreadFunc()
 {
+    //each fetch thread requires its own scratch space for the geometry
+    double* geometryBuf = new double[TILE_RESOLUTION*TILE_RESOLUTION*3];
+
     Request req;
+    TreeIndex parentIndex;
+    uint8_t childMask = 0;
     while (true)
     {
     //-- grab a request from the pending list
         {
-            //make sure there are requests available
             Threads::Mutex::Lock lock(requestMutex);
-            if (childRequests.empty())
-                fetchCond.wait(requestMutex);
-            //terminate before trying to fetch more?
-            if (terminateFetch)
-                return NULL;
-            //grab the request
-            assert(!childRequests.empty());
-            req = childRequests.back();
-            childRequests.pop_back();
+            childMask = 0;
+            while (childMask == 0)
+            {
+                //make sure there are requests available
+                while (childRequests.empty() && !terminateFetch)
+                    fetchCond.wait(requestMutex);
+                //terminate before trying to fetch more?
+                if (terminateFetch)
+                {
+                    delete[] geometryBuf;
+                    return NULL;
+                }
+                //grab the request
+                ChildRequests::Key key;
+                req = childRequests.pop(key);
+
+                /* the parent of a prefetch request is only retained for a
+                   frame and a request might wait in the queue for longer.
+                   Keep the parent from being recycled while its children are
+                   loaded, or drop the request if its buffers have been
+                   recycled already */
+                parentIndex.raw = key;
+                if (!pinMainBuffer(parentIndex, req.parent))
+                    continue;
+
+                /* another thread might already be loading some of the children
+                   (the request was re-issued before the data became
+                   available). Drop those, they will be requested again if
+                   still needed */
+                childMask = req.childMask;
+                for (int i=0; i<4; ++i)
+                {
+                    if ((childMask & (1<<i)) != 0 &&
+                        std::find(inFlightRequests.begin(),
+                                  inFlightRequests.end(),
+                                  parentIndex.down(i)) !=
+                        inFlightRequests.end())
+                    {
+                        childMask &= ~(1<<i);
+                    }
+                }
+            }
+            for (int i=0; i<4; ++i)
+            {
+                if ((childMask & (1<<i)) != 0)
+                    inFlightRequests.push_back(parentIndex.down(i));
+            }
+            if (childMask == 0)
+                unpinMainBuffer(req.parent);
         }
 
-    //-- try to grab a cache entry to satisfy the request
-        TreeIndex childIndex=req.parent.node->getData().index.down(req.child);
+    //-- try to grab cache entries to satisfy the request
         /* Because the frame swaps are no synchronized with this thread, the
            grab could occur right after the swap (i.e., CURRENT_FRAME set to
            the new timestamp), then all the cache entries would be valid
@@ -1302,27 +1615,72 @@ fetchThreadFunc()
            evaluation of the surface approximation would retain from the
            previous frame, we restrict candidates to ones that have been
            neglected for at least two frames already */
-        NodeMainBuffer mainBuf;
-        if (!grabMainBuffer(childIndex, LAST_FRAME, mainBuf))
+        NodeMainBuffer childBufs[4];
+        NodeMainData   childData[4];
+        bool haveChild = false;
+        for (int i=0; i<4; ++i)
         {
-            std::cerr << "!!! no more main memory cache" << std::endl;
-            //we couldn't secure a buffer from the cache bail on this request
-            continue;
+            if ((childMask & (1<<i)) == 0)
+                continue;
+
+            if (grabMainBuffer(parentIndex.down(i), LAST_FRAME, childBufs[i]))
+            {
+                childData[i] = getData(childBufs[i]);
+                haveChild    = true;
+            }
+            else
+            {
+                //we couldn't secure a buffer from the cache bail on this child
+                std::cerr << "!!! no more main memory cache" << std::endl;
+            }
         }
 
-    //-- fetch it
-        NodeMainData parentData = getData(req.parent);
-        NodeMainData childData  = getData(mainBuf);
-        loadChild(req.crusta, parentData, req.child, childData);
+        if (haveChild)
+        {
+        //-- fetch them
+            NodeMainData parentData = getData(req.parent);
+            loadChildren(req.crusta, parentData, childData, req.prefetch,
+                         geometryBuf);
 
-    //-- make it available
-        releaseMainBuffer(childIndex, mainBuf);
+        //-- make them available
+            for (int i=0; i<4; ++i)
+            {
+                if (childData[i].node != NULL)
+                    releaseMainBuffer(parentIndex.down(i), childBufs[i]);
+            }
 CRUSTA_DEBUG(14, CRUSTA_DEBUG_OUT <<
-"FetchThread: request for Index " << childIndex.med_str() << ":" <<
-req.child << " processed\n";)
-        Vrui::requestUpdate();
+"FetchThread: request for Index " << parentIndex.med_str() << ":" <<
+int(childMask) << " processed\n";)
+            Vrui::requestUpdate();
+        }
+        unpinMainBuffer(req.parent);
+
+    //-- the nodes are no longer being processed
+        {
+            Threads::Mutex::Lock lock(requestMutex);
+            for (int i=0; i<4; ++i)
+            {
+                if (childData[i].node == NULL)
+                    continue;
+                if (req.prefetch)
+                    ++prefetchStats.prefetched;
+                else
+                    ++prefetchStats.demandLoads;
+            }
+
+            for (int i=0; i<4; ++i)
+            {
+                if ((childMask & (1<<i)) == 0)
+                    continue;
+                TreeIndices::iterator it = std::find(inFlightRequests.begin(),
+                    inFlightRequests.end(), parentIndex.down(i));
+                assert(it != inFlightRequests.end());
+                inFlightRequests.erase(it);
+            }
+        }
     }
 
+    delete[] geometryBuf;
     return NULL;
 }
 
@@ -6,6 +6,7 @@
 #include <crustacore/GlobeFile.h>
 #include <crusta/QuadCache.h>
 #include <crusta/QuadNodeData.h>
+#include <crusta/RequestQueue.h>
 #include <crusta/shader/ShaderAtlasDataSource.h>
 #include <crusta/shader/ShaderTopographySource.h>
 #include <crusta/SurfaceApproximation.h>
@@ -70,18 +71,18 @@ public:
     };
     typedef std::vector<BatchElement> Batch;
 
-    /** information required to process the fetch/generation of data */
+    /** information required to process the fetch/generation of data. The
+        children of a node are requested as a group, such that the siblings
+        required for a split are loaded together */
     class Request
     {
         friend class DataManager;
+        template <typename RequestParam> friend class RequestQueue;
 
     public:
         Request();
         Request(Crusta* iCrusta, float iLod, const NodeMainBuffer& iParent,
-                uint8_t iChild);
-
-        bool operator ==(const Request& other) const;
-        bool operator >(const Request& other) const;
+                uint8_t iChildMask, bool iPrefetch=false);
 
     protected:
         /** handle to the requesting crusta */
@@ -90,11 +91,27 @@ public:
         float lod;
         /** parent of the requested */
         NodeMainBuffer parent;
-        /** index of the child to be loaded */
-        uint8_t child;
+        /** bit mask of the children to be loaded (bit i for child i) */
+        uint8_t childMask;
+        /** the data is anticipated for a predicted view rather than needed
+            by the current one */
+        bool prefetch;
     };
     typedef std::vector<Request> Requests;
 
+    /** counters for tuning the prefetching */
+    struct PrefetchStats
+    {
+        PrefetchStats();
+
+        /** number of nodes loaded by prefetch requests */
+        uint64_t prefetched;
+        /** number of prefetched nodes that became part of a representation */
+        uint64_t hits;
+        /** number of nodes loaded because the current view needed them */
+        uint64_t demandLoads;
+    };
+
     DataManager();
     ~DataManager();
 
@@ -153,7 +170,7 @@ public:
     /** get the data pointed to by the gpu buffer */
     const NodeGpuData getData(const NodeGpuBuffer& gpuBuf) const;
     /** check if it is possible to get higher-resolution data */
-    bool existsChildData(const NodeMainData& parent);
+    bool existsChildData(const NodeData& node);
 
     /** grabs a combo-buffer corresponding to the crusta node */
     bool find(const TreeIndex& index, NodeMainBuffer& mainBuf) const;
@@ -170,10 +187,25 @@ public:
     bool isComplete(const NodeMainBuffer& mainBuf) const;
     /** touch the main buffers */
     void touch(NodeMainBuffer& mainBuf) const;
+    /** keep the main buffers from being recycled during the next frame,
+        without making them part of the current hierarchy */
+    void retain(NodeMainBuffer& mainBuf) const;
+
+    /** record the number of prefetched nodes that have been used by the
+        representation of a frame */
+    void addPrefetchHits(uint64_t numHits);
+    /** retrieve the prefetching counters. The hit rate is given by
+        hits / (hits + demandLoads) */
+    PrefetchStats getPrefetchStats();
+    /** reset the prefetching counters */
+    void resetPrefetchStats();
 
 protected:
-    typedef std::vector<ColorFile*>  ColorFiles;
-    typedef std::vector<LayerfFile*> LayerfFiles;
+    typedef std::vector<ColorFile*>       ColorFiles;
+    typedef std::vector<LayerfFile*>      LayerfFiles;
+    typedef std::vector<Threads::Thread*> FetchThreads;
+    typedef std::vector<TreeIndex>        TreeIndices;
+    typedef RequestQueue<Request>         ChildRequests;
 
     struct GlItem : public GLObject::DataItem
     {
@@ -190,6 +222,16 @@ protected:
     /** release main buffers to the managed caches */
     void releaseMainBuffer(const TreeIndex& index,
                            const NodeMainBuffer& buffer) const;
+    /** return grabbed main buffers to the managed caches without validating
+        them, when the data of the node can't be provided */
+    void discardMainBuffer(const TreeIndex& index,
+                           const NodeMainBuffer& buffer) const;
+    /** pin the main buffers if they all still hold the data of the node.
+        Returns false, leaving them unpinned, if any has been recycled */
+    bool pinMainBuffer(const TreeIndex& index,
+                       const NodeMainBuffer& buffer) const;
+    /** unpin main buffers pinned by pinMainBuffer */
+    void unpinMainBuffer(const NodeMainBuffer& buffer) const;
 
     /** find the gpu buffers from the managed caches */
     bool findGpuBuffer(GLContextData& contextData, const NodeMainData& main,
@@ -201,29 +243,36 @@ protected:
     void streamGpuData(GLContextData& contextData, BatchElement& batchel,
                        NodeGpuBuffer& gpuBuf);
 
-    /** load the data required for the child of the specified node */
-    void loadChild(Crusta* crusta, NodeMainData& parent, uint8_t which,
-                   NodeMainData& child);
+    /** load the data required for the children of the specified node.
+        Children without a node buffer are skipped. The geometry buffer provides
+        the temporary storage used to compute the high-precision surface
+        geometry */
+    void loadChildren(Crusta* crusta, NodeMainData& parent,
+                      NodeMainData children[4], bool prefetched,
+                      double* geometryBuf);
 
     /** produce the flat sphere cartesian space coordinates for a node */
-    void generateGeometry(Crusta* crusta, NodeData* child, Vertex* v);
-    /** source the elevation data for a node */
+    void generateGeometry(Crusta* crusta, NodeData* child, Vertex* v,
+                          double* geometryBuf);
+    /** source the elevation data for a group of siblings. NULL children are
+        skipped. The tiles of the siblings are read from the file together */
     void sourceDem(const NodeData* const parent,
-                   const DemHeight::Type* const parentHeight, NodeData* child,
-                   DemHeight::Type* childHeight);
-    /** source the color data for a node */
+                   const DemHeight::Type* const parentHeight,
+                   NodeData* const children[4],
+                   DemHeight::Type* const childHeights[4]);
+    /** source the color data for a group of siblings */
     void sourceColor(const NodeData* const parent,
                      const TextureColor::Type* const parentColor,
-                     NodeData* child, uint8_t layer,
-                     TextureColor::Type* childColor);
-    /** source the layerf data for a node */
+                     NodeData* const children[4], uint8_t layer,
+                     TextureColor::Type* const childColors[4]);
+    /** source the layerf data for a group of siblings */
     void sourceLayerf(const NodeData* const parent,
                       const LayerDataf::Type* const parentLayerf,
-                      NodeData* child, uint8_t layer,
-                      LayerDataf::Type* childLayerf);
+                      NodeData* const children[4], uint8_t layer,
+                      LayerDataf::Type* const childLayerfs[4]);
 
     /** merge a new request into the pending list */
-    void addRequest(Request req);
+    void addRequest(const Request& req);
 
     /** fetch thread function: process the generation/reading of the data */
     void* fetchThreadFunc();
@@ -265,21 +314,29 @@ protected:
     /** current surface being sent to gpu */
     const SurfaceApproximation* curSurface;
 
-    /** temporary storage for computing the high-precision surface geometry */
+    /** temporary storage for computing the high-precision surface geometry of
+        the root nodes. The fetch threads each allocate their own */
     double* tempGeometryBuf;
 
     /** serialize access to data requesting */
     Threads::Mutex requestMutex;
     /** keep track of pending child requests */
-    std::list<Request> childRequests;
+    ChildRequests childRequests;
+    /** indices of the children currently being processed by the fetch
+        threads. Used to prevent concurrent loads of the same node */
+    TreeIndices inFlightRequests;
+
+    /** counters of the prefetching (protected by the request mutex) */
+    PrefetchStats prefetchStats;
 
-    /** flags the fetch thread to terminate */
+    /** flags the fetch threads to terminate */
     bool terminateFetch;
 
-    /** allow the fetching thread to blocking wait for requests */
+    /** allow the fetching threads to blocking wait for requests */
     Threads::Cond fetchCond;
-    /** thread handling fetch request processing */
-    Threads::Thread fetchThread;
+    /** pool of threads handling fetch request processing */
+    ///\todo benchmark tiles/s per pool size on a recorded request stream
+    FetchThreads fetchThreads;
 
     /** used to reset the source shaders */
     FrameStamp resetSourceShadersStamp;
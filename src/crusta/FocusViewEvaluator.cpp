@@ -12,7 +12,12 @@ namespace crusta {
 void FocusViewEvaluator::
 setFocusFromDisplay()
 {
-	Vrui::NavTransform invXform = Vrui::getInverseNavigationTransformation();
+	setFocusFromDisplay(Vrui::getInverseNavigationTransformation());
+}
+
+void FocusViewEvaluator::
+setFocusFromDisplay(const Vrui::NavTransform& invXform)
+{
 	focusCenter = Geometry::Point<double, 3>(
 		invXform.transform(Vrui::getDisplayCenter()));
 	focusRadius = invXform.getScaling() * Vrui::getDisplaySize() * 0.5;
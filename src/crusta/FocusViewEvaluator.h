@@ -17,6 +17,9 @@ class FocusViewEvaluator : public LodEvaluator
 public:
     /** update the focus area from the display center */
     void setFocusFromDisplay();
+    /** update the focus area from the display center as seen through the
+        given inverse navigation transformation */
+    void setFocusFromDisplay(const Vrui::NavTransform& invXform);
 
     /** the specification of the viewing parameters */
     GLFrustum<double> frustum;
@@ -1,11 +1,26 @@
 #include <crusta/FrustumVisibility.h>
 
+#include <algorithm>
+
 #include <crusta/QuadNodeData.h>
 #include <crusta/SliceTool.h>
 #include <crusta/CrustaSettings.h>
 
 namespace crusta {
 
+FrustumVisibility::Stats::
+Stats() :
+    frustumRejects(0), horizonRejects(0)
+{
+}
+
+
+FrustumVisibility::
+FrustumVisibility() :
+    verticalScale(1.0)
+{
+}
+
 bool FrustumVisibility::
 evaluate(const NodeData& node)
 {
@@ -14,9 +29,28 @@ evaluate(const NodeData& node)
         if (!frustum.doesSphereIntersect(node.boundingCenter,
                                          node.boundingRadius))
         {
+            ++stats.frustumRejects;
             return false;
         }
 
+        /* the bounding sphere test is cheap, but loose for the large nodes of
+           the coarse levels. Their elevation range bounds them tighter */
+        if (horizon.isActive())
+        {
+            DemHeight::Type range[2];
+            node.getElevationRange(range);
+            //a negative vertical scale turns the range upside down
+            Scalar maxRadius = SETTINGS->globeRadius +
+                               std::max(range[0]*verticalScale,
+                                        range[1]*verticalScale);
+            if (horizon.isOccluded(node.boundingCenter, node.boundingRadius) ||
+                horizon.isOccluded(node.scope, maxRadius))
+            {
+                ++stats.horizonRejects;
+                return false;
+            }
+        }
+
         return true;
     }
     else
@@ -1,6 +1,7 @@
 #ifndef _FrustumVisibility_H_
 #define _FrustumVisibility_H_
 
+#include <crusta/HorizonOccluder.h>
 #include <crusta/VisibilityEvaluator.h>
 
 #include <crusta/vrui.h>
@@ -14,8 +15,29 @@ namespace crusta {
 class FrustumVisibility : public VisibilityEvaluator
 {
 public:
+    /** counters of the nodes rejected by the different tests */
+    struct Stats
+    {
+        Stats();
+
+        /** number of nodes outside of the view frustum */
+        size_t frustumRejects;
+        /** number of nodes hidden behind the horizon */
+        size_t horizonRejects;
+    };
+
+    FrustumVisibility();
+
     /** the specification of the viewing parameters */
     GLFrustum<double> frustum;
+    /** occluder used to reject the nodes behind the horizon. The test is
+        skipped unless the occluder is active */
+    HorizonOccluder horizon;
+    /** vertical scale applied to the elevation ranges of the nodes */
+    Scalar verticalScale;
+
+    /** the rejection counters since the evaluator was setup */
+    Stats stats;
 
 //- inherited from VisibilityEvaluator
 public:
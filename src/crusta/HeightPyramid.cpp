@@ -0,0 +1,114 @@
+#include <crusta/HeightPyramid.h>
+
+#include <algorithm>
+#include <cassert>
+
+#include <crusta/QuadNodeData.h>
+
+
+namespace crusta {
+
+
+const int HeightPyramid::NUM_CELLS;
+const int HeightPyramid::NUM_BLOCKS;
+
+HeightPyramid::
+HeightPyramid() :
+    numLevels(1)
+{
+    for (int res=NUM_CELLS; res>1; res>>=1)
+        ++numLevels;
+
+    for (int i=0; i<NUM_BLOCKS; ++i)
+    {
+        ranges[i][0] =  Math::Constants<DemHeight::Type>::max;
+        ranges[i][1] = -Math::Constants<DemHeight::Type>::max;
+    }
+}
+
+void HeightPyramid::
+build(const NodeData& node, const DemHeight::Type* heights)
+{
+    //the first level covers the 3x3 vertices of each block of 2x2 cells
+    int numBlocks = NUM_CELLS >> 1;
+    DemHeight::Type (*range)[2] = ranges;
+    for (int y=0; y<numBlocks; ++y)
+    {
+        for (int x=0; x<numBlocks; ++x, ++range)
+        {
+            const DemHeight::Type* h = heights + 2*y*TILE_RESOLUTION + 2*x;
+            (*range)[0] = (*range)[1] = node.getHeight(*h);
+            for (int j=0; j<3; ++j, h+=TILE_RESOLUTION)
+            {
+                for (int i=0; i<3; ++i)
+                {
+                    DemHeight::Type height = node.getHeight(h[i]);
+                    (*range)[0] = std::min((*range)[0], height);
+                    (*range)[1] = std::max((*range)[1], height);
+                }
+            }
+        }
+    }
+
+    //the coarser levels merge the four blocks they cover
+    for (int level=2; level<numLevels; ++level)
+    {
+        int numChildBlocks = numBlocks;
+        numBlocks >>= 1;
+
+        const DemHeight::Type (*children)[2] = ranges +
+                                               getLevelOffset(level-1);
+        for (int y=0; y<numBlocks; ++y)
+        {
+            for (int x=0; x<numBlocks; ++x, ++range)
+            {
+                const DemHeight::Type (*child)[2] =
+                    children + 2*y*numChildBlocks + 2*x;
+                const DemHeight::Type* quad[4] = {
+                    child[0], child[1],
+                    child[numChildBlocks], child[numChildBlocks+1] };
+
+                (*range)[0] = quad[0][0];
+                (*range)[1] = quad[0][1];
+                for (int i=1; i<4; ++i)
+                {
+                    (*range)[0] = std::min((*range)[0], quad[i][0]);
+                    (*range)[1] = std::max((*range)[1], quad[i][1]);
+                }
+            }
+        }
+    }
+
+    assert(range == ranges+NUM_BLOCKS);
+}
+
+int HeightPyramid::
+getNumLevels() const
+{
+    return numLevels;
+}
+
+void HeightPyramid::
+getRange(int level, int cellX, int cellY, DemHeight::Type range[2]) const
+{
+    assert(level>0 && level<numLevels);
+
+    int numBlocks = NUM_CELLS >> level;
+    const DemHeight::Type* block = ranges[getLevelOffset(level) +
+        (cellY>>level)*numBlocks + (cellX>>level)];
+    range[0] = block[0];
+    range[1] = block[1];
+}
+
+
+int HeightPyramid::
+getLevelOffset(int level)
+{
+    /* the finer levels hold N^2/4 + N^2/16 + ... blocks for N cells a side.
+       The geometric series sums to (N^2 - (N/2^(level-1))^2) / 3 */
+    int coarser = NUM_CELLS >> (level-1);
+    return (NUM_CELLS*NUM_CELLS - coarser*coarser) / 3;
+}
+
+
+} //namespace crusta
@@ -0,0 +1,50 @@
+#ifndef _HeightPyramid_H_
+#define _HeightPyramid_H_
+
+#include <crustacore/basics.h>
+#include <crustacore/DemHeight.h>
+
+
+namespace crusta {
+
+
+struct NodeData;
+
+/** min/max pyramid over the cells of the height tile of a node. Level l covers
+    the cells in blocks of 2^l x 2^l, such that the last level spans the whole
+    tile. The ranges of the individual cells (level 0) aren't stored, as they
+    follow directly from the corners of the cell */
+class HeightPyramid
+{
+public:
+    /** number of cells along the side of a tile */
+    static const int NUM_CELLS  = TILE_RESOLUTION-1;
+    /** number of blocks stored over all the levels */
+    static const int NUM_BLOCKS = (NUM_CELLS*NUM_CELLS - 1) / 3;
+
+    HeightPyramid();
+
+    /** compute the ranges from the height tile of the node */
+    void build(const NodeData& node, const DemHeight::Type* heights);
+
+    /** number of levels, including the cell level */
+    int getNumLevels() const;
+    /** get the range of the block of the given level containing the cell */
+    void getRange(int level, int cellX, int cellY,
+                  DemHeight::Type range[2]) const;
+
+protected:
+    /** index of the first block of a level */
+    static int getLevelOffset(int level);
+
+    /** number of levels, including the cell level */
+    int numLevels;
+    /** the min/max heights of the blocks, from the finest level up */
+    DemHeight::Type ranges[NUM_BLOCKS][2];
+};
+
+
+} //namespace crusta
+
+
+#endif //_HeightPyramid_H_
@@ -0,0 +1,122 @@
+#include <crusta/HorizonOccluder.h>
+
+#include <algorithm>
+
+
+namespace crusta {
+
+
+HorizonOccluder::
+HorizonOccluder() :
+    active(false), radius(0), horizonDistance(0), coneAngle(0),
+    sqrTangentLength(0)
+{
+}
+
+void HorizonOccluder::
+setup(const Geometry::Point<double,3>& iEye, Scalar iRadius)
+{
+    eye = iEye;
+
+    eyeDirection = eye - Geometry::Point<double,3>::origin;
+    Scalar eyeDistance = Geometry::mag(eyeDirection);
+    active = iRadius>Scalar(0) && eyeDistance>iRadius;
+    if (!active)
+        return;
+
+    radius           = iRadius;
+    eyeDirection    /= eyeDistance;
+    horizonDistance  = Math::sqr(radius) / eyeDistance;
+    coneAngle        = Math::asin(radius / eyeDistance);
+    sqrTangentLength = Math::sqr(eyeDistance) - Math::sqr(radius);
+}
+
+void HorizonOccluder::
+disable()
+{
+    active = false;
+}
+
+bool HorizonOccluder::
+isActive() const
+{
+    return active;
+}
+
+bool HorizonOccluder::
+isOccluded(const Geometry::Point<double,3>& center,
+           Scalar sphereRadius) const
+{
+    if (!active)
+        return false;
+
+    /* the sight lines through the sphere must all hit the occluder before
+       reaching the sphere. This holds if the sphere lies within the cone of
+       the sight lines hitting the occluder... */
+    Geometry::Vector<double,3> toCenter = center - eye;
+    Scalar distance = Geometry::mag(toCenter);
+    if (distance <= sphereRadius)
+        return false;
+
+    Scalar cosAngle = -(toCenter*eyeDirection) / distance;
+    cosAngle        = std::min(std::max(cosAngle, Scalar(-1)), Scalar(1));
+    Scalar angle    = Math::acos(cosAngle) +
+                      Math::asin(sphereRadius / distance);
+    if (angle > coneAngle)
+        return false;
+
+    /* ...and behind the plane of the horizon, past which the sight lines of
+       the cone have entered the occluder */
+    Geometry::Vector<double,3> fromOrigin =
+        center - Geometry::Point<double,3>::origin;
+    return fromOrigin*eyeDirection + sphereRadius <= horizonDistance;
+}
+
+bool HorizonOccluder::
+isOccluded(const Scope& scope, Scalar maxRadius) const
+{
+    if (!active)
+        return false;
+    //everything within the occluder is hidden
+    if (maxRadius <= radius)
+        return true;
+
+    //angular extent of the scope around its centroid
+    Scope::Vertex centroid = scope.getCentroid(1.0);
+    Geometry::Vector<double,3> direction(centroid[0], centroid[1],
+                                         centroid[2]);
+    Scalar cosExtent = Scalar(1);
+    for (int i=0; i<4; ++i)
+    {
+        Geometry::Vector<double,3> corner(scope.corners[i][0],
+            scope.corners[i][1], scope.corners[i][2]);
+        cosExtent = std::min(cosExtent,
+                             corner*direction / Geometry::mag(corner));
+    }
+    cosExtent = std::max(cosExtent, Scalar(-1));
+
+    /* the point above the centroid from which the tangents to the occluder
+       pass over the whole scope at the maximum radius. If that point is
+       hidden, so is the scope */
+    Scalar angle = Math::acos(cosExtent) + Math::acos(radius / maxRadius);
+    if (angle >= Math::Constants<Scalar>::pi*Scalar(0.5))
+        return false;
+
+    direction *= radius / Math::cos(angle);
+    return isPointOccluded(Geometry::Point<double,3>::origin + direction);
+}
+
+
+bool HorizonOccluder::
+isPointOccluded(const Geometry::Point<double,3>& point) const
+{
+    /* the point must be behind the plane of the horizon and within the cone
+       of the sight lines hitting the occluder */
+    Geometry::Vector<double,3> toPoint = point - eye;
+    Scalar depth = -(toPoint*(eye - Geometry::Point<double,3>::origin));
+    return depth > sqrTangentLength &&
+           Math::sqr(depth) > sqrTangentLength*Geometry::sqr(toPoint);
+}
+
+
+} //namespace crusta
@@ -0,0 +1,58 @@
+#ifndef _HorizonOccluder_H_
+#define _HorizonOccluder_H_
+
+#include <crustacore/basics.h>
+#include <crustacore/Scope.h>
+
+
+namespace crusta {
+
+/** Conservative occluder for the horizon culling of the terrain: a sphere
+    centered on the globe that is contained in the terrain surface. Anything
+    that lies entirely behind it, as seen from the eye, cannot be visible
+    through an opaque terrain. */
+class HorizonOccluder
+{
+public:
+    HorizonOccluder();
+
+    /** setup the occluder for the given eye position and occluder radius. The
+        occluder is inactive if the eye isn't outside of it */
+    void setup(const Geometry::Point<double,3>& iEye, Scalar iRadius);
+    /** deactivate the occluder */
+    void disable();
+    /** check if the occluder is active */
+    bool isActive() const;
+
+    /** check if the sphere is entirely hidden behind the occluder */
+    bool isOccluded(const Geometry::Point<double,3>& center,
+                    Scalar sphereRadius) const;
+    /** check if the part of the globe covered by the scope is entirely hidden
+        behind the occluder up to the given distance from the center of the
+        globe. Tighter than the bounding sphere test for large scopes */
+    bool isOccluded(const Scope& scope, Scalar maxRadius) const;
+
+protected:
+    /** check if the point is hidden behind the occluder */
+    bool isPointOccluded(const Geometry::Point<double,3>& point) const;
+
+    /** flags whether the occluder is used */
+    bool active;
+    /** radius of the occluder */
+    Scalar radius;
+    /** the eye position */
+    Geometry::Point<double,3> eye;
+    /** direction from the center of the globe to the eye */
+    Geometry::Vector<double,3> eyeDirection;
+    /** distance from the center of the globe to the plane of the horizon */
+    Scalar horizonDistance;
+    /** half-angle of the cone of sight lines hitting the occluder */
+    Scalar coneAngle;
+    /** squared length of the sight lines tangent to the occluder */
+    Scalar sqrTangentLength;
+};
+
+} //namespace crusta
+
+
+#endif //_HorizonOccluder_H_
@@ -0,0 +1,60 @@
+#ifndef _InlineVector_H_
+#define _InlineVector_H_
+
+
+#include <cstddef>
+
+
+namespace crusta {
+
+
+/** sequence of at most CapacityParam elements stored within the object. Offers
+    the subset of the std::vector interface used by the node data bundles, but
+    never allocates. Exceeding the capacity is a programming error */
+template <typename ValueParam, int CapacityParam>
+class InlineVector
+{
+public:
+    typedef ValueParam        value_type;
+    typedef ValueParam*       iterator;
+    typedef const ValueParam* const_iterator;
+    typedef size_t            size_type;
+
+    static const int CAPACITY = CapacityParam;
+
+    InlineVector();
+    InlineVector(const InlineVector& other);
+
+    InlineVector& operator=(const InlineVector& other);
+
+    size_t size() const;
+    bool empty() const;
+    size_t capacity() const;
+
+    void clear();
+    void push_back(const ValueParam& value);
+    void resize(size_t newSize, const ValueParam& value=ValueParam());
+
+    ValueParam& operator[](size_t i);
+    const ValueParam& operator[](size_t i) const;
+
+    iterator begin();
+    const_iterator begin() const;
+    iterator end();
+    const_iterator end() const;
+
+protected:
+    /** number of elements in use */
+    size_t numElements;
+    /** storage for the elements */
+    ValueParam elements[CapacityParam];
+};
+
+
+} //namespace crusta
+
+
+#include <crusta/InlineVector.hpp>
+
+
+#endif //_InlineVector_H_
@@ -0,0 +1,133 @@
+#include <cassert>
+
+
+namespace crusta {
+
+
+template <typename ValueParam, int CapacityParam>
+const int InlineVector<ValueParam, CapacityParam>::CAPACITY;
+
+template <typename ValueParam, int CapacityParam>
+InlineVector<ValueParam, CapacityParam>::
+InlineVector() :
+    numElements(0)
+{
+}
+
+template <typename ValueParam, int CapacityParam>
+InlineVector<ValueParam, CapacityParam>::
+InlineVector(const InlineVector& other) :
+    numElements(other.numElements)
+{
+    //only the elements in use are copied
+    for (size_t i=0; i<numElements; ++i)
+        elements[i] = other.elements[i];
+}
+
+template <typename ValueParam, int CapacityParam>
+InlineVector<ValueParam, CapacityParam>&
+InlineVector<ValueParam, CapacityParam>::
+operator=(const InlineVector& other)
+{
+    numElements = other.numElements;
+    for (size_t i=0; i<numElements; ++i)
+        elements[i] = other.elements[i];
+    return *this;
+}
+
+template <typename ValueParam, int CapacityParam>
+size_t InlineVector<ValueParam, CapacityParam>::
+size() const
+{
+    return numElements;
+}
+
+template <typename ValueParam, int CapacityParam>
+bool InlineVector<ValueParam, CapacityParam>::
+empty() const
+{
+    return numElements == 0;
+}
+
+template <typename ValueParam, int CapacityParam>
+size_t InlineVector<ValueParam, CapacityParam>::
+capacity() const
+{
+    return CapacityParam;
+}
+
+template <typename ValueParam, int CapacityParam>
+void InlineVector<ValueParam, CapacityParam>::
+clear()
+{
+    numElements = 0;
+}
+
+template <typename ValueParam, int CapacityParam>
+void InlineVector<ValueParam, CapacityParam>::
+push_back(const ValueParam& value)
+{
+    assert(numElements < size_t(CapacityParam));
+    elements[numElements++] = value;
+}
+
+template <typename ValueParam, int CapacityParam>
+void InlineVector<ValueParam, CapacityParam>::
+resize(size_t newSize, const ValueParam& value)
+{
+    assert(newSize <= size_t(CapacityParam));
+    for (size_t i=numElements; i<newSize; ++i)
+        elements[i] = value;
+    numElements = newSize;
+}
+
+template <typename ValueParam, int CapacityParam>
+ValueParam& InlineVector<ValueParam, CapacityParam>::
+operator[](size_t i)
+{
+    assert(i < numElements);
+    return elements[i];
+}
+
+template <typename ValueParam, int CapacityParam>
+const ValueParam& InlineVector<ValueParam, CapacityParam>::
+operator[](size_t i) const
+{
+    assert(i < numElements);
+    return elements[i];
+}
+
+template <typename ValueParam, int CapacityParam>
+typename InlineVector<ValueParam, CapacityParam>::iterator
+InlineVector<ValueParam, CapacityParam>::
+begin()
+{
+    return elements;
+}
+
+template <typename ValueParam, int CapacityParam>
+typename InlineVector<ValueParam, CapacityParam>::const_iterator
+InlineVector<ValueParam, CapacityParam>::
+begin() const
+{
+    return elements;
+}
+
+template <typename ValueParam, int CapacityParam>
+typename InlineVector<ValueParam, CapacityParam>::iterator
+InlineVector<ValueParam, CapacityParam>::
+end()
+{
+    return elements + numElements;
+}
+
+template <typename ValueParam, int CapacityParam>
+typename InlineVector<ValueParam, CapacityParam>::const_iterator
+InlineVector<ValueParam, CapacityParam>::
+end() const
+{
+    return elements + numElements;
+}
+
+
+} //namespace crusta
@@ -23,7 +23,8 @@ NodeData::
 NodeData() :
     lineInheritCoverage(false), lineNumSegments(0), lineDataStamp(0),
     index(TreeIndex::invalid),
-    boundingAge(0), boundingCenter(0,0,0), boundingRadius(0)
+    boundingAge(0), boundingCenter(0,0,0), boundingRadius(0),
+    prefetched(false)
 {
     centroid[0] = centroid[1] = centroid[2] = DemHeight::Type(0.0);
     elevationRange[0] =  Math::Constants<DemHeight::Type>::max;
@@ -12,6 +12,7 @@
 #include <crustacore/Scope.h>
 
 #include <crusta/glbasics.h>
+#include <crusta/HeightPyramid.h>
 
 #include <crusta/vrui.h>
 
@@ -85,6 +86,8 @@ Colors           lineData;
     Geometry::Point<float,3> centroid;
     /** the range of the elevation values */
     DemHeight::Type elevationRange[2];
+    /** the ranges of the elevation values over the blocks of cells */
+    HeightPyramid heightPyramid;
 
     /** indices for the DEM tiles in the database */
     Tile demTile;
@@ -92,6 +95,10 @@ Colors           lineData;
     Tiles colorTiles;
     /** indices for the Layer tiles in the databases */
     Tiles layerTiles;
+
+    /** flags data that was loaded by a prefetch request and hasn't been part
+        of a representation yet */
+    bool prefetched;
 };
 
 
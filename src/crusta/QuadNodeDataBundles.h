@@ -2,18 +2,24 @@
 #define _QuadNodeDataBundles_H_
 
 
+#include <crusta/InlineVector.h>
 #include <crusta/QuadCache.h>
 
 
 namespace crusta {
 
 
+/** the per-layer pointers of the node data bundles are stored inline, such
+    that assembling the bundles during the frame traversals doesn't allocate.
+    There can't be more layers than distinct data ids */
+static const int NODE_MAX_DATA_LAYERS = DataIndex::MAX_DATA_IDS;
+
 /** contains all the buffers needed to define a node's main memory
     representation */
 struct NodeMainBuffer
 {
-    typedef std::vector<ColorBuffer*>  ColorBufferPtrs;
-    typedef std::vector<LayerfBuffer*> LayerBufferPtrs;
+    typedef InlineVector<ColorBuffer*, NODE_MAX_DATA_LAYERS> ColorBufferPtrs;
+    typedef InlineVector<LayerfBuffer*, NODE_MAX_DATA_LAYERS> LayerBufferPtrs;
 
     NodeMainBuffer();
 
@@ -28,8 +34,8 @@ typedef std::vector<NodeMainBuffer> NodeMainBuffers;
 /** contains pointers to all the main memory data pertaining to a node */
 struct NodeMainData
 {
-    typedef std::vector<TextureColor::Type*> ColorPtrs;
-    typedef std::vector<LayerDataf::Type*>   LayerPtrs;
+    typedef InlineVector<TextureColor::Type*, NODE_MAX_DATA_LAYERS> ColorPtrs;
+    typedef InlineVector<LayerDataf::Type*, NODE_MAX_DATA_LAYERS> LayerPtrs;
 
     NodeMainData();
 
@@ -45,7 +51,8 @@ typedef std::vector<NodeMainData> NodeMainDatas;
     representation */
 struct NodeGpuBuffer
 {
-    typedef std::vector<SubRegionBuffer*> SubRegionBufferPtrs;
+    typedef InlineVector<SubRegionBuffer*, NODE_MAX_DATA_LAYERS>
+        SubRegionBufferPtrs;
 
     NodeGpuBuffer();
 
@@ -61,7 +68,7 @@ typedef std::vector<NodeGpuBuffer> NodeGpuBuffers;
 /** contains pointers to all the gpu data pertaining to a node */
 struct NodeGpuData
 {
-    typedef std::vector<SubRegion*> SubRegionPtrs;
+    typedef InlineVector<SubRegion*, NODE_MAX_DATA_LAYERS> SubRegionPtrs;
 
     NodeGpuData();
 
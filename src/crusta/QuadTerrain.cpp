@@ -48,6 +48,8 @@ bool QuadTerrain::displayDebuggingGrid            = false;
 ///\todo dependency on VruiGlew must be dynamically allocated after VruiGlew
 QuadTerrain::GlData* QuadTerrain::glData = 0;
 
+Threads::Mutex QuadTerrain::coverageMutex;
+
 
 
 static int
@@ -98,6 +100,61 @@ CRUSTA_DEBUG(90, CRUSTA_DEBUG_OUT <<
 "Scope exit param: " << param << " side: " << side << "\n";)
 }
 
+/** compute the scope of the block of size x size cells starting at the given
+    cell of a leaf */
+static Scope
+computeBlockScope(const NodeMainData& leaf, int x, int y, int size)
+{
+    const Vertex* v = leaf.geometry + y*TILE_RESOLUTION + x;
+    const Vertex* blockCorners[4] = {
+        v, v+size, v+size*TILE_RESOLUTION, v+size*TILE_RESOLUTION+size };
+
+    Scope::Vertex corners[4];
+    for (int i=0; i<4; ++i)
+    {
+        for (int j=0; j<3; ++j)
+        {
+            corners[i][j] = double(blockCorners[i]->position[j]) +
+                            double(leaf.node->centroid[j]);
+        }
+    }
+    return Scope(corners[0], corners[1], corners[2], corners[3]);
+}
+
+/** check whether the ray passes above the heights of the block of the given
+    level containing the cell, from the current parameter until it leaves the
+    block. If so, the exit parameter and side of the block are returned */
+static bool
+skipBlock(const NodeMainData& leaf, const Geometry::Ray<double,3>& ray,
+          double param, int level, int cellX, int cellY, double verticalScale,
+          double& exitParam, int& exitSide)
+{
+    DemHeight::Type range[2];
+    leaf.node->heightPyramid.getRange(level, cellX, cellY, range);
+    double top = std::max(range[0]*verticalScale, range[1]*verticalScale);
+
+    //the ray is below the top of the block at the current parameter
+    Sphere shell(Geometry::Point<double,3>(0), SETTINGS->globeRadius + top);
+    double t0, t1;
+    bool hitsShell = shell.intersectRay(ray, t0, t1) && t1>=param;
+    if (hitsShell && t0<=param)
+        return false;
+
+    //the ray has to leave the block before it dips below its top
+    int size = 1 << level;
+    double blockExit;
+    int    blockSide;
+    computeExit(ray, param, computeBlockScope(leaf, cellX & ~(size-1),
+                                              cellY & ~(size-1), size),
+                blockExit, blockSide);
+    if (hitsShell && t0<=blockExit)
+        return false;
+
+    exitParam = blockExit;
+    exitSide  = blockSide;
+    return true;
+}
+
 QuadTerrain::
 QuadTerrain(uint8_t patch, const Scope& scope, Crusta* iCrusta) :
     CrustaComponent(iCrusta), rootIndex(patch)
@@ -296,12 +353,11 @@ renderLineCoverageMap(GLContextData& contextData, const MainData& nodeData)
 
 
 static GLFrustum<Scalar>
-getFrustumFromVrui(GLContextData& contextData)
+getFrustumFromVrui(GLContextData& contextData, const Vrui::NavTransform& inv)
 {
     const Vrui::DisplayState& displayState = Vrui::getDisplayState(contextData);
     Vrui::ViewSpecification viewSpec =
         displayState.window->calcViewSpec(displayState.eyeIndex);
-    Vrui::NavTransform inv = Vrui::getInverseNavigationTransformation();
 
     GLFrustum<Scalar> frustum;
 
@@ -351,29 +407,62 @@ getFrustumFromVrui(GLContextData& contextData)
 }
 
 
+QuadTerrain::Evaluators::
+Evaluators() :
+    prefetchHits(0)
+{
+}
+
 void QuadTerrain::
-prepareDisplay(GLContextData& contextData, SurfaceApproximation& surface)
+setupEvaluators(GLContextData& contextData, Crusta* crusta,
+                const Vrui::NavTransform& inv, Evaluators& evaluators)
 {
-    //setup the evaluators
-    FrustumVisibility visibility;
-    visibility.frustum = getFrustumFromVrui(contextData);
-    FocusViewEvaluator lod;
-    lod.bias = SETTINGS->lodBias;
-    lod.scale = SETTINGS->lodScale;
-    lod.frustum = visibility.frustum;
-    lod.setFocusFromDisplay();
-
-    /* display could be multi-threaded. Buffer all the node data requests and
-       merge them into the request list en block */
-    DataManager::Requests dataRequests;
+    evaluators.visibility.frustum       = getFrustumFromVrui(contextData, inv);
+    evaluators.visibility.verticalScale = crusta->getVerticalScale();
+    evaluators.visibility.stats         = FrustumVisibility::Stats();
+    evaluators.prefetchHits             = 0;
+    //a transparent terrain shows what is behind the horizon
+    if (crusta->isOpaque())
+    {
+        evaluators.visibility.horizon.setup(
+            evaluators.visibility.frustum.getEye(),
+            crusta->getHorizonOccluderRadius());
+    }
+    else
+        evaluators.visibility.horizon.disable();
 
+    evaluators.lod.bias    = SETTINGS->lodBias;
+    evaluators.lod.scale   = SETTINGS->lodScale;
+    evaluators.lod.frustum = evaluators.visibility.frustum;
+    evaluators.lod.setFocusFromDisplay(inv);
+}
+
+void QuadTerrain::
+prepareDisplay(Evaluators& evaluators, int subtreeLevel,
+               SurfaceApproximation& surface, DataManager::Requests& requests,
+               MainBuffers& subtrees)
+{
     /* traverse the terrain tree, update as necessary and collect the current
        tree front */
     MainBuffer rootBuf = getRootBuffer();
-    prepareDisplay(visibility, lod, rootBuf, surface, dataRequests);
+    prepareDisplay(evaluators, rootBuf, subtreeLevel, surface, requests,
+                   subtrees);
+}
 
-    //merge the data requests
-    DATAMANAGER->request(dataRequests);
+void QuadTerrain::
+prepareSubtree(Evaluators& evaluators, MainBuffer& root,
+               SurfaceApproximation& surface, DataManager::Requests& requests)
+{
+    //the subtree is evaluated entirely
+    MainBuffers subtrees;
+    prepareDisplay(evaluators, root, -1, surface, requests, subtrees);
+}
+
+void QuadTerrain::
+prefetch(Evaluators& evaluators, DataManager::Requests& requests)
+{
+    MainBuffer rootBuf = getRootBuffer();
+    prefetch(evaluators, rootBuf, requests);
 }
 
 void QuadTerrain::initSlicingPlane(GLContextData& contextData, CrustaGlData* crustaGl, const Geometry::Vector<double,3> &center) {
@@ -578,7 +667,7 @@ display(GLContextData& contextData, CrustaGlData* crustaGl,
     glPushMatrix();
 
     //render the terrain nodes in batches
-    DataManager::Batch batch;
+    DataManager::Batch& batch = crustaGl->batch;
     DATAMANAGER->startGpuBatch(surface);
     while (DATAMANAGER->hasBatchToStreamToGpu())
     {
@@ -968,7 +1057,7 @@ CRUSTA_DEBUG(90, CRUSTA_DEBUG_OUT << "------------------------\n";)
 ///\todo check lower boundary?
 
 //- perform leaf intersection?
-    if (!DATAMANAGER->existsChildData(mainData))
+    if (!DATAMANAGER->existsChildData(*mainData.node))
     {
 CRUSTA_DEBUG(90, CRUSTA_DEBUG_OUT <<
 "No children exist, considering leaf.\n";)
@@ -1116,12 +1205,67 @@ CRUSTA_DEBUG(96,
 CrustaVisualizer::addRay(blarg, 1);
 CrustaVisualizer::peek();)
 
+    static const int next[4][3] = { {0,1,2}, {-1,0,3}, {0,-1,0}, {1,0,1} };
+
     double verticalScale = crusta->getVerticalScale();
     int offset = cellY*tileRes + cellX;
     Vertex*          cellV = leafData.geometry + offset;
     DemHeight::Type* cellH = leafData.height   + offset;
+
+    /* the last level of the height pyramid spans the whole leaf, which has
+       already been checked by the node traversal */
+    int maxLevel = leaf.heightPyramid.getNumLevels() - 2;
+    int level    = 0;
     while (true)
     {
+        /* skip the coarsest block around the cell that the ray passes above.
+           The search starts one level above the last skip, such that the
+           steps grow while the ray stays clear of the terrain */
+        for (level=std::min(level+1, maxLevel); level>0; --level)
+        {
+            if (skipBlock(leafData, ray, param, level, cellX, cellY,
+                          verticalScale, param, side))
+            {
+                break;
+            }
+        }
+
+        if (level > 0)
+        {
+            if (param==Math::Constants<double>::max || param>gout)
+                return SurfacePoint();
+
+            //move to the block on the exit side
+            int size   = 1 << level;
+            int blockX = (cellX & ~(size-1)) + next[side][0]*size;
+            int blockY = (cellY & ~(size-1)) + next[side][1]*size;
+            if (blockX<0 || blockX>tileRes-1-size ||
+                blockY<0 || blockY>tileRes-1-size)
+            {
+                return SurfacePoint();
+            }
+
+            //locate the cell containing the entry point
+            for (int l=level; l>0; --l)
+            {
+                int childIndex = computeContainingChild(ray(param),
+                    computeBlockScope(leafData, blockX, blockY, 1<<l));
+                blockX += childIndex&0x1 ? 1<<(l-1) : 0;
+                blockY += childIndex&0x2 ? 1<<(l-1) : 0;
+            }
+
+            cellX  = blockX;
+            cellY  = blockY;
+            offset = cellY*tileRes + cellX;
+            cellV  = leafData.geometry + offset;
+            cellH  = leafData.height   + offset;
+
+            side = next[side][2];
+CRUSTA_DEBUG(90, CRUSTA_DEBUG_OUT <<
+"Skipped to cell: " << cellX << " " << cellY << " level: " << level << "\n";)
+            continue;
+        }
+
         const Vertex::Position* positions[4] = {
             &(cellV->position), &((cellV+1)->position),
             &((cellV+tileRes)->position), &((cellV+tileRes+1)->position) };
@@ -1205,8 +1349,6 @@ CRUSTA_DEBUG(90, CRUSTA_DEBUG_OUT << "No side intersection!\n";)
         if (param > gout)
             return SurfacePoint();
 
-        static const int next[4][3] = { {0,1,2}, {-1,0,3}, {0,-1,0}, {1,0,1} };
-
         cellX += next[side][0];
         cellY += next[side][1];
         if (cellX<0 || cellX>tileRes-2 || cellY<0 || cellY>tileRes-2)
@@ -1397,76 +1539,100 @@ crustaGl->terrainShader.enable();
 }
 
 void QuadTerrain::
-prepareDisplay(FrustumVisibility& visibility, FocusViewEvaluator& lod,
-               MainBuffer& buf, SurfaceApproximation& surface,
-               DataManager::Requests& requests)
+prepareDisplay(Evaluators& evaluators, MainBuffer& buf, int subtreeLevel,
+               SurfaceApproximation& surface, DataManager::Requests& requests,
+               MainBuffers& subtrees)
 {
+    /* only the node is needed for the evaluation, the full node data is only
+       assembled for the nodes making up the approximation */
+    NodeData* node = &buf.node->getData();
+    if (node->index.level() == subtreeLevel)
+    {
+        subtrees.push_back(buf);
+        return;
+    }
+
     MapManager* mapMan = crusta->getMapManager();
 
     //confirm current node as being active
     DATAMANAGER->touch(buf);
 
-    NodeMainData data = DATAMANAGER->getData(buf);
+    //account for prefetched data that ended up being used
+    if (node->prefetched)
+    {
+        ++evaluators.prefetchHits;
+        node->prefetched = false;
+    }
 
 ///\todo generalize this to an API that makes sure the node is ready for eval
     //make sure we have proper bounding spheres
-    if (data.node->boundingAge < crusta->getLastScaleStamp())
+    if (node->boundingAge < crusta->getLastScaleStamp())
     {
-        data.node->computeBoundingSphere(SETTINGS->globeRadius,
+        node->computeBoundingSphere(SETTINGS->globeRadius,
             crusta->getVerticalScale());
     }
 
 //- evaluate
-    float visible = visibility.evaluate(*data.node);
+    float visible = evaluators.visibility.evaluate(*node);
     if (visible)
     {
         //evaluate node for splitting
-        float lodValue = lod.evaluate(*data.node);
+        float lodValue = evaluators.lod.evaluate(*node);
         if (lodValue>1.0)
         {
             //does there exist child data for refinement
-            bool allgood = DATAMANAGER->existsChildData(data);
+            bool allgood = DATAMANAGER->existsChildData(*node);
             //check if all the children are available
             NodeMainBuffer children[4];
             bool validChildren[4] = {false, false, false, false};
             if (allgood)
             {
+                uint8_t missingChildren = 0;
                 for (int i=0; i<4; ++i)
                 {
-                    if (!DATAMANAGER->find(data.node->index.down(i),
+                    if (!DATAMANAGER->find(node->index.down(i),
                                            children[i]))
                     {
-                        //request the data be loaded
-                        requests.push_back(DataManager::Request(
-                            crusta, lodValue, buf, i));
+                        missingChildren |= 1<<i;
                         allgood = false;
                     }
                     else
                         validChildren[i] = true;
                 }
+
+                //request the missing siblings be loaded together
+                if (missingChildren != 0)
+                {
+                    requests.push_back(DataManager::Request(
+                        crusta, lodValue, buf, missingChildren));
+                }
             }
 
 /**\todo horrible Vis2010 HACK: integrate this in the proper way? I.e. don't
 stall here, but defer the update. */
-if (allgood && data.node->lineInheritCoverage)
+if (allgood && node->lineInheritCoverage)
 {
+    Threads::Mutex::Lock lock(coverageMutex);
     for (int i=0; i<4; ++i)
     {
-        NodeMainData child = DATAMANAGER->getData(children[i]);
-CRUSTA_DEBUG(60, std::cerr << "***COVDOWN parent(" << data.node->index <<
-")    " << "n(" << data.node->index << ")\n\n";)
-        mapMan->inheritShapeCoverage(*data.node, *child.node);
-        child.node->lineInheritCoverage = true;
+        NodeData* child = &children[i].node->getData();
+CRUSTA_DEBUG(60, std::cerr << "***COVDOWN parent(" << node->index <<
+")    " << "n(" << node->index << ")\n\n";)
+        mapMan->inheritShapeCoverage(*node, *child);
+        child->lineInheritCoverage = true;
     }
 
-    data.node->lineInheritCoverage = false;
+    node->lineInheritCoverage = false;
 }
 
             //still all good then recurse to the children
             if (allgood)
             {
                 for (int i=0; i<4; ++i)
-                    prepareDisplay(visibility,lod,children[i],surface,requests);
+                {
+                    prepareDisplay(evaluators, children[i], subtreeLevel,
+                                   surface, requests, subtrees);
+                }
             }
             else
             {
@@ -1477,14 +1643,58 @@ CRUSTA_DEBUG(60, std::cerr << "***COVDOWN parent(" << data.node->index <<
                         DATAMANAGER->touch(children[i]);
                 }
                 //add the current node to the current representation
-                surface.add(data, true);
+                surface.add(DATAMANAGER->getData(buf), true);
             }
         }
         else
-            surface.add(data, true);
+            surface.add(DATAMANAGER->getData(buf), true);
     }
     else
-        surface.add(data, false);
+        surface.add(DATAMANAGER->getData(buf), false);
+}
+
+void QuadTerrain::
+prefetch(Evaluators& evaluators, MainBuffer& buf,
+         DataManager::Requests& requests)
+{
+    /* hold on to the nodes of the predicted representation, such that the
+       fetch threads don't recycle them while they are being evaluated. They
+       must not be touched: they aren't part of the current representation */
+    DATAMANAGER->retain(buf);
+
+    NodeData* node = &buf.node->getData();
+
+    if (node->boundingAge < crusta->getLastScaleStamp())
+    {
+        node->computeBoundingSphere(SETTINGS->globeRadius,
+            crusta->getVerticalScale());
+    }
+
+    //only nodes that would be split in the predicted view are of interest
+    if (!evaluators.visibility.evaluate(*node))
+        return;
+    float lodValue = evaluators.lod.evaluate(*node);
+    if (lodValue<=1.0 || !DATAMANAGER->existsChildData(*node))
+        return;
+
+    NodeMainBuffer children[4];
+    uint8_t missingChildren = 0;
+    for (int i=0; i<4; ++i)
+    {
+        if (!DATAMANAGER->find(node->index.down(i), children[i]))
+            missingChildren |= 1<<i;
+    }
+
+    if (missingChildren != 0)
+    {
+        requests.push_back(DataManager::Request(
+            crusta, lodValue, buf, missingChildren, true));
+    }
+    else
+    {
+        for (int i=0; i<4; ++i)
+            prefetch(evaluators, children[i], requests);
+    }
 }
 
 
@@ -1518,7 +1728,7 @@ confirmLineCoverageRemoval(const MainData& nodeData, Shape* shape,
     MainBuffer children[4];
 
     //does there exist child data for refinement
-    bool allgood = DATAMANAGER->existsChildData(nodeData);
+    bool allgood = DATAMANAGER->existsChildData(*nodeData.node);
     //check cached
     if (allgood)
     {
@@ -1588,7 +1798,7 @@ validateLineCoverage(const MainData& nodeData)
     MainBuffer children[4];
 
     //does there exist child data for refinement
-    bool allgood = DATAMANAGER->existsChildData(nodeData);
+    bool allgood = DATAMANAGER->existsChildData(*nodeData.node);
     //check cached
     if (allgood)
     {
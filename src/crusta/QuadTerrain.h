@@ -37,11 +37,24 @@ class QuadTerrain : public CrustaComponent
 {
 public:
     typedef NodeMainBuffer       MainBuffer;
+    typedef NodeMainBuffers      MainBuffers;
     typedef NodeMainData         MainData;
     typedef NodeMainDatas        MainDatas;
     typedef NodeGpuData          GpuData;
     typedef NodeGpuDatas         GpuDatas;
 
+    /** the view-dependent evaluators of a terrain traversal */
+    struct Evaluators
+    {
+        Evaluators();
+
+        FrustumVisibility  visibility;
+        FocusViewEvaluator lod;
+        /** number of prefetched nodes that became part of the approximation.
+            Counted per evaluator, such that the workers don't contend */
+        uint64_t prefetchHits;
+    };
+
     QuadTerrain(uint8_t patch, const Scope& scope, Crusta* iCrusta);
 
     /** query the patch's root node buffer */
@@ -61,11 +74,29 @@ public:
     static void renderLineCoverageMap(GLContextData& contextData,
                                       const MainData& nodeData);
 
+    /** setup the evaluators for the view of the display as seen through the
+        given inverse navigation transformation */
+    static void setupEvaluators(GLContextData& contextData, Crusta* crusta,
+                                const Vrui::NavTransform& inv,
+                                Evaluators& evaluators);
+
     /** prepareDiplay has several functions:
         1. issue requests for loading in new nodes (from splits or merges)
-        2. provide the list of nodes that will be rendered for the frame */
-    void prepareDisplay(GLContextData& contextData,
-                        SurfaceApproximation& surface);
+        2. provide the list of nodes that will be rendered for the frame
+        The traversal doesn't descend into the nodes of the given level. These
+        are collected as the roots of subtrees that are evaluated separately
+        (see prepareSubtree), e.g. in parallel */
+    void prepareDisplay(Evaluators& evaluators, int subtreeLevel,
+                        SurfaceApproximation& surface,
+                        DataManager::Requests& requests,
+                        MainBuffers& subtrees);
+    /** evaluate a subtree collected by prepareDisplay */
+    void prepareSubtree(Evaluators& evaluators, MainBuffer& root,
+                        SurfaceApproximation& surface,
+                        DataManager::Requests& requests);
+    /** traverse the patch as it would be evaluated for a predicted view and
+        populate low-priority data requests for the uncached data */
+    void prefetch(Evaluators& evaluators, DataManager::Requests& requests);
 
     /** draw slicing plane and setup corresponding shader uniforms **/
     static void initSlicingPlane(GLContextData& contextData, CrustaGlData* crustaGl, const Geometry::Vector<double,3> &center);
@@ -139,6 +170,7 @@ protected:
                             Scalar tin, int sin, Scalar& tout, int& sout,
                             const Scalar gout) const;
     /** ray patch traversal function for leaf nodes of the quadtree */
+    ///\todo benchmark rays/s against the cell by cell march on a cached globe
     SurfacePoint intersectLeaf(const MainData& leaf, const Geometry::Ray<double,3>& ray,
                             Scalar param, int side, const Scalar gout) const;
 
@@ -155,14 +187,24 @@ protected:
                          const MainData& mainData, const GpuData& gpuData);
 
     /** traverse the terrain tree, compute the appropriate surface approximation
-        and populate data requests for need uncached data */
-    void prepareDisplay(FrustumVisibility& visibility, FocusViewEvaluator& lod,
-                     MainBuffer& buffer, SurfaceApproximation& surface,
-                     DataManager::Requests& requests);
+        and populate data requests for need uncached data. Nodes of the subtree
+        level are only collected */
+    void prepareDisplay(Evaluators& evaluators, MainBuffer& buffer,
+                        int subtreeLevel, SurfaceApproximation& surface,
+                        DataManager::Requests& requests,
+                        MainBuffers& subtrees);
+    /** traverse the terrain tree as it would be evaluated for a predicted
+        view and populate low-priority data requests for the uncached data */
+    void prefetch(Evaluators& evaluators, MainBuffer& buffer,
+                  DataManager::Requests& requests);
 
     /** index of the root patch for this terrain */
     TreeIndex rootIndex;
 
+    /** serializes the inheritance of the line coverage by the traversals of
+        the different patches */
+    static Threads::Mutex coverageMutex;
+
     /** gl data for general terrain use.
     \todo due to VruiGlew dependency must be dynamically allocated */
     static GlData* glData;
@@ -0,0 +1,82 @@
+#ifndef _RequestQueue_H_
+#define _RequestQueue_H_
+
+
+#include <map>
+
+#include <crustacore/basics.h>
+
+
+namespace crusta {
+
+
+/** pending requests for the children of nodes, ordered by priority. Requests
+    for the children of the same parent are coalesced into a single one. The
+    request type must provide the lod, childMask and prefetch members */
+template <typename RequestParam>
+class RequestQueue
+{
+public:
+    /** identifies a request for coalescing: the raw parent index */
+    typedef uint64_t Key;
+
+    RequestQueue();
+
+    /** check if there are pending requests */
+    bool empty() const;
+    /** number of pending requests */
+    size_t size() const;
+    /** drop all the pending requests */
+    void clear();
+
+    /** merge a new request into the queue. The requests of lowest priority
+        are dropped to keep at most maxSize requests */
+    void push(Key key, RequestParam request, size_t maxSize);
+    /** remove the request of highest priority from the queue */
+    RequestParam pop(Key& key);
+
+protected:
+    /** rank of a pending request. Prefetch requests rank behind all the
+        others. Then |lod| followed by the complemented insertion sequence
+        number, such that among requests of equal |lod| the most recent one
+        ranks first */
+    struct Rank
+    {
+        Rank(bool iPrefetch, float iLod, uint64_t iSequence);
+        bool operator <(const Rank& other) const;
+
+        bool     prefetch;
+        float    lod;
+        uint64_t sequence;
+    };
+
+    /** a pending request along with its coalescing key */
+    struct Pending
+    {
+        Key          key;
+        RequestParam request;
+    };
+    /** pending requests ordered by decreasing priority */
+    typedef std::map<Rank, Pending>                 Queue;
+    /** index into the pending requests for coalescing */
+    typedef std::map<Key, typename Queue::iterator> Lookup;
+
+    /** remove a pending request from the queue and its lookup */
+    void remove(typename Queue::iterator it);
+
+    /** the pending requests */
+    Queue queue;
+    /** the pending requests by key */
+    Lookup lookup;
+    /** sequence number of the next request */
+    uint64_t sequence;
+};
+
+
+} //namespace crusta
+
+
+#include <crusta/RequestQueue.hpp>
+
+
+#endif //_RequestQueue_H_
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cassert>
+
+#include <Math/Math.h>
+
+
+namespace crusta {
+
+
+template <typename RequestParam>
+RequestQueue<RequestParam>::Rank::
+Rank(bool iPrefetch, float iLod, uint64_t iSequence) :
+    prefetch(iPrefetch), lod(iLod), sequence(iSequence)
+{
+}
+
+template <typename RequestParam>
+bool RequestQueue<RequestParam>::Rank::
+operator <(const Rank& other) const
+{
+    if (prefetch != other.prefetch)
+        return !prefetch;
+    if (lod != other.lod)
+        return lod < other.lod;
+    return sequence < other.sequence;
+}
+
+
+template <typename RequestParam>
+RequestQueue<RequestParam>::
+RequestQueue() :
+    sequence(0)
+{
+}
+
+template <typename RequestParam>
+bool RequestQueue<RequestParam>::
+empty() const
+{
+    return queue.empty();
+}
+
+template <typename RequestParam>
+size_t RequestQueue<RequestParam>::
+size() const
+{
+    return queue.size();
+}
+
+template <typename RequestParam>
+void RequestQueue<RequestParam>::
+clear()
+{
+    queue.clear();
+    lookup.clear();
+}
+
+template <typename RequestParam>
+void RequestQueue<RequestParam>::
+push(Key key, RequestParam request, size_t maxSize)
+{
+    /* coalesce with an existing entry for the same parent: merge the requested
+       children and update the LOD as necessary */
+    typename Lookup::iterator dup = lookup.find(key);
+    if (dup != lookup.end())
+    {
+        const RequestParam& existing = dup->second->second.request;
+        request.lod        = std::min(request.lod, existing.lod);
+        request.childMask |= existing.childMask;
+        //data needed by the current view must not be treated as prefetching
+        request.prefetch   = request.prefetch && existing.prefetch;
+        remove(dup->second);
+    }
+
+    //among requests of equal LOD the most recent one is served first
+    Rank rank(request.prefetch, Math::abs(request.lod), ~sequence);
+    ++sequence;
+    Pending pending;
+    pending.key     = key;
+    pending.request = request;
+    typename Queue::iterator it =
+        queue.insert(typename Queue::value_type(rank, pending)).first;
+    lookup.insert(typename Lookup::value_type(key, it));
+
+    //keep the request list manageable by dropping the lowest priorities
+    while (queue.size() > maxSize)
+        remove(--queue.end());
+    assert(queue.size() == lookup.size());
+}
+
+template <typename RequestParam>
+RequestParam RequestQueue<RequestParam>::
+pop(Key& key)
+{
+    assert(!queue.empty());
+    typename Queue::iterator first = queue.begin();
+    RequestParam request = first->second.request;
+    key                  = first->second.key;
+    remove(first);
+    return request;
+}
+
+
+template <typename RequestParam>
+void RequestQueue<RequestParam>::
+remove(typename Queue::iterator it)
+{
+    lookup.erase(it->second.key);
+    queue.erase(it);
+}
+
+
+} //namespace crusta
@@ -20,6 +20,18 @@ add(const NodeMainData& node, bool isVisible)
         visibles.push_back(nodes.size()-1);
 }
 
+void SurfaceApproximation::
+append(const SurfaceApproximation& fragment)
+{
+    int offset = static_cast<int>(nodes.size());
+    nodes.insert(nodes.end(), fragment.nodes.begin(), fragment.nodes.end());
+    for (Indices::const_iterator it=fragment.visibles.begin();
+         it!=fragment.visibles.end(); ++it)
+    {
+        visibles.push_back(offset + *it);
+    }
+}
+
 NodeMainData& SurfaceApproximation::
 visible(size_t index)
 {
@@ -23,6 +23,9 @@ struct SurfaceApproximation
     /** add a node to the representation as contributing to the display or
         not */
     void add(const NodeMainData& node, bool isVisible);
+    /** append the nodes of another (partial) representation, e.g., one
+        generated for a subtree of the globe */
+    void append(const SurfaceApproximation& fragment);
     /** returns the data of the index'th visible node */
     NodeMainData& visible(size_t index);
     const NodeMainData& visible(size_t index) const;
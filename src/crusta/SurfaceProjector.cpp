@@ -19,54 +19,92 @@ SurfaceProjector() :
 SurfacePoint SurfaceProjector::
 project(Vrui::InputDevice* device, bool mapBackToDevice)
 {
-    //transform the physical frame to navigation space
-    Vrui::NavTransform physicalFrame = device->getTransformation();
-    Vrui::NavTransform modelFrame    =
-        Vrui::getInverseNavigationTransformation() * physicalFrame;
+    Devices devices(1, device);
+    SurfacePoints surfacePoints;
+    project(devices, surfacePoints, mapBackToDevice);
+    return surfacePoints.front();
+}
 
-    //align the model frame to the surface
-    SurfacePoint surfacePoint;
+void SurfaceProjector::
+project(const Devices& devices, SurfacePoints& surfacePoints,
+        bool mapBackToDevice)
+{
+    surfacePoints.resize(devices.size());
+
+    //align the model frames to the surface
     if (Vrui::isMaster())
     {
+        const Vrui::NavTransform& invNav =
+            Vrui::getInverseNavigationTransformation();
+
         if (SETTINGS->surfaceProjectorRayIntersect)
         {
-            Vrui::Vector rayDir = device->getRayDirection();
-            rayDir = Vrui::getInverseNavigationTransformation().transform(
-                rayDir);
-            rayDir.normalize();
-
-            Geometry::Ray<double,3> ray(modelFrame.getOrigin(), rayDir);
-            surfacePoint = crusta->intersect(ray);
+            Crusta::Rays rays;
+            rays.reserve(devices.size());
+            for (Devices::const_iterator it=devices.begin();
+                 it!=devices.end(); ++it)
+            {
+                //transform the physical frame to navigation space
+                Vrui::NavTransform modelFrame =
+                    invNav * (*it)->getTransformation();
+
+                Vrui::Vector rayDir = invNav.transform(
+                    (*it)->getRayDirection());
+                rayDir.normalize();
+
+                rays.push_back(Geometry::Ray<double,3>(modelFrame.getOrigin(),
+                                                       rayDir));
+            }
+            crusta->intersect(rays, surfacePoints);
         }
         else
         {
-            //snapping is done radially, no need to map to the unscaled globe
-            surfacePoint = crusta->snapToSurface(modelFrame.getOrigin());
+            for (size_t i=0; i<devices.size(); ++i)
+            {
+                Vrui::NavTransform modelFrame =
+                    invNav * devices[i]->getTransformation();
+                /* snapping is done radially, no need to map to the unscaled
+                   globe */
+                surfacePoints[i] =
+                    crusta->snapToSurface(modelFrame.getOrigin());
+            }
         }
 
         if (Vrui::getMainPipe() != NULL)
-            Vrui::getMainPipe()->write<SurfacePoint>(surfacePoint);
+        {
+            for (SurfacePoints::const_iterator it=surfacePoints.begin();
+                 it!=surfacePoints.end(); ++it)
+            {
+                Vrui::getMainPipe()->write<SurfacePoint>(*it);
+            }
+        }
     }
     else
-        Vrui::getMainPipe()->read<SurfacePoint>(surfacePoint);
-
-    if (!surfacePoint.isValid())
     {
-        projectionFailed = true;
-PROJECTION_FAILED = true;
-        return SurfacePoint();
+        for (SurfacePoints::iterator it=surfacePoints.begin();
+             it!=surfacePoints.end(); ++it)
+        {
+            Vrui::getMainPipe()->read<SurfacePoint>(*it);
+        }
     }
 
-    if (mapBackToDevice)
+    projectionFailed = false;
+    for (SurfacePoints::iterator it=surfacePoints.begin();
+         it!=surfacePoints.end(); ++it)
     {
-        //transform the position back to physical space
-        surfacePoint.position = Vrui::getNavigationTransformation().transform(
-                                surfacePoint.position);
+        if (!it->isValid())
+        {
+            projectionFailed = true;
+            *it = SurfacePoint();
+        }
+        else if (mapBackToDevice)
+        {
+            //transform the position back to physical space
+            it->position = Vrui::getNavigationTransformation().transform(
+                           it->position);
+        }
     }
-
-    projectionFailed = false;
-PROJECTION_FAILED = false;
-    return surfacePoint;
+PROJECTION_FAILED = projectionFailed;
 }
 
 
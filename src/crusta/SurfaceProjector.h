@@ -2,6 +2,8 @@
 #define _Crusta_SurfaceProjector_H_
 
 
+#include <vector>
+
 #include <crusta/CrustaComponent.h>
 #include <crusta/SurfacePoint.h>
 
@@ -14,9 +16,17 @@ namespace crusta {
 class SurfaceProjector : public CrustaComponent
 {
 public:
+    typedef std::vector<Vrui::InputDevice*> Devices;
+    typedef std::vector<SurfacePoint>       SurfacePoints;
+
     SurfaceProjector();
 
     SurfacePoint project(Vrui::InputDevice* device, bool mapBackToDevice=true);
+    /** project several devices at once. Their rays are intersected with the
+        terrain as a batch. The projection is flagged as failed if any of the
+        devices couldn't be projected */
+    void project(const Devices& devices, SurfacePoints& surfacePoints,
+                 bool mapBackToDevice=true);
 
     void display(GLContextData& contextData,
                  const Vrui::NavTransform& original,
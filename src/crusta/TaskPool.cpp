@@ -0,0 +1,137 @@
+#include <crusta/TaskPool.h>
+
+
+namespace crusta {
+
+
+TaskPool::
+TaskPool() :
+    job(NULL), numItems(0), nextItem(0), batch(0), numBusy(0), nextWorker(1),
+    terminate(false)
+{
+}
+
+TaskPool::
+~TaskPool()
+{
+    stop();
+}
+
+void TaskPool::
+start(int numThreads)
+{
+    //the pool might already be running
+    if (!threads.empty())
+        return;
+
+    terminate  = false;
+    batch      = 0;
+    nextWorker = 1;
+    for (int i=0; i<numThreads; ++i)
+    {
+        Threads::Thread* thread = new Threads::Thread;
+        thread->start(this, &TaskPool::workerThreadFunc);
+        threads.push_back(thread);
+    }
+}
+
+void TaskPool::
+stop()
+{
+    if (threads.empty())
+        return;
+
+    {
+        Threads::Mutex::Lock lock(batchMutex);
+        terminate = true;
+    }
+    batchCond.broadcast();
+
+    for (WorkerThreads::iterator it=threads.begin(); it!=threads.end(); ++it)
+    {
+        (*it)->join();
+        delete *it;
+    }
+    threads.clear();
+}
+
+int TaskPool::
+getNumWorkers() const
+{
+    return static_cast<int>(threads.size()) + 1;
+}
+
+void TaskPool::
+run(Job& iJob, size_t iNumItems)
+{
+    Threads::Mutex::Lock runLock(runMutex);
+
+    {
+        Threads::Mutex::Lock lock(batchMutex);
+        job      = &iJob;
+        numItems = iNumItems;
+        nextItem = 0;
+        numBusy  = static_cast<int>(threads.size());
+        ++batch;
+    }
+    batchCond.broadcast();
+
+    processItems(0);
+
+    //wait for the threads to finish their last items
+    Threads::Mutex::Lock lock(batchMutex);
+    while (numBusy > 0)
+        doneCond.wait(batchMutex);
+    job = NULL;
+}
+
+
+void TaskPool::
+processItems(int worker)
+{
+    while (true)
+    {
+        size_t item;
+        {
+            Threads::Mutex::Lock lock(batchMutex);
+            if (nextItem >= numItems)
+                return;
+            item = nextItem++;
+        }
+        job->process(item, worker);
+    }
+}
+
+void* TaskPool::
+workerThreadFunc()
+{
+    int worker;
+    {
+        Threads::Mutex::Lock lock(batchMutex);
+        worker = nextWorker++;
+    }
+
+    /* batches are numbered from 1 on, such that a thread starting late still
+       takes part in a batch that has already been submitted */
+    unsigned int lastBatch = 0;
+    while (true)
+    {
+        {
+            Threads::Mutex::Lock lock(batchMutex);
+            while (!terminate && batch==lastBatch)
+                batchCond.wait(batchMutex);
+            if (terminate)
+                return NULL;
+            lastBatch = batch;
+        }
+
+        processItems(worker);
+
+        Threads::Mutex::Lock lock(batchMutex);
+        if (--numBusy == 0)
+            doneCond.signal();
+    }
+}
+
+
+} //namespace crusta
@@ -0,0 +1,87 @@
+#ifndef _TaskPool_H_
+#define _TaskPool_H_
+
+
+#include <vector>
+
+#include <crustacore/basics.h>
+
+#include <crusta/vrui.h>
+
+
+namespace crusta {
+
+
+/** persistent set of threads processing batches of independent work items.
+    The thread submitting a batch takes part in processing it and only returns
+    once all the items of the batch have been processed */
+class TaskPool
+{
+public:
+    /** the processing of the items of a batch */
+    class Job
+    {
+    public:
+        virtual ~Job() {}
+        /** process an item of the batch. The items are processed concurrently
+            by the workers of the pool, identified by their index. The
+            submitting thread is worker 0 */
+        virtual void process(size_t item, int worker) = 0;
+    };
+
+    TaskPool();
+    ~TaskPool();
+
+    /** start the given number of threads in addition to the submitting one */
+    void start(int numThreads);
+    /** terminate the threads of the pool */
+    void stop();
+
+    /** returns the number of workers processing the batches */
+    int getNumWorkers() const;
+
+    /** process the items of a batch. Concurrent submissions are processed one
+        after the other */
+    void run(Job& job, size_t numItems);
+
+protected:
+    typedef std::vector<Threads::Thread*> WorkerThreads;
+
+    /** process items of the current batch until there are none left */
+    void processItems(int worker);
+    /** thread function of the pool workers */
+    void* workerThreadFunc();
+
+    /** the threads of the pool */
+    WorkerThreads threads;
+
+    /** the job of the current batch */
+    Job* job;
+    /** number of items of the current batch */
+    size_t numItems;
+    /** next item of the current batch to be processed */
+    size_t nextItem;
+    /** sequence number of the current batch */
+    unsigned int batch;
+    /** number of threads still processing the current batch */
+    int numBusy;
+    /** index handed to the next started thread */
+    int nextWorker;
+    /** flags the threads to terminate */
+    bool terminate;
+
+    /** serializes the submission of batches */
+    Threads::Mutex runMutex;
+    /** protects the state of the current batch */
+    Threads::Mutex batchMutex;
+    /** signals the threads that a new batch has been submitted */
+    Threads::Cond batchCond;
+    /** signals the submitter that a thread is done with the batch */
+    Threads::Cond doneCond;
+};
+
+
+} //namespace crusta
+
+
+#endif //_TaskPool_H_
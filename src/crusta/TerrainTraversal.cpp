@@ -0,0 +1,156 @@
+#include <crusta/TerrainTraversal.h>
+
+#include <crusta/Crusta.h>
+
+
+namespace crusta {
+
+
+const int TerrainTraversal::SUBTREE_LEVEL;
+
+TerrainTraversal::
+TerrainTraversal() :
+    stage(STAGE_SUBTREES), numSubtrees(0)
+{
+}
+
+void TerrainTraversal::
+start(int numThreads)
+{
+    pool.start(numThreads);
+}
+
+void TerrainTraversal::
+stop()
+{
+    pool.stop();
+}
+
+void TerrainTraversal::
+prepareDisplay(GLContextData& contextData, Crusta* crusta,
+               const Patches& patches, SurfaceApproximation& surface)
+{
+    Threads::Mutex::Lock lock(traversalMutex);
+
+    /* the evaluators query the GL state and thus have to be setup by the
+       calling thread. Each worker gets its own copy, as they keep counters */
+    QuadTerrain::setupEvaluators(contextData, crusta,
+        Vrui::getInverseNavigationTransformation(), evaluators);
+    workerEvaluators.assign(pool.getNumWorkers(), evaluators);
+
+    /* traverse the coarse levels and collect the roots of the subtrees. Nodes
+       above the subtree level go straight into the approximation */
+    requests.clear();
+    numSubtrees = 0;
+    for (Patches::const_iterator it=patches.begin(); it!=patches.end(); ++it)
+    {
+        roots.clear();
+        (*it)->prepareDisplay(evaluators, SUBTREE_LEVEL, surface, requests,
+                              roots);
+
+        if (subtrees.size() < numSubtrees+roots.size())
+            subtrees.resize(numSubtrees+roots.size());
+        for (QuadTerrain::MainBuffers::iterator rit=roots.begin();
+             rit!=roots.end(); ++rit, ++numSubtrees)
+        {
+            Subtree& subtree = subtrees[numSubtrees];
+            subtree.terrain  = *it;
+            subtree.root     = *rit;
+            subtree.surface.clear();
+            subtree.requests.clear();
+        }
+    }
+
+    //evaluate the subtrees
+    stage = STAGE_SUBTREES;
+    pool.run(*this, numSubtrees);
+
+    //merge the fragments in the order of the subtrees
+    for (size_t i=0; i<numSubtrees; ++i)
+    {
+        surface.append(subtrees[i].surface);
+        requests.insert(requests.end(), subtrees[i].requests.begin(),
+                        subtrees[i].requests.end());
+    }
+
+    //accumulate the visibility and prefetch counters of the frame
+    visibilityStats       = evaluators.visibility.stats;
+    uint64_t prefetchHits = evaluators.prefetchHits;
+    for (EvaluatorsList::const_iterator it=workerEvaluators.begin();
+         it!=workerEvaluators.end(); ++it)
+    {
+        visibilityStats.frustumRejects += it->visibility.stats.frustumRejects;
+        visibilityStats.horizonRejects += it->visibility.stats.horizonRejects;
+        prefetchHits                   += it->prefetchHits;
+    }
+    if (prefetchHits != 0)
+        DATAMANAGER->addPrefetchHits(prefetchHits);
+
+    /* anticipate the data needed for the view the navigation is heading to.
+       This only starts once the regular traversal is complete, as both update
+       the bounding spheres of the nodes. The regular requests are issued
+       first, such that they take precedence when coalescing */
+    Vrui::NavTransform predictedInv;
+    if (crusta->getPredictedInverseNavigation(predictedInv))
+    {
+        QuadTerrain::Evaluators predictedEvaluators;
+        QuadTerrain::setupEvaluators(contextData, crusta, predictedInv,
+                                     predictedEvaluators);
+        workerEvaluators.assign(pool.getNumWorkers(), predictedEvaluators);
+
+        prefetches.resize(patches.size());
+        for (size_t i=0; i<patches.size(); ++i)
+        {
+            prefetches[i].terrain = patches[i];
+            prefetches[i].requests.clear();
+        }
+
+        stage = STAGE_PREFETCH;
+        pool.run(*this, prefetches.size());
+
+        for (Prefetches::const_iterator it=prefetches.begin();
+             it!=prefetches.end(); ++it)
+        {
+            requests.insert(requests.end(), it->requests.begin(),
+                            it->requests.end());
+        }
+    }
+
+    //merge the data requests
+    DATAMANAGER->request(requests);
+}
+
+
+void TerrainTraversal::
+process(size_t item, int worker)
+{
+    //the evaluators of the current stage
+    QuadTerrain::Evaluators& workerEvals = workerEvaluators[worker];
+
+    switch (stage)
+    {
+        case STAGE_SUBTREES:
+        {
+            Subtree& subtree = subtrees[item];
+            subtree.terrain->prepareSubtree(workerEvals, subtree.root,
+                                            subtree.surface, subtree.requests);
+            break;
+        }
+
+        case STAGE_PREFETCH:
+        {
+            Prefetch& prefetch = prefetches[item];
+            prefetch.terrain->prefetch(workerEvals, prefetch.requests);
+            break;
+        }
+    }
+}
+
+const FrustumVisibility::Stats& TerrainTraversal::
+getVisibilityStats() const
+{
+    return visibilityStats;
+}
+
+
+} //namespace crusta
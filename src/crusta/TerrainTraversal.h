@@ -0,0 +1,119 @@
+#ifndef _TerrainTraversal_H_
+#define _TerrainTraversal_H_
+
+
+#include <vector>
+
+#include <crusta/QuadTerrain.h>
+#include <crusta/TaskPool.h>
+
+#include <crusta/vrui.h>
+
+
+class GLContextData;
+
+namespace crusta {
+
+
+class Crusta;
+
+/** generates the surface approximation of the terrain patches for a frame.
+    The coarse levels of the patches are traversed by the calling thread and
+    the subtrees below them are then evaluated in parallel on a pool of
+    threads. The partial approximations of the subtrees are appended in a
+    fixed order, such that the result does not depend on the scheduling */
+class TerrainTraversal : public TaskPool::Job
+{
+public:
+    typedef std::vector<QuadTerrain*> Patches;
+
+    TerrainTraversal();
+
+    /** start the given number of threads helping with the traversals */
+    void start(int numThreads);
+    /** terminate the helping threads */
+    void stop();
+
+    /** generate the terrain representation of the patches for the current
+        view and issue the data requests of the traversal */
+    void prepareDisplay(GLContextData& contextData, Crusta* crusta,
+                        const Patches& patches, SurfaceApproximation& surface);
+
+    /** retrieve the visibility counters of the last traversal for the current
+        view */
+    const FrustumVisibility::Stats& getVisibilityStats() const;
+
+//- inherited from TaskPool::Job
+public:
+    virtual void process(size_t item, int worker);
+
+protected:
+    /** level of the roots of the subtrees evaluated in parallel. Each patch
+        contributes up to 4^SUBTREE_LEVEL subtrees */
+    static const int SUBTREE_LEVEL = 2;
+
+    /** a subtree evaluated by one of the workers */
+    struct Subtree
+    {
+        /** the terrain the subtree belongs to */
+        QuadTerrain* terrain;
+        /** the buffer of the root of the subtree */
+        QuadTerrain::MainBuffer root;
+        /** the approximation generated for the subtree */
+        SurfaceApproximation surface;
+        /** the data requests of the subtree */
+        DataManager::Requests requests;
+    };
+    typedef std::vector<Subtree> Subtrees;
+    typedef std::vector<QuadTerrain::Evaluators> EvaluatorsList;
+
+    /** the prefetch traversal of one of the patches */
+    struct Prefetch
+    {
+        /** the terrain to prefetch for */
+        QuadTerrain* terrain;
+        /** the data requests of the prefetch */
+        DataManager::Requests requests;
+    };
+    typedef std::vector<Prefetch> Prefetches;
+
+    /** what the items of the current batch refer to */
+    enum Stage
+    {
+        STAGE_SUBTREES,
+        STAGE_PREFETCH
+    };
+
+    /** the pool evaluating the subtrees */
+    TaskPool pool;
+
+    /** the stage being processed by the pool */
+    Stage stage;
+    /** evaluators for the current view */
+    QuadTerrain::Evaluators evaluators;
+    /** copies of the evaluators of the current stage for each worker */
+    EvaluatorsList workerEvaluators;
+    /** visibility counters of the last traversal */
+    FrustumVisibility::Stats visibilityStats;
+
+    /** the roots of the subtrees of a patch */
+    QuadTerrain::MainBuffers roots;
+    /** the subtrees of the current frame. Kept across frames to reuse their
+        allocations */
+    Subtrees subtrees;
+    /** number of the subtrees used in the current frame */
+    size_t numSubtrees;
+    /** the prefetch traversals of the current frame */
+    Prefetches prefetches;
+    /** the merged data requests of the current frame */
+    DataManager::Requests requests;
+
+    /** serializes the traversals of different contexts */
+    Threads::Mutex traversalMutex;
+};
+
+
+} //namespace crusta
+
+
+#endif //_TerrainTraversal_H_
@@ -2,6 +2,8 @@
 #define _DemHeightGlobeData_H_
 
 
+#include <cstring>
+
 #include <crustacore/GlobeData.h>
 #include <crustacore/DemHeight.h>
 
@@ -38,6 +40,11 @@ struct GlobeData<DemHeight>
             file->read(range, 2);
         }
 
+        void read(const uint8_t* buffer)
+        {
+            memcpy(range, buffer, 2 * sizeof(PixelType));
+        }
+
         static size_t getSize()
         {
             return 2 * sizeof(PixelType);
@@ -53,6 +60,11 @@ struct GlobeData<DemHeight>
         {
             file->write(range, 2);
         }
+
+        void write(uint8_t* buffer) const
+        {
+            memcpy(buffer, range, 2 * sizeof(PixelType));
+        }
     };
 
     static const std::string typeName()
@@ -30,12 +30,16 @@ struct GlobeData
         void write(Misc::LargeFile* file) const;
     };
 
-    ///generic header for tile scope meta-data. Defaults to an empty header.
+    /** generic header for tile scope meta-data. Defaults to an empty header.
+        Besides the stream access, the header must be able to decode/encode
+        itself from/to getSize() bytes of raw storage for positional I/O */
     struct TileHeader
     {
         void read(Misc::LargeFile* file);
+        void read(const uint8_t* buffer);
         static size_t getSize();
         void write(Misc::LargeFile* file) const;
+        void write(uint8_t* buffer) const;
     };
 
 //- database storage traits
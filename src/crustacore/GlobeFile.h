@@ -21,14 +21,30 @@ public:
     typedef typename gd::File         File;
 
 ///\todo when moving to Vrui 2.0 no need to initialize the cfg pointer anymore
-    GlobeFile(bool writable);
+    /** a read-only globe file can be requested to memory-map its patches.
+        Patches that fail to map fall back to reading from the file */
+    GlobeFile(bool writable, bool mapped=false);
     ~GlobeFile();
 
     /** check that the file is a valid wrt PixelParam */
     static bool isCompatible(const std::string& path);
 
+    /** request compressed tiles for globe files that are created by a
+        subsequent open. Existing files keep the format recorded in their
+        configuration */
+    void setCompressed(bool compress);
+    /** checks if the patches store their tiles compressed */
+    bool isCompressed() const;
+
     void open(const std::string& path);
     void close();
+    /** saves the configuration and forces the patches to disk (see
+        QuadtreeFile::checkpoint) */
+    void checkpoint();
+    /** commit the tiles written to the patches from background writers,
+        sharing the given number of bytes for queued tiles among the patches
+        (see QuadtreeFile::startWriteBehind) */
+    void startWriteBehind(size_t budget);
 
     /** get access to a specific patch of the globe file */
     File* getPatch(uint8_t patch);
@@ -57,6 +73,8 @@ protected:
     void createBaseFolder(std::string path, bool parent=false);
 
     bool writable;
+    bool mapped;
+    bool compressed;
     std::vector<PixelType> blank;
     PatchFiles patches;
 
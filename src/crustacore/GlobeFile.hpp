@@ -16,8 +16,9 @@ namespace crusta {
 
 template <typename PixelParam>
 GlobeFile<PixelParam>::
-GlobeFile(bool writable) :
-	writable(writable), cfg(NULL)
+GlobeFile(bool writable, bool mapped) :
+	writable(writable), mapped(mapped && !writable), compressed(false),
+	cfg(NULL)
 {
 }
 
@@ -44,6 +45,20 @@ isCompatible(const std::string& path)
     return true;
 }
 
+template <typename PixelParam>
+void GlobeFile<PixelParam>::
+setCompressed(bool compress)
+{
+    compressed = compress;
+}
+
+template <typename PixelParam>
+bool GlobeFile<PixelParam>::
+isCompressed() const
+{
+    return compressed;
+}
+
 template <typename PixelParam>
 void GlobeFile<PixelParam>::
 open(const std::string& path)
@@ -73,7 +88,17 @@ open(const std::string& path)
         std::ostringstream oss;
         oss << path << "/patch_" << i << ".qtf";
         uint32_t utileSize[2] = {uint32_t(tileSize[0]), uint32_t(tileSize[1])};
-        patches.push_back(new File(oss.str().c_str(), utileSize, writable));
+        patches.push_back(new File(oss.str().c_str(), utileSize, writable,
+                                   compressed));
+
+        /* compressed files store nodata tiles without any pixel data and thus
+           need to know the nodata value */
+        if (writable && compressed)
+            patches[i]->setDefaultPixelValue(nodata);
+
+        //tiles are fetched in view-dependent order, thus expect random access
+        if (mapped)
+            patches[i]->map(File::MAPPED_ACCESS_RANDOM);
 
         if (writable)
         {
@@ -112,6 +137,35 @@ close()
     blank.clear();
 }
 
+template <typename PixelParam>
+void GlobeFile<PixelParam>::
+checkpoint()
+{
+    if (!writable)
+        return;
+
+    //new globe files keep their configuration open until they are closed
+    if (cfg != NULL)
+        cfg->save();
+
+    typedef typename PatchFiles::iterator PatchFileIterator;
+    for (PatchFileIterator it=patches.begin(); it!=patches.end(); ++it)
+        (*it)->checkpoint();
+}
+
+template <typename PixelParam>
+void GlobeFile<PixelParam>::
+startWriteBehind(size_t budget)
+{
+    if (!writable || patches.empty())
+        return;
+
+    size_t patchBudget = budget / patches.size();
+    typedef typename PatchFiles::iterator PatchFileIterator;
+    for (PatchFileIterator it=patches.begin(); it!=patches.end(); ++it)
+        (*it)->startWriteBehind(patchBudget);
+}
+
 template <typename PixelParam>
 typename GlobeFile<PixelParam>::File* GlobeFile<PixelParam>::
 getPatch(uint8_t patch)
@@ -202,6 +256,9 @@ loadConfiguration(const std::string& cfgName)
             Geometry::Point<int,2> tileSizeInput = cfg->retrieveValue<Geometry::Point<int,2> >("tileSize");
             tileSize[0] = tileSizeInput[0];
             tileSize[1] = tileSizeInput[1];
+
+            //files predating compression don't specify the format
+            compressed = cfg->retrieveValue<bool>("compressed", false);
         }
         catch (std::runtime_error e)
         {
@@ -256,6 +313,7 @@ loadConfiguration(const std::string& cfgName)
         cfg->storeString("nodata", oss.str().c_str());
         cfg->storeString("polyhedronType", polyhedronType.c_str());
         cfg->storeValue<Geometry::Point<int,2> >("tileSize",Geometry::Point<int,2>(tileSize[0], tileSize[1]));
+        cfg->storeValue<bool>("compressed", compressed);
     }
 
     if (!create && cfg)
@@ -26,9 +26,18 @@ Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 #ifndef _QuadTreeFile_H_
 #define _QuadTreeFile_H_
 
+#include <map>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include <crustacore/TileCodec.h>
 #include <crustacore/TileIndex.h>
 #include <crustacore/TreeIndex.h>
 
+#include <crustacore/vrui.h>
+
 
 namespace crusta {
 
@@ -46,6 +55,14 @@ public:
     ///type for extra data in each tile header
     typedef TileHeaderParam TileHeader;
 
+    ///expected access pattern for memory-mapped files (see madvise)
+    enum MappedAccess
+    {
+        MAPPED_ACCESS_NORMAL,
+        MAPPED_ACCESS_SEQUENTIAL,
+        MAPPED_ACCESS_RANDOM
+    };
+
     ///required meta-data for all quadtree files
     class Header
     {
@@ -62,8 +79,12 @@ public:
         TileIndex maxTileIndex;
     };
 
-    ///opens an existing quadtree file for update or creates a new one
-    QuadtreeFile(const char* quadtreeFileName, const uint32_t iTileSize[2], bool writable);
+    /** opens an existing quadtree file for update or creates a new one. The
+        tiles of compressed files only store a reference to their encoded
+        pixels, which are kept in a separate data file (.qtd). Tiles made up
+        entirely of the default pixel value don't use any data storage */
+    QuadtreeFile(const char* quadtreeFileName, const uint32_t iTileSize[2],
+                 bool writable, bool compressed=false);
     ~QuadtreeFile();
 
     ///returns the file's meta data
@@ -77,16 +98,35 @@ public:
     const uint32_t* getTileSize() const;
     ///return the number of tiles stored in the hierarchy
     TileIndex getNumTiles() const;
+    ///checks if the pixels of the tiles are stored compressed
+    bool isCompressed() const;
 
     ///reads the quadtree file header from the file
     void readHeader();
     ///writes the quadtree file header to the file again
     void writeHeader();
+    /** writes the header and forces all the data written so far to disk, such
+        that the file is consistent if the process dies afterwards */
+    void checkpoint();
+
+    /** starts writing the tiles from a background thread. Written tiles are
+        queued, up to the given number of bytes, and committed in file order
+        with contiguous tiles gathered into single transfers. Writers block
+        while the queue is full. Reads see the queued tiles */
+    void startWriteBehind(size_t budget);
+    /** commits all the queued tiles and stops the background writer. Errors
+        of the background writes are reported here or by the next write */
+    void stopWriteBehind();
+    ///commits all the queued tiles before returning
+    void flush();
 
     ///appends a new tile to the file (only reserves the space for it)
     TileIndex appendTile(const Pixel* const blank=NULL);
 
-    ///reads the tile of given index into the given buffer
+    /** reads the tile of given index into the given buffer. Tiles are read
+        with a single positional transfer that does not alter any shared file
+        state, such that reads may be issued from multiple threads
+        concurrently */
     bool readTile(TileIndex tileIndex, TileIndex childPointers[4],
                   TileHeader& tileHeader, Pixel* tileBuffer=NULL);
     bool readTile(TileIndex tileIndex, Pixel* tileBuffer);
@@ -95,6 +135,14 @@ public:
     bool readTile(TileIndex tileIndex, TileHeader& tileHeader,
                   Pixel* tileBuffer=NULL);
 
+    /** reads a group of tiles, e.g. siblings. The child pointers are returned
+        four per tile. Entries with an invalid tile index are skipped. Tiles
+        with consecutive indices are gathered with a single transfer. Returns
+        false if any of the tiles doesn't exist */
+    bool readTiles(int numTiles, const TileIndex* tileIndices,
+                   TileIndex* childPointers, TileHeader* tileHeaders,
+                   Pixel* const* tileBuffers);
+
     ///writes the tile in the given buffer to the given index
     void writeTile(TileIndex tileIndex, const TileIndex childPointers[4],
                    const TileHeader& tileHeader, const Pixel* tileBuffer=NULL);
@@ -104,7 +152,97 @@ public:
     void writeTile(TileIndex tileIndex, const TileHeader& tileHeader,
                    const Pixel* tileBuffer=NULL);
 
+    /** maps the tiles of a read-only file into memory. Tile reads are then
+        served from the mapping. Returns false if the mapping failed or the
+        file is compressed, in which case the file keeps using positional
+        reads */
+    bool map(MappedAccess access=MAPPED_ACCESS_RANDOM);
+    ///checks if the tiles of the file are memory-mapped
+    bool isMapped() const;
+    /** returns a zero-copy pointer to the raw storage of a mapped tile: the
+        child pointers, followed by the tile header and the pixels. Returns NULL
+        if the file isn't mapped or the tile doesn't exist */
+    const uint8_t* getMappedTile(TileIndex tileIndex) const;
+    /** returns a zero-copy pointer to the pixels of a mapped tile. Returns NULL
+        if the tile is not available or the pixels aren't suitably aligned */
+    const Pixel* getMappedPixels(TileIndex tileIndex) const;
+    /** hints that the tile of given index will be accessed soon such that its
+        pages can be prefaulted. Ignored for non-mapped files */
+    void willNeedTile(TileIndex tileIndex) const;
+
 protected:
+    ///upper bound on the size of the tile header (see TileHeader::getSize())
+    static const size_t MAX_TILEHEADER_SIZE = 64;
+    ///maximum number of tiles gathered by a single transfer of readTiles()
+    static const int MAX_TILES_PER_TRANSFER = 4;
+    ///maximum number of tiles committed by a single background transfer
+    static const int MAX_TILES_PER_WRITE = 256;
+
+    ///the components of a tile stored in the file
+    enum TilePart
+    {
+        PART_CHILDREN = 0x1,
+        PART_HEADER   = 0x2,
+        PART_PIXELS   = 0x4,
+        PART_ALL      = 0x7
+    };
+
+    /** a tile queued for the background writer. The components that have
+        been written are kept in their file encoding, except for the pixels of
+        compressed files that are only encoded when committed */
+    struct PendingTile
+    {
+        PendingTile();
+
+        ///the components that have been written (see TilePart)
+        int parts;
+        ///the tile as stored in the file
+        std::vector<uint8_t> raw;
+        ///the pixels of compressed files
+        std::vector<Pixel> pixels;
+    };
+    typedef std::map<TileIndex, PendingTile> PendingTiles;
+
+    /** transfer the given scatter/gather list from/to the file descriptor at
+        the specified offset. Partial transfers are resumed. */
+    void transferTile(int fd, bool write, struct iovec* iov, int iovCount,
+                      off_t offset) const;
+    ///reads and decodes the pixels referenced by a compressed tile
+    void readPixels(uint64_t dataOffset, uint32_t dataSize,
+                    Pixel* tileBuffer) const;
+    /** encodes and appends the pixels of a compressed tile to the data file.
+        Returns the reference to the stored data */
+    void storePixels(const Pixel* tileBuffer, uint64_t& dataOffset,
+                     uint32_t& dataSize);
+    ///returns the offset of a tile in the file
+    off_t getTileOffset(TileIndex tileIndex) const;
+    /** reads a range of the tile file. The part of the range beyond the end
+        of the file is zero-filled */
+    void readRange(off_t offset, size_t size, uint8_t* buffer) const;
+
+    ///writes the components of a tile to the file (see writeTile())
+    void writeStoredTile(TileIndex tileIndex, const TileIndex childPointers[4],
+                         const TileHeader& tileHeader,
+                         const Pixel* tileBuffer);
+    ///returns the number of bytes held by a queued tile
+    size_t getPendingTileSize() const;
+    ///queues the components of a tile for the background writer
+    void queueTile(TileIndex tileIndex, const TileIndex childPointers[4],
+                   const TileHeader& tileHeader, const Pixel* tileBuffer);
+    /** collects the queued components of a tile. Returns the components that
+        were found (see TilePart) */
+    int findPendingTile(TileIndex tileIndex, PendingTile& tile);
+    ///copies components of a tile from its pending state
+    void readPendingTile(const PendingTile& tile, int parts,
+                         TileIndex childPointers[4], TileHeader& tileHeader,
+                         Pixel* tileBuffer) const;
+    ///background writer: commits the queued tiles as they fill up the budget
+    void* writerThreadFunc();
+    ///commits a set of pending tiles in runs of contiguous tiles
+    void writePendingTiles(PendingTiles& tiles);
+    ///raises any error of the background writer (writeMutex must be held)
+    void checkWriteError();
+
 ///returns the last ignored tile child pointers
 const TileIndex* getLastChildPointers() const;
 ///returns one of the last ignored tile child pointers
@@ -112,10 +250,52 @@ TileIndex getLastChildPointer(int childIndex) const;
 ///returns the last ignored tile header
 const TileHeader& getLastTileHeader() const;
 
+    ///name of the quadtree file
+    std::string quadtreeFileName;
     ///handle of the quadtree file for local quadtree files
     Misc::LargeFile* quadtreeFile;
+    /** descriptor on the quadtree file used for the positional transfers of the
+        tiles. The stream handle above is only used for the file header */
+    int tileFile;
+    ///read-only mapping of the entire file (NULL if not mapped)
+    uint8_t* mappedFile;
+    ///size of the mapping
+    size_t mappedSize;
     ///is the file writable?
     bool writable;
+    ///are the pixels of the tiles compressed?
+    bool compressed;
+    ///descriptor of the encoded pixel data of compressed files
+    int dataFile;
+    ///end of the encoded pixel data, where new encodings are appended
+    off_t dataEnd;
+    ///serializes the allocation of storage for encoded pixels
+    Threads::Mutex dataMutex;
+
+    ///the background writer (NULL if tiles are written immediately)
+    Threads::Thread* writerThread;
+    ///maximum number of bytes held by the queued tiles
+    size_t writeBudget;
+    ///number of bytes held by the queued tiles (including the ones in flight)
+    size_t pendingBytes;
+    ///tiles queued since the background writer took the last batch
+    PendingTiles pendingTiles;
+    ///the batch of tiles currently being committed
+    PendingTiles writingTiles;
+    ///buffer for the parts of a batch that need to be read from the file
+    std::vector<uint8_t> fillBuffer;
+    ///flags the background writer to commit all the queued tiles
+    bool flushRequested;
+    ///flags the background writer to terminate once the queue is empty
+    bool terminateWriter;
+    ///message of the first failed background write
+    std::string writeError;
+    ///protects the state of the background writer
+    Threads::Mutex writeMutex;
+    ///wakes the background writer
+    Threads::Cond writeCond;
+    ///signals that a batch of tiles has been committed
+    Threads::Cond drainCond;
     ///Header containing the basic meta-data
     Header header;
     ///custom header meta data for the file scope
@@ -22,7 +22,15 @@ Free Software Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
 02111-1307 USA
 ***********************************************************************/
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
 #include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
 namespace crusta {
@@ -56,15 +64,28 @@ write(Misc::LargeFile* quadtreeFile)
     quadtreeFile->write(maxTileIndex);
 }
 
+template <class PixelType, class FileHeaderParam, class TileHeaderParam>
+QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::PendingTile::
+PendingTile() :
+    parts(0)
+{
+}
+
 /*****************************
 Methods of class QuadtreeFile:
 *****************************/
 
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
 QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
-QuadtreeFile(const char* quadtreeFileName, const uint32_t iTileSize[2], bool writable) :
-    quadtreeFile(NULL), writable(writable)
+QuadtreeFile(const char* quadtreeFileName, const uint32_t iTileSize[2],
+             bool writable, bool compressed) :
+    quadtreeFile(NULL), tileFile(-1), mappedFile(NULL), mappedSize(0),
+    writable(writable), compressed(compressed), dataFile(-1), dataEnd(0),
+    writerThread(NULL), writeBudget(0), pendingBytes(0),
+    flushRequested(false), terminateWriter(false)
 {
+    this->quadtreeFileName = quadtreeFileName;
+
     //open existing quadtree file or create a new one
     try
     {
@@ -108,12 +129,84 @@ QuadtreeFile(const char* quadtreeFileName, const uint32_t iTileSize[2], bool wri
         }
     }
 
-    //compute the file tile size
+    /* compute the file tile size. Compressed tiles store a reference to the
+       encoded pixels (offset and size) instead of the pixels */
     tileNumPixels = header.tileSize[0] * header.tileSize[1];
-    fileTileSize  = Misc::LargeFile::Offset(sizeof(Pixel)) *
-                    Misc::LargeFile::Offset(tileNumPixels);
+    if (compressed)
+    {
+        fileTileSize = Misc::LargeFile::Offset(sizeof(uint64_t) +
+                                               sizeof(uint32_t));
+    }
+    else
+    {
+        fileTileSize = Misc::LargeFile::Offset(sizeof(Pixel)) *
+                       Misc::LargeFile::Offset(tileNumPixels);
+    }
     fileTileSize += Misc::LargeFile::Offset(4*sizeof(TileIndex));
     fileTileSize += Misc::LargeFile::Offset(TileHeader::getSize());
+
+    if (TileHeader::getSize() > MAX_TILEHEADER_SIZE)
+    {
+        Misc::throwStdErr("QuadtreeFile: tile header of %d bytes exceeds the "
+                          "supported maximum of %d bytes",
+                          int(TileHeader::getSize()), int(MAX_TILEHEADER_SIZE));
+    }
+
+    //open the descriptor for the positional tile transfers
+    tileFile = ::open(quadtreeFileName, writable ? O_RDWR : O_RDONLY);
+    if (tileFile < 0)
+    {
+        Misc::throwStdErr("QuadtreeFile: unable to open %s for tile access "
+                          "(%s)", quadtreeFileName, strerror(errno));
+    }
+
+    /* the header is only written on checkpoints and on close while tiles are
+       written as they come. Tiles appended after the last header update of a
+       file that wasn't closed properly are recovered from the file size,
+       such that their indices can't be handed out again. appendTile extends
+       the file as it hands out an index, thus this also covers appended tiles
+       that never made it out of the write queue while a parent pointing to
+       them did. Those read back as leaves with zeroed content */
+    if (writable)
+    {
+        struct stat tileStat;
+        if (fstat(tileFile, &tileStat) == 0 &&
+            tileStat.st_size > off_t(firstTileOffset))
+        {
+            TileIndex numStored = TileIndex(
+                (tileStat.st_size - off_t(firstTileOffset)) / fileTileSize);
+            if (numStored > getNumTiles())
+                header.maxTileIndex = numStored - 1;
+        }
+    }
+
+    if (compressed)
+    {
+        //the encoded pixels are kept next to the tree: patch_0.qtf -> .qtd
+        std::string dataFileName(quadtreeFileName);
+        size_t dotPos = dataFileName.rfind('.');
+        if (dotPos!=std::string::npos && dataFileName.substr(dotPos)==".qtf")
+            dataFileName.resize(dotPos);
+        dataFileName.append(".qtd");
+
+        dataFile = ::open(dataFileName.c_str(),
+                          writable ? O_RDWR|O_CREAT : O_RDONLY, 0666);
+        if (dataFile < 0)
+        {
+            Misc::throwStdErr("QuadtreeFile: unable to open the tile data "
+                              "file %s (%s)", dataFileName.c_str(),
+                              strerror(errno));
+        }
+
+        struct stat dataStat;
+        if (fstat(dataFile, &dataStat) != 0)
+        {
+            Misc::throwStdErr("QuadtreeFile: unable to query the tile data "
+                              "file %s (%s)", dataFileName.c_str(),
+                              strerror(errno));
+        }
+        dataEnd = dataStat.st_size;
+    }
 }
 
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
@@ -122,12 +215,28 @@ QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
 {
     if (writable)
     {
+        //commit the queued tiles, there is no one left to report errors to
+        try
+        {
+            stopWriteBehind();
+        }
+        catch (std::runtime_error e)
+        {
+            std::cerr << e.what() << std::endl;
+        }
+
         //make sure the latest header has been written to disk
         writeHeader();
     }
 
     //close the quadtree file
     delete quadtreeFile;
+    if (mappedFile != NULL)
+        munmap(mappedFile, mappedSize);
+    if (tileFile >= 0)
+        ::close(tileFile);
+    if (dataFile >= 0)
+        ::close(dataFile);
 }
 
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
@@ -172,6 +281,13 @@ getNumTiles() const
     return header.maxTileIndex==INVALID_TILEINDEX ? 0 : header.maxTileIndex+1;
 }
 
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+bool QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+isCompressed() const
+{
+    return compressed;
+}
+
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
 void
 QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
@@ -199,6 +315,103 @@ writeHeader()
     fileHeader.write(quadtreeFile);
 }
 
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void
+QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+checkpoint()
+{
+    if (!writable)
+        Misc::throwStdErr("QuadtreeFile: Attempted write operation on non-writable instance.");
+
+    flush();
+
+    /* the referenced pixels have to be on disk before the tiles and header
+       that make them reachable */
+    if (dataFile>=0 && fsync(dataFile)!=0)
+    {
+        Misc::throwStdErr("QuadtreeFile: unable to sync the data of %s to "
+                          "disk (%s)", quadtreeFileName.c_str(),
+                          strerror(errno));
+    }
+
+    /* the header is updated in place through the positional descriptor, as
+       the buffered header stream would only hand it to the system when it is
+       repositioned or closed. Only the common header changes as tiles are
+       added, the custom header is written on close */
+    struct iovec iov[3];
+    iov[0].iov_base = header.tileSize;
+    iov[0].iov_len  = sizeof(header.tileSize);
+    iov[1].iov_base = &header.defaultPixelValue;
+    iov[1].iov_len  = sizeof(header.defaultPixelValue);
+    iov[2].iov_base = &header.maxTileIndex;
+    iov[2].iov_len  = sizeof(header.maxTileIndex);
+    transferTile(tileFile, true, iov, 3, 0);
+
+    if (fsync(tileFile) != 0)
+    {
+        Misc::throwStdErr("QuadtreeFile: unable to sync %s to disk (%s)",
+                          quadtreeFileName.c_str(), strerror(errno));
+    }
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+startWriteBehind(size_t budget)
+{
+    if (!writable)
+        Misc::throwStdErr("QuadtreeFile: Attempted write operation on non-writable instance.");
+    if (writerThread != NULL)
+        return;
+
+    /* the writer must be woken up before a full queue blocks the writes,
+       i.e., at least two tiles must fit */
+    writeBudget     = std::max(budget, 2*getPendingTileSize());
+    pendingBytes    = 0;
+    flushRequested  = false;
+    terminateWriter = false;
+    writeError.clear();
+
+    writerThread = new Threads::Thread;
+    writerThread->start(this, &QuadtreeFile::writerThreadFunc);
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+stopWriteBehind()
+{
+    if (writerThread == NULL)
+        return;
+
+    {
+        Threads::Mutex::Lock lock(writeMutex);
+        terminateWriter = true;
+    }
+    writeCond.signal();
+
+    writerThread->join();
+    delete writerThread;
+    writerThread = NULL;
+
+    Threads::Mutex::Lock lock(writeMutex);
+    checkWriteError();
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+flush()
+{
+    if (writerThread == NULL)
+        return;
+
+    Threads::Mutex::Lock lock(writeMutex);
+    flushRequested = true;
+    writeCond.signal();
+    while (!pendingTiles.empty() || !writingTiles.empty())
+        drainCond.wait(writeMutex);
+    flushRequested = false;
+    checkWriteError();
+}
+
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
 TileIndex QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
 appendTile(const Pixel* const blank)
@@ -212,7 +425,31 @@ appendTile(const Pixel* const blank)
     };
 
     ++header.maxTileIndex;
-    writeTile(header.maxTileIndex, invalidChildren, TileHeader(), blank);
+
+    /* the queued tiles are written in index order, such that the parent
+       pointing to the new tile may reach the file before the tile itself.
+       Extend the file right away for its size to account for the new index,
+       and terminate the tree at the new tile in the meantime */
+    off_t offset = getTileOffset(header.maxTileIndex);
+    if (ftruncate(tileFile, offset + off_t(fileTileSize)) != 0)
+    {
+        Misc::throwStdErr("QuadtreeFile: unable to extend %s (%s)",
+                          quadtreeFileName.c_str(), strerror(errno));
+    }
+    struct iovec iov;
+    iov.iov_base = const_cast<TileIndex*>(invalidChildren);
+    iov.iov_len  = sizeof(invalidChildren);
+    transferTile(tileFile, true, &iov, 1, offset);
+
+    if (compressed && blank==NULL)
+    {
+        //compressed tiles always need a valid reference to their pixels
+        std::vector<Pixel> defaultTile(tileNumPixels, header.defaultPixelValue);
+        writeTile(header.maxTileIndex, invalidChildren, TileHeader(),
+                  &defaultTile.front());
+    }
+    else
+        writeTile(header.maxTileIndex, invalidChildren, TileHeader(), blank);
 
     return header.maxTileIndex;
 }
@@ -231,19 +468,72 @@ readTile(TileIndex tileIndex, TileIndex childPointers[4],
         return false;
     }
 
-    /* Set the file pointer to the beginning of the tile: */
-    Misc::LargeFile::Offset offset = Misc::LargeFile::Offset(tileIndex);
-    offset *= fileTileSize;
-    offset += firstTileOffset;
-    quadtreeFile->seekSet(offset);
+    /* queued components supersede the stored ones. The file is only read if
+       some of the requested ones aren't queued (e.g., for freshly appended
+       tiles that might not exist in the file yet) */
+    PendingTile pending;
+    int pendingParts = 0;
+    if (writerThread != NULL)
+        pendingParts = findPendingTile(tileIndex, pending);
+    int requested = PART_CHILDREN | PART_HEADER |
+                    (tileBuffer!=NULL ? PART_PIXELS : 0);
+    if ((pendingParts & requested) == requested)
+    {
+        readPendingTile(pending, pendingParts, childPointers, tileHeader,
+                        tileBuffer);
+        return true;
+    }
+
+    //serve the tile from the mapping if possible
+    const uint8_t* mapped = getMappedTile(tileIndex);
+    if (mapped != NULL)
+    {
+        memcpy(childPointers, mapped, 4*sizeof(TileIndex));
+        mapped += 4*sizeof(TileIndex);
+        tileHeader.read(mapped);
+        mapped += TileHeader::getSize();
+        if (tileBuffer != NULL)
+            memcpy(tileBuffer, mapped, tileNumPixels*sizeof(Pixel));
+        return true;
+    }
+
+    /* gather the child pointers, the tile's header data and the pixels (or the
+       reference to them for compressed files) in a single transfer */
+    uint8_t headerBuf[MAX_TILEHEADER_SIZE];
+    uint64_t dataOffset = 0;
+    uint32_t dataSize   = 0;
+    struct iovec iov[4];
+    iov[0].iov_base = childPointers;
+    iov[0].iov_len  = 4*sizeof(TileIndex);
+    iov[1].iov_base = headerBuf;
+    iov[1].iov_len  = TileHeader::getSize();
+    int iovCount    = 2;
+    if(tileBuffer!=NULL && compressed)
+    {
+        iov[2].iov_base = &dataOffset;
+        iov[2].iov_len  = sizeof(uint64_t);
+        iov[3].iov_base = &dataSize;
+        iov[3].iov_len  = sizeof(uint32_t);
+        iovCount += 2;
+    }
+    else if(tileBuffer != NULL)
+    {
+        iov[2].iov_base = tileBuffer;
+        iov[2].iov_len  = tileNumPixels*sizeof(Pixel);
+        ++iovCount;
+    }
+    transferTile(tileFile, false, iov, iovCount, getTileOffset(tileIndex));
+
+    tileHeader.read(headerBuf);
 
-    //read the child pointers
-    quadtreeFile->read(childPointers, 4);
-    //read the tile's header data
-    tileHeader.read(quadtreeFile);
+    if(tileBuffer!=NULL && compressed)
+        readPixels(dataOffset, dataSize, tileBuffer);
 
-    if(tileBuffer != NULL)
-        quadtreeFile->read(tileBuffer, tileNumPixels);
+    if (pendingParts != 0)
+    {
+        readPendingTile(pending, pendingParts, childPointers, tileHeader,
+                        tileBuffer);
+    }
 
     return true;
 }
@@ -253,7 +543,10 @@ bool
 QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
 readTile(TileIndex tileIndex, Pixel* tileBuffer)
 {
-    return readTile(tileIndex,lastTileChildPointers,lastTileHeader,tileBuffer);
+    //ignored components are read into locals to keep concurrent reads safe
+    TileIndex childPointers[4];
+    TileHeader tileHeader;
+    return readTile(tileIndex,childPointers,tileHeader,tileBuffer);
 }
 
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
@@ -261,7 +554,8 @@ bool
 QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
 readTile(TileIndex tileIndex,TileIndex childPointers[4],Pixel* tileBuffer)
 {
-    return readTile(tileIndex,childPointers,lastTileHeader,tileBuffer);
+    TileHeader tileHeader;
+    return readTile(tileIndex,childPointers,tileHeader,tileBuffer);
 }
 
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
@@ -269,7 +563,112 @@ bool
 QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
 readTile(TileIndex tileIndex,TileHeader& tileHeader,Pixel* tileBuffer)
 {
-    return readTile(tileIndex,lastTileChildPointers,tileHeader,tileBuffer);
+    TileIndex childPointers[4];
+    return readTile(tileIndex,childPointers,tileHeader,tileBuffer);
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+bool
+QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+readTiles(int numTiles, const TileIndex* tileIndices, TileIndex* childPointers,
+          typename QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+          TileHeader* tileHeaders,
+          typename QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+          Pixel* const* tileBuffers)
+{
+    if (quadtreeFile == NULL)
+        return false;
+    for (int i=0; i<numTiles; ++i)
+    {
+        if (tileIndices[i]!=INVALID_TILEINDEX &&
+            tileIndices[i]>header.maxTileIndex)
+        {
+            return false;
+        }
+    }
+
+    /* mapped tiles are simply copied, there is nothing to coalesce. Queued
+       tiles need to be merged tile by tile */
+    if (mappedFile!=NULL || writerThread!=NULL)
+    {
+        for (int i=0; i<numTiles; ++i)
+        {
+            if (tileIndices[i] != INVALID_TILEINDEX)
+            {
+                readTile(tileIndices[i], &childPointers[4*i], tileHeaders[i],
+                         tileBuffers[i]);
+            }
+        }
+        return true;
+    }
+
+    uint8_t headerBufs[MAX_TILES_PER_TRANSFER][MAX_TILEHEADER_SIZE];
+    uint64_t dataOffsets[MAX_TILES_PER_TRANSFER];
+    uint32_t dataSizes[MAX_TILES_PER_TRANSFER];
+    struct iovec iov[4*MAX_TILES_PER_TRANSFER];
+
+    int runStart = 0;
+    while (runStart < numTiles)
+    {
+        if (tileIndices[runStart] == INVALID_TILEINDEX)
+        {
+            ++runStart;
+            continue;
+        }
+
+        /* extend the run over the tiles that directly follow in the file. A
+           tile without pixel buffer ends the run, since its pixels would have
+           to be transferred to be able to continue */
+        int runEnd = runStart + 1;
+        while (runEnd<numTiles && runEnd-runStart<MAX_TILES_PER_TRANSFER &&
+               tileBuffers[runEnd-1]!=NULL &&
+               tileIndices[runEnd]!=INVALID_TILEINDEX &&
+               tileIndices[runEnd]==tileIndices[runEnd-1]+1)
+        {
+            ++runEnd;
+        }
+
+        int iovCount = 0;
+        for (int i=runStart; i<runEnd; ++i)
+        {
+            int r = i - runStart;
+            iov[iovCount].iov_base = &childPointers[4*i];
+            iov[iovCount].iov_len  = 4*sizeof(TileIndex);
+            ++iovCount;
+            iov[iovCount].iov_base = headerBufs[r];
+            iov[iovCount].iov_len  = TileHeader::getSize();
+            ++iovCount;
+            if (tileBuffers[i]!=NULL && compressed)
+            {
+                iov[iovCount].iov_base = &dataOffsets[r];
+                iov[iovCount].iov_len  = sizeof(uint64_t);
+                ++iovCount;
+                iov[iovCount].iov_base = &dataSizes[r];
+                iov[iovCount].iov_len  = sizeof(uint32_t);
+                ++iovCount;
+            }
+            else if (tileBuffers[i] != NULL)
+            {
+                iov[iovCount].iov_base = tileBuffers[i];
+                iov[iovCount].iov_len  = tileNumPixels*sizeof(Pixel);
+                ++iovCount;
+            }
+        }
+        transferTile(tileFile, false, iov, iovCount,
+                     getTileOffset(tileIndices[runStart]));
+
+        for (int i=runStart; i<runEnd; ++i)
+        {
+            int r = i - runStart;
+            tileHeaders[i].read(headerBufs[r]);
+            if (tileBuffers[i]!=NULL && compressed)
+                readPixels(dataOffsets[r], dataSizes[r], tileBuffers[i]);
+        }
+
+        runStart = runEnd;
+    }
+
+    return true;
 }
 
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
@@ -287,29 +686,73 @@ writeTile(TileIndex tileIndex, const TileIndex childPointers[4],
     if (tileIndex>header.maxTileIndex || quadtreeFile==NULL)
         return;
 
-    /* Set the file pointer to the beginning of the tile: */
-    Misc::LargeFile::Offset offset = Misc::LargeFile::Offset(tileIndex);
-    offset *= fileTileSize;
-    offset += firstTileOffset;
-    quadtreeFile->seekSet(offset);
-
-    /* Write the child pointers: */
-    if (childPointers != lastTileChildPointers)
-        quadtreeFile->write(childPointers, 4);
+    if (writerThread != NULL)
+        queueTile(tileIndex, childPointers, tileHeader, tileBuffer);
     else
-        quadtreeFile->seekCurrent(Misc::LargeFile::Offset(4*sizeof(TileIndex)));
-    /* Write the tile's header: */
-    if (&tileHeader != &lastTileHeader)
-        tileHeader.write(quadtreeFile);
+        writeStoredTile(tileIndex, childPointers, tileHeader, tileBuffer);
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void
+QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+writeStoredTile(TileIndex tileIndex, const TileIndex childPointers[4],
+                const TileHeader& tileHeader, const Pixel* tileBuffer)
+{
+    /* components passed as the "ignored" ones are skipped. The remaining ones
+       are written in contiguous runs */
+    uint8_t headerBuf[MAX_TILEHEADER_SIZE];
+    uint64_t dataOffset = 0;
+    uint32_t dataSize   = 0;
+    struct iovec parts[4];
+    bool skip[4];
+    parts[0].iov_base = const_cast<TileIndex*>(childPointers);
+    parts[0].iov_len  = 4*sizeof(TileIndex);
+    skip[0]           = childPointers == lastTileChildPointers;
+    parts[1].iov_base = headerBuf;
+    parts[1].iov_len  = TileHeader::getSize();
+    skip[1]           = &tileHeader == &lastTileHeader;
+    int numParts      = 3;
+    if (compressed)
+    {
+        //the pixels are replaced by the reference to their encoding
+        parts[2].iov_base = &dataOffset;
+        parts[2].iov_len  = sizeof(uint64_t);
+        skip[2]           = tileBuffer == NULL;
+        parts[3].iov_base = &dataSize;
+        parts[3].iov_len  = sizeof(uint32_t);
+        skip[3]           = tileBuffer == NULL;
+        numParts          = 4;
+        if (tileBuffer != NULL)
+            storePixels(tileBuffer, dataOffset, dataSize);
+    }
     else
     {
-        quadtreeFile->seekCurrent(
-            Misc::LargeFile::Offset(TileHeader::getSize()));
+        parts[2].iov_base = const_cast<Pixel*>(tileBuffer);
+        parts[2].iov_len  = tileNumPixels*sizeof(Pixel);
+        skip[2]           = tileBuffer == NULL;
     }
+    if (!skip[1])
+        tileHeader.write(headerBuf);
 
-    /* Write the tile's image data: */
-    if (tileBuffer != NULL)
-        quadtreeFile->write(tileBuffer, tileNumPixels);
+    off_t runOffset  = getTileOffset(tileIndex);
+    off_t partOffset = runOffset;
+    int runStart = 0;
+    for (int i=0; i<=numParts; ++i)
+    {
+        if (i==numParts || skip[i])
+        {
+            if (i > runStart)
+            {
+                transferTile(tileFile, true, &parts[runStart], i-runStart,
+                             runOffset);
+            }
+            if (i == numParts)
+                break;
+            runStart  = i+1;
+            runOffset = partOffset + off_t(parts[i].iov_len);
+        }
+        partOffset += off_t(parts[i].iov_len);
+    }
 }
 
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
@@ -344,6 +787,498 @@ writeTile(TileIndex tileIndex, const TileHeader& tileHeader,
     writeTile(tileIndex,lastTileChildPointers,tileHeader,tileBuffer);
 }
 
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+size_t QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+getPendingTileSize() const
+{
+    size_t size = size_t(fileTileSize);
+    if (compressed)
+        size += tileNumPixels*sizeof(Pixel);
+    return size;
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+queueTile(TileIndex tileIndex, const TileIndex childPointers[4],
+          const TileHeader& tileHeader, const Pixel* tileBuffer)
+{
+    const size_t tileBytes = getPendingTileSize();
+
+    Threads::Mutex::Lock lock(writeMutex);
+    checkWriteError();
+
+    //apply backpressure until the background writer has caught up
+    typename PendingTiles::iterator it = pendingTiles.find(tileIndex);
+    if (it == pendingTiles.end())
+    {
+        while (pendingBytes+tileBytes > writeBudget)
+        {
+            writeCond.signal();
+            drainCond.wait(writeMutex);
+            checkWriteError();
+        }
+        it = pendingTiles.insert(typename PendingTiles::value_type(
+            tileIndex, PendingTile())).first;
+        it->second.raw.resize(fileTileSize);
+        if (compressed)
+            it->second.pixels.resize(tileNumPixels);
+        pendingBytes += tileBytes;
+    }
+
+    //merge the components into the ones queued earlier
+    PendingTile& tile = it->second;
+    uint8_t* raw = &tile.raw.front();
+    if (childPointers != lastTileChildPointers)
+    {
+        memcpy(raw, childPointers, 4*sizeof(TileIndex));
+        tile.parts |= PART_CHILDREN;
+    }
+    raw += 4*sizeof(TileIndex);
+    if (&tileHeader != &lastTileHeader)
+    {
+        tileHeader.write(raw);
+        tile.parts |= PART_HEADER;
+    }
+    raw += TileHeader::getSize();
+    if (tileBuffer != NULL)
+    {
+        if (compressed)
+            std::copy(tileBuffer, tileBuffer+tileNumPixels,
+                      tile.pixels.begin());
+        else
+            memcpy(raw, tileBuffer, tileNumPixels*sizeof(Pixel));
+        tile.parts |= PART_PIXELS;
+    }
+
+    //hand larger batches to the writer such that they can be coalesced
+    if (pendingBytes >= writeBudget/2)
+        writeCond.signal();
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+int QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+findPendingTile(TileIndex tileIndex, PendingTile& tile)
+{
+    /* the batch in flight is older than the queued tiles. Only the valid
+       components are copied as the writer fills in the others */
+    const size_t pixelOffset = 4*sizeof(TileIndex) + TileHeader::getSize();
+    Threads::Mutex::Lock lock(writeMutex);
+    PendingTiles* sets[2] = { &writingTiles, &pendingTiles };
+    for (int i=0; i<2; ++i)
+    {
+        typename PendingTiles::const_iterator it = sets[i]->find(tileIndex);
+        if (it == sets[i]->end())
+            continue;
+
+        const PendingTile& src = it->second;
+        if (tile.raw.empty())
+            tile.raw.resize(fileTileSize);
+        if (src.parts & PART_CHILDREN)
+            memcpy(&tile.raw[0], &src.raw[0], 4*sizeof(TileIndex));
+        if (src.parts & PART_HEADER)
+        {
+            memcpy(&tile.raw[4*sizeof(TileIndex)],
+                   &src.raw[4*sizeof(TileIndex)], TileHeader::getSize());
+        }
+        if ((src.parts & PART_PIXELS) && compressed)
+            tile.pixels = src.pixels;
+        else if (src.parts & PART_PIXELS)
+        {
+            memcpy(&tile.raw[pixelOffset], &src.raw[pixelOffset],
+                   tileNumPixels*sizeof(Pixel));
+        }
+        tile.parts |= src.parts;
+    }
+    return tile.parts;
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+readPendingTile(const PendingTile& tile, int parts, TileIndex childPointers[4],
+                TileHeader& tileHeader, Pixel* tileBuffer) const
+{
+    const uint8_t* raw = &tile.raw.front();
+    if (parts & PART_CHILDREN)
+        memcpy(childPointers, raw, 4*sizeof(TileIndex));
+    raw += 4*sizeof(TileIndex);
+    if (parts & PART_HEADER)
+        tileHeader.read(raw);
+    raw += TileHeader::getSize();
+    if ((parts & PART_PIXELS) && tileBuffer!=NULL)
+    {
+        if (compressed)
+            std::copy(tile.pixels.begin(), tile.pixels.end(), tileBuffer);
+        else
+            memcpy(tileBuffer, raw, tileNumPixels*sizeof(Pixel));
+    }
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void* QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+writerThreadFunc()
+{
+    writeMutex.lock();
+    while (true)
+    {
+        if (pendingTiles.empty() && terminateWriter)
+            break;
+
+        //wait for a batch worth coalescing unless the queue is to be drained
+        bool drain = flushRequested || terminateWriter;
+        if (pendingTiles.empty() || (!drain && pendingBytes<writeBudget/2))
+        {
+            writeCond.wait(writeMutex);
+            continue;
+        }
+
+        //take the whole queue, new tiles are queued while the batch is written
+        writingTiles.swap(pendingTiles);
+        writeMutex.unlock();
+
+        std::string error;
+        try
+        {
+            writePendingTiles(writingTiles);
+        }
+        catch (std::runtime_error e)
+        {
+            error = e.what();
+        }
+
+        writeMutex.lock();
+        if (writeError.empty())
+            writeError = error;
+        //the tiles are only dropped once they have reached the file
+        pendingBytes -= writingTiles.size() * getPendingTileSize();
+        writingTiles.clear();
+        drainCond.broadcast();
+    }
+    writeMutex.unlock();
+
+    return NULL;
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+writePendingTiles(PendingTiles& tiles)
+{
+    const size_t tileSize    = size_t(fileTileSize);
+    const size_t pixelOffset = 4*sizeof(TileIndex) + TileHeader::getSize();
+    struct iovec iov[MAX_TILES_PER_WRITE];
+
+    //the tiles are ordered by index, i.e., by their offset in the file
+    typename PendingTiles::iterator runStart = tiles.begin();
+    while (runStart != tiles.end())
+    {
+        typename PendingTiles::iterator runEnd = runStart;
+        int  runLength = 0;
+        bool complete  = true;
+        do
+        {
+            complete &= runEnd->second.parts == PART_ALL;
+            ++runEnd;
+            ++runLength;
+        } while (runEnd!=tiles.end() && runLength<MAX_TILES_PER_WRITE &&
+                 runEnd->first==runStart->first+TileIndex(runLength));
+
+        //components not written are completed from the file
+        off_t runOffset = getTileOffset(runStart->first);
+        bool  needFill  = !complete;
+        if (needFill)
+        {
+            fillBuffer.resize(runLength*tileSize);
+            readRange(runOffset, fillBuffer.size(), &fillBuffer.front());
+        }
+
+        int i = 0;
+        for (typename PendingTiles::iterator it=runStart; it!=runEnd;
+             ++it, ++i)
+        {
+            PendingTile& tile = it->second;
+            uint8_t* raw      = &tile.raw.front();
+            const uint8_t* stored = needFill ? &fillBuffer[i*tileSize] : NULL;
+            if (!(tile.parts & PART_CHILDREN))
+                memcpy(raw, stored, 4*sizeof(TileIndex));
+            if (!(tile.parts & PART_HEADER))
+            {
+                memcpy(raw + 4*sizeof(TileIndex),
+                       stored + 4*sizeof(TileIndex), TileHeader::getSize());
+            }
+            if ((tile.parts & PART_PIXELS) && compressed)
+            {
+                uint64_t dataOffset;
+                uint32_t dataSize;
+                storePixels(&tile.pixels.front(), dataOffset, dataSize);
+                memcpy(raw+pixelOffset, &dataOffset, sizeof(uint64_t));
+                memcpy(raw+pixelOffset+sizeof(uint64_t), &dataSize,
+                       sizeof(uint32_t));
+            }
+            else if (!(tile.parts & PART_PIXELS))
+            {
+                memcpy(raw+pixelOffset, stored+pixelOffset,
+                       tileSize-pixelOffset);
+            }
+
+            iov[i].iov_base = raw;
+            iov[i].iov_len  = tileSize;
+        }
+        transferTile(tileFile, true, iov, runLength, runOffset);
+
+        runStart = runEnd;
+    }
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+checkWriteError()
+{
+    if (!writeError.empty())
+    {
+        std::string error;
+        error.swap(writeError);
+        Misc::throwStdErr("QuadtreeFile: background write to %s failed (%s)",
+                          quadtreeFileName.c_str(), error.c_str());
+    }
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+bool QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+map(MappedAccess access)
+{
+    if (writable)
+    {
+        Misc::throwStdErr("QuadtreeFile::map: only read-only instances can "
+                          "be mapped");
+    }
+    if (mappedFile != NULL)
+        return true;
+    //compressed tiles need to be decoded on read
+    if (compressed)
+        return false;
+
+    struct stat fileStat;
+    if (fstat(tileFile, &fileStat)!=0 || fileStat.st_size==0)
+        return false;
+
+    mappedSize = size_t(fileStat.st_size);
+    void* addr = mmap(NULL, mappedSize, PROT_READ, MAP_SHARED, tileFile, 0);
+    if (addr == MAP_FAILED)
+    {
+        mappedSize = 0;
+        return false;
+    }
+    mappedFile = static_cast<uint8_t*>(addr);
+
+    static const int advice[3] = {MADV_NORMAL,MADV_SEQUENTIAL,MADV_RANDOM};
+    madvise(mappedFile, mappedSize, advice[access]);
+    return true;
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+bool QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+isMapped() const
+{
+    return mappedFile != NULL;
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+const uint8_t* QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+getMappedTile(TileIndex tileIndex) const
+{
+    if (mappedFile==NULL || tileIndex>header.maxTileIndex)
+        return NULL;
+
+    off_t offset = getTileOffset(tileIndex);
+    if (size_t(offset + fileTileSize) > mappedSize)
+        return NULL;
+
+    return mappedFile + offset;
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+const typename QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::Pixel*
+QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+getMappedPixels(TileIndex tileIndex) const
+{
+    const uint8_t* tile = getMappedTile(tileIndex);
+    if (tile == NULL)
+        return NULL;
+
+    /* the pixels follow the file and tile headers and thus might not satisfy
+       the alignment of the pixel type */
+    const uint8_t* pixels = tile + 4*sizeof(TileIndex) + TileHeader::getSize();
+    if (reinterpret_cast<size_t>(pixels) % __alignof__(Pixel) != 0)
+        return NULL;
+
+    return reinterpret_cast<const Pixel*>(pixels);
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+willNeedTile(TileIndex tileIndex) const
+{
+    const uint8_t* tile = getMappedTile(tileIndex);
+    if (tile == NULL)
+        return;
+
+    //madvise requires a page aligned start address
+    static const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    size_t start = reinterpret_cast<size_t>(tile) & ~(pageSize-1);
+    size_t end   = reinterpret_cast<size_t>(tile) + size_t(fileTileSize);
+    madvise(reinterpret_cast<void*>(start), end-start, MADV_WILLNEED);
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+off_t QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+getTileOffset(TileIndex tileIndex) const
+{
+    Misc::LargeFile::Offset offset = Misc::LargeFile::Offset(tileIndex);
+    offset *= fileTileSize;
+    offset += firstTileOffset;
+    return off_t(offset);
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+transferTile(int fd, bool write, struct iovec* iov, int iovCount,
+             off_t offset) const
+{
+    while (iovCount > 0)
+    {
+        //skip over the completed (or empty) parts of the transfer
+        if (iov->iov_len == 0)
+        {
+            ++iov;
+            --iovCount;
+            continue;
+        }
+
+#ifdef __APPLE__
+        ssize_t res = write ? pwrite(fd, iov->iov_base, iov->iov_len, offset) :
+                              pread(fd, iov->iov_base, iov->iov_len, offset);
+#else
+        ssize_t res = write ? pwritev(fd, iov, iovCount, offset) :
+                              preadv(fd, iov, iovCount, offset);
+#endif //__APPLE__
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res <= 0)
+        {
+            Misc::throwStdErr("QuadtreeFile::transferTile: failed to %s tile "
+                              "data at offset %lld (%s)",
+                              write ? "write" : "read", (long long)offset,
+                              res<0 ? strerror(errno) : "unexpected end of file");
+        }
+
+        //advance through the parts that have been transferred
+        offset += res;
+        while (res > 0)
+        {
+            if (size_t(res) >= iov->iov_len)
+            {
+                res -= iov->iov_len;
+                ++iov;
+                --iovCount;
+            }
+            else
+            {
+                iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + res;
+                iov->iov_len -= res;
+                res           = 0;
+            }
+        }
+    }
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+readRange(off_t offset, size_t size, uint8_t* buffer) const
+{
+    while (size > 0)
+    {
+        ssize_t res = pread(tileFile, buffer, size, offset);
+        if (res < 0 && errno == EINTR)
+            continue;
+        if (res < 0)
+        {
+            Misc::throwStdErr("QuadtreeFile::readRange: failed to read tile "
+                              "data at offset %lld (%s)", (long long)offset,
+                              strerror(errno));
+        }
+        //tiles that haven't reached the file yet read as zero
+        if (res == 0)
+        {
+            memset(buffer, 0, size);
+            return;
+        }
+        buffer += res;
+        size   -= size_t(res);
+        offset += res;
+    }
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+readPixels(uint64_t dataOffset, uint32_t dataSize, Pixel* tileBuffer) const
+{
+    //tiles without storage are filled entirely with the default value
+    if (dataSize == 0)
+    {
+        std::fill(tileBuffer, tileBuffer+tileNumPixels,
+                  header.defaultPixelValue);
+        return;
+    }
+
+    TileCodecBase::Bytes encoded(dataSize);
+    struct iovec iov;
+    iov.iov_base = &encoded[0];
+    iov.iov_len  = dataSize;
+    transferTile(dataFile, false, &iov, 1, off_t(dataOffset));
+
+    TileCodecBase::decode(&encoded[0], dataSize, header.tileSize[0],
+                          header.tileSize[1], sizeof(Pixel), tileBuffer);
+}
+
+template <class PixelType,class FileHeaderParam,class TileHeaderParam>
+void QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
+storePixels(const Pixel* tileBuffer, uint64_t& dataOffset, uint32_t& dataSize)
+{
+    //tiles entirely made up of the default value don't need any storage
+    const Pixel& blank = header.defaultPixelValue;
+    const Pixel* p     = tileBuffer;
+    for (; p<tileBuffer+tileNumPixels; ++p)
+    {
+        if (memcmp(p, &blank, sizeof(Pixel)) != 0)
+            break;
+    }
+    if (p == tileBuffer+tileNumPixels)
+    {
+        dataOffset = 0;
+        dataSize   = 0;
+        return;
+    }
+
+    TileCodecBase::Bytes encoded;
+    TileCodec<Pixel>::encode(tileBuffer, header.tileSize[0],
+                             header.tileSize[1], encoded);
+    dataSize = uint32_t(encoded.size());
+
+    /* the encoding is always appended, even if it would fit the current
+       storage of the tile: until the new reference reaches the tile file, the
+       current one must keep pointing to intact data. Repacking reclaims the
+       space of the replaced encodings */
+    {
+        Threads::Mutex::Lock lock(dataMutex);
+        dataOffset = uint64_t(dataEnd);
+        dataEnd   += off_t(dataSize);
+    }
+
+    struct iovec data;
+    data.iov_base = &encoded[0];
+    data.iov_len  = dataSize;
+    transferTile(dataFile, true, &data, 1, off_t(dataOffset));
+}
+
 template <class PixelType,class FileHeaderParam,class TileHeaderParam>
 const TileIndex* QuadtreeFile<PixelType,FileHeaderParam,TileHeaderParam>::
 getLastChildPointers() const
@@ -31,8 +31,10 @@ struct GlobeData<TextureColor>
     struct TileHeader
     {
         void read(Misc::LargeFile*)        {}
+        void read(const uint8_t*)          {}
         static size_t getSize()            {return 0;}
         void write(Misc::LargeFile*) const {}
+        void write(uint8_t*) const         {}
     };
 
     static const std::string typeName()
@@ -0,0 +1,497 @@
+#include <crustacore/TileCodec.h>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace crusta {
+
+
+typedef TileCodecBase::Bytes Bytes;
+
+
+//- LZ block compression -------------------------------------------------------
+
+/* The block format follows the one of LZ4: every sequence starts with a token
+   holding the number of literals in the high and the match length in the low
+   nibble. Lengths of 15 and more are continued in extra bytes. The literals
+   follow, and then the 16 bit match offset and the extra match length bytes.
+   The last sequence only carries literals. */
+
+static const size_t LZ_MIN_MATCH  = 4;
+static const int    LZ_HASH_BITS  = 12;
+static const size_t LZ_MAX_OFFSET = 65535;
+
+static inline uint32_t
+lzRead32(const uint8_t* p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(uint32_t));
+    return v;
+}
+
+static inline uint32_t
+lzHash(uint32_t sequence)
+{
+    return (sequence * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static void
+lzWriteLength(size_t length, Bytes& out)
+{
+    for (; length>=255; length-=255)
+        out.push_back(255);
+    out.push_back(uint8_t(length));
+}
+
+static void
+lzEmit(const uint8_t* literals, size_t numLiterals, size_t matchLength,
+       size_t offset, Bytes& out)
+{
+    size_t tokenPos = out.size();
+    uint8_t token   = uint8_t(std::min(numLiterals, size_t(15)) << 4);
+    out.push_back(0);
+    if (numLiterals >= 15)
+        lzWriteLength(numLiterals-15, out);
+    out.insert(out.end(), literals, literals+numLiterals);
+
+    if (matchLength != 0)
+    {
+        out.push_back(uint8_t(offset & 0xFF));
+        out.push_back(uint8_t(offset >> 8));
+        size_t length = matchLength - LZ_MIN_MATCH;
+        token |= uint8_t(std::min(length, size_t(15)));
+        if (length >= 15)
+            lzWriteLength(length-15, out);
+    }
+    out[tokenPos] = token;
+}
+
+static void
+lzCompress(const uint8_t* in, size_t size, Bytes& out)
+{
+    //positions of the last occurrence of hashed 4 byte sequences
+    int table[1<<LZ_HASH_BITS];
+    for (int i=0; i<(1<<LZ_HASH_BITS); ++i)
+        table[i] = -1;
+
+    size_t anchor = 0;
+    size_t ip     = 0;
+    while (ip+LZ_MIN_MATCH <= size)
+    {
+        uint32_t sequence = lzRead32(in+ip);
+        uint32_t hash     = lzHash(sequence);
+        int candidate     = table[hash];
+        table[hash]       = int(ip);
+
+        if (candidate>=0 && ip-candidate<=LZ_MAX_OFFSET &&
+            lzRead32(in+candidate)==sequence)
+        {
+            size_t length = LZ_MIN_MATCH;
+            while (ip+length<size && in[candidate+length]==in[ip+length])
+                ++length;
+            lzEmit(in+anchor, ip-anchor, length, ip-candidate, out);
+            ip    += length;
+            anchor = ip;
+        }
+        else
+            ++ip;
+    }
+    //flush the remaining literals
+    lzEmit(in+anchor, size-anchor, 0, 0, out);
+}
+
+static size_t
+lzReadLength(const uint8_t*& ip, const uint8_t* end)
+{
+    size_t length = 0;
+    uint8_t extra;
+    do
+    {
+        if (ip >= end)
+            Misc::throwStdErr("TileCodec: truncated LZ length");
+        extra   = *ip++;
+        length += extra;
+    } while (extra == 255);
+    return length;
+}
+
+static void
+lzDecompress(const uint8_t* ip, size_t size, uint8_t* out, size_t outSize)
+{
+    const uint8_t* end = ip + size;
+    size_t op = 0;
+    while (op < outSize)
+    {
+        if (ip >= end)
+            Misc::throwStdErr("TileCodec: truncated LZ sequence");
+        uint8_t token = *ip++;
+
+        //copy the literals
+        size_t numLiterals = token >> 4;
+        if (numLiterals == 15)
+            numLiterals += lzReadLength(ip, end);
+        if (numLiterals>size_t(end-ip) || numLiterals>outSize-op)
+            Misc::throwStdErr("TileCodec: LZ literals out of bounds");
+        memcpy(out+op, ip, numLiterals);
+        ip += numLiterals;
+        op += numLiterals;
+        if (op == outSize)
+            break;
+
+        //copy the match
+        if (end-ip < 2)
+            Misc::throwStdErr("TileCodec: truncated LZ match offset");
+        size_t offset = size_t(ip[0]) | (size_t(ip[1])<<8);
+        ip += 2;
+        size_t length = token & 0x0F;
+        if (length == 15)
+            length += lzReadLength(ip, end);
+        length += LZ_MIN_MATCH;
+        if (offset==0 || offset>op || length>outSize-op)
+            Misc::throwStdErr("TileCodec: LZ match out of bounds");
+        //the match may overlap the output being produced: copy byte by byte
+        const uint8_t* match = out + op - offset;
+        for (size_t i=0; i<length; ++i)
+            out[op+i] = match[i];
+        op += length;
+    }
+}
+
+
+//- Rice coded residuals -------------------------------------------------------
+
+/* Residuals are mapped to unsigned values and written as a unary quotient
+   followed by the k low bits. Quotients of RICE_ESCAPE or more are escaped and
+   the residual is written verbatim. */
+
+static const int RICE_ESCAPE = 24;
+
+class BitWriter
+{
+public:
+    BitWriter(Bytes& iOut) :
+        out(iOut), acc(0), numBits(0)
+    {}
+
+    void write(uint32_t value, int count)
+    {
+        acc      = (acc << count) | (uint64_t(value) & ((uint64_t(1)<<count)-1));
+        numBits += count;
+        while (numBits >= 8)
+        {
+            numBits -= 8;
+            out.push_back(uint8_t(acc >> numBits));
+        }
+    }
+
+    void writeOnes(int count)
+    {
+        for (; count>0; count-=16)
+        {
+            int n = std::min(count, 16);
+            write((1U<<n) - 1, n);
+        }
+    }
+
+    void flush()
+    {
+        if (numBits > 0)
+            out.push_back(uint8_t(acc << (8-numBits)));
+        numBits = 0;
+    }
+
+private:
+    Bytes&   out;
+    uint64_t acc;
+    int      numBits;
+};
+
+class BitReader
+{
+public:
+    BitReader(const uint8_t* data, size_t size) :
+        pos(data), end(data+size), acc(0), numBits(0)
+    {}
+
+    uint32_t read(int count)
+    {
+        while (numBits < count)
+        {
+            if (pos == end)
+                Misc::throwStdErr("TileCodec: truncated residual stream");
+            acc      = (acc << 8) | *pos++;
+            numBits += 8;
+        }
+        numBits -= count;
+        return uint32_t((acc >> numBits) & ((uint64_t(1)<<count)-1));
+    }
+
+    int readUnary(int limit)
+    {
+        int q = 0;
+        while (q<limit && read(1)==1)
+            ++q;
+        return q;
+    }
+
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+    uint64_t       acc;
+    int            numBits;
+};
+
+static inline uint32_t
+zigzag(uint32_t d)
+{
+    return (d << 1) ^ (0U - (d >> 31));
+}
+
+static inline uint32_t
+unzigzag(uint32_t z)
+{
+    return (z >> 1) ^ (0U - (z & 1));
+}
+
+static inline int
+riceCost(uint32_t z, int k)
+{
+    uint32_t q = z >> k;
+    return q<uint32_t(RICE_ESCAPE) ? int(q)+1+k : RICE_ESCAPE+32;
+}
+
+static void
+riceWrite(BitWriter& bits, uint32_t z, int k)
+{
+    uint32_t q = z >> k;
+    if (q < uint32_t(RICE_ESCAPE))
+    {
+        bits.writeOnes(int(q));
+        bits.write(0, 1);
+        bits.write(z, k);
+    }
+    else
+    {
+        bits.writeOnes(RICE_ESCAPE);
+        bits.write(z, 32);
+    }
+}
+
+static uint32_t
+riceRead(BitReader& bits, int k)
+{
+    int q = bits.readUnary(RICE_ESCAPE);
+    if (q == RICE_ESCAPE)
+        return bits.read(32);
+    return (uint32_t(q) << k) | bits.read(k);
+}
+
+
+//- float prediction -----------------------------------------------------------
+
+///map float bit patterns to unsigned values of the same order
+static inline uint32_t
+floatToOrdered(float f)
+{
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(float));
+    return (bits & 0x80000000U) ? ~bits : (bits | 0x80000000U);
+}
+
+static inline float
+orderedToFloat(uint32_t u)
+{
+    uint32_t bits = (u & 0x80000000U) ? (u & 0x7FFFFFFFU) : ~u;
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
+
+///median edge detection predictor (see LOCO-I)
+static inline uint32_t
+predict(const uint32_t* cur, const uint32_t* prev, int x)
+{
+    if (prev == NULL)
+        return x>0 ? cur[x-1] : 0;
+    if (x == 0)
+        return prev[0];
+
+    uint32_t a = cur[x-1];
+    uint32_t b = prev[x];
+    uint32_t c = prev[x-1];
+    if (c >= std::max(a, b))
+        return std::min(a, b);
+    if (c <= std::min(a, b))
+        return std::max(a, b);
+    //c lies between a and b, thus a+b-c does as well
+    return uint32_t(int64_t(a) + int64_t(b) - int64_t(c));
+}
+
+
+//- TileCodecBase --------------------------------------------------------------
+
+void TileCodecBase::
+decode(const uint8_t* encoded, size_t encodedSize, int width, int height,
+       size_t pixelSize, void* pixels)
+{
+    if (encodedSize < 1)
+        Misc::throwStdErr("TileCodec: empty tile encoding");
+
+    size_t numPixels = size_t(width) * size_t(height);
+    size_t rawSize   = numPixels * pixelSize;
+    const uint8_t* data = encoded + 1;
+    size_t dataSize     = encodedSize - 1;
+
+    switch (encoded[0])
+    {
+        case CODEC_RAW:
+        {
+            if (dataSize != rawSize)
+                Misc::throwStdErr("TileCodec: raw tile size mismatch");
+            memcpy(pixels, data, rawSize);
+            break;
+        }
+
+        case CODEC_DELTA_LZ:
+        {
+            Bytes planes(rawSize);
+            if (rawSize > 0)
+                lzDecompress(data, dataSize, &planes[0], rawSize);
+
+            //undo the row deltas and interleave the byte planes again
+            uint8_t* out = static_cast<uint8_t*>(pixels);
+            const uint8_t* plane = planes.empty() ? NULL : &planes[0];
+            for (size_t b=0; b<pixelSize; ++b)
+            {
+                for (int y=0; y<height; ++y)
+                {
+                    uint8_t value = 0;
+                    uint8_t* dst  = out + size_t(y)*width*pixelSize + b;
+                    for (int x=0; x<width; ++x, ++plane, dst+=pixelSize)
+                    {
+                        value += *plane;
+                        *dst   = value;
+                    }
+                }
+            }
+            break;
+        }
+
+        case CODEC_PREDICTIVE_FLOAT:
+        {
+            if (pixelSize != sizeof(float))
+            {
+                Misc::throwStdErr("TileCodec: predictive float codec used for "
+                                  "%d byte pixels", int(pixelSize));
+            }
+
+            float* out = static_cast<float*>(pixels);
+            std::vector<uint32_t> rows(2*width);
+            uint32_t* prev = NULL;
+            uint32_t* cur  = &rows[0];
+            BitReader bits(data, dataSize);
+            for (int y=0; y<height; ++y)
+            {
+                int k = int(bits.read(5));
+                for (int x=0; x<width; ++x)
+                {
+                    uint32_t z = riceRead(bits, k);
+                    cur[x]     = predict(cur, prev, x) + unzigzag(z);
+                    *out++     = orderedToFloat(cur[x]);
+                }
+                prev = cur;
+                cur  = &rows[0]==cur ? &rows[width] : &rows[0];
+            }
+            break;
+        }
+
+        default:
+            Misc::throwStdErr("TileCodec: unknown codec %d", int(encoded[0]));
+    }
+}
+
+void TileCodecBase::
+encodeDeltaLz(const uint8_t* pixels, int width, int height, size_t pixelSize,
+              Bytes& encoded)
+{
+    //separate the bytes of the pixels into planes of row deltas
+    Bytes planes;
+    planes.reserve(size_t(width)*height*pixelSize);
+    for (size_t b=0; b<pixelSize; ++b)
+    {
+        for (int y=0; y<height; ++y)
+        {
+            uint8_t prev = 0;
+            const uint8_t* src = pixels + size_t(y)*width*pixelSize + b;
+            for (int x=0; x<width; ++x, src+=pixelSize)
+            {
+                planes.push_back(uint8_t(*src - prev));
+                prev = *src;
+            }
+        }
+    }
+
+    encoded.clear();
+    encoded.push_back(CODEC_DELTA_LZ);
+    if (!planes.empty())
+        lzCompress(&planes[0], planes.size(), encoded);
+}
+
+void TileCodecBase::
+encodePredictiveFloat(const float* pixels, int width, int height,
+                      Bytes& encoded)
+{
+    encoded.clear();
+    encoded.push_back(CODEC_PREDICTIVE_FLOAT);
+
+    std::vector<uint32_t> rows(2*width);
+    std::vector<uint32_t> residuals(width);
+    uint32_t* prev = NULL;
+    uint32_t* cur  = &rows[0];
+    BitWriter bits(encoded);
+    for (int y=0; y<height; ++y)
+    {
+        for (int x=0; x<width; ++x)
+            cur[x] = floatToOrdered(*pixels++);
+        for (int x=0; x<width; ++x)
+            residuals[x] = zigzag(cur[x] - predict(cur, prev, x));
+
+        //pick the Rice parameter that minimizes the size of the row
+        int bestK    = 0;
+        int bestCost = -1;
+        for (int k=0; k<32; ++k)
+        {
+            int cost = 0;
+            for (int x=0; x<width; ++x)
+                cost += riceCost(residuals[x], k);
+            if (bestCost<0 || cost<bestCost)
+            {
+                bestK    = k;
+                bestCost = cost;
+            }
+        }
+
+        bits.write(uint32_t(bestK), 5);
+        for (int x=0; x<width; ++x)
+            riceWrite(bits, residuals[x], bestK);
+
+        prev = cur;
+        cur  = &rows[0]==cur ? &rows[width] : &rows[0];
+    }
+    bits.flush();
+}
+
+void TileCodecBase::
+finalize(const uint8_t* pixels, size_t rawSize, Bytes& encoded)
+{
+    if (encoded.size() <= rawSize)
+        return;
+
+    encoded.clear();
+    encoded.push_back(CODEC_RAW);
+    encoded.insert(encoded.end(), pixels, pixels+rawSize);
+}
+
+
+} //namespace crusta
@@ -0,0 +1,81 @@
+#ifndef _TileCodec_H_
+#define _TileCodec_H_
+
+
+#include <crustacore/basics.h>
+
+
+namespace crusta {
+
+
+/** Lossless codecs for the pixels of the tiles stored in compressed quadtree
+    files. An encoded tile starts with a byte identifying the codec that was
+    used, such that the decoder doesn't need to know how the tile was
+    written. */
+class TileCodecBase
+{
+public:
+    typedef std::vector<uint8_t> Bytes;
+
+    enum Codec
+    {
+        ///pixels stored verbatim
+        CODEC_RAW = 0,
+        ///byte planes, row deltas and LZ block compression
+        CODEC_DELTA_LZ,
+        ///median-predicted float residuals, Rice coded
+        CODEC_PREDICTIVE_FLOAT
+    };
+
+    /** decode a tile of the given size. Throws if the encoded data is
+        corrupt */
+    static void decode(const uint8_t* encoded, size_t encodedSize, int width,
+                       int height, size_t pixelSize, void* pixels);
+
+protected:
+    /** encode pixels of arbitrary type as byte planes with row deltas that are
+        then LZ compressed */
+    static void encodeDeltaLz(const uint8_t* pixels, int width, int height,
+                              size_t pixelSize, Bytes& encoded);
+    ///encode single precision float pixels using the predictive codec
+    static void encodePredictiveFloat(const float* pixels, int width,
+                                      int height, Bytes& encoded);
+    ///fall back to the raw encoding if compression didn't pay off
+    static void finalize(const uint8_t* pixels, size_t rawSize,
+                         Bytes& encoded);
+};
+
+/** Codec selection by pixel type. Generic pixels use the delta/LZ codec; the
+    specializations below provide better suited codecs */
+template <typename PixelType>
+class TileCodec : public TileCodecBase
+{
+public:
+    ///encode a tile of the given size
+    static void encode(const PixelType* pixels, int width, int height,
+                       Bytes& encoded)
+    {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(pixels);
+        encodeDeltaLz(bytes, width, height, sizeof(PixelType), encoded);
+        finalize(bytes, width*height*sizeof(PixelType), encoded);
+    }
+};
+
+template <>
+class TileCodec<float> : public TileCodecBase
+{
+public:
+    static void encode(const float* pixels, int width, int height,
+                       Bytes& encoded)
+    {
+        encodePredictiveFloat(pixels, width, height, encoded);
+        finalize(reinterpret_cast<const uint8_t*>(pixels),
+                 width*height*sizeof(float), encoded);
+    }
+};
+
+
+} //namespace crusta
+
+
+#endif //_TileCodec_H_
@@ -9,3 +9,6 @@
 #include <Misc/LargeFile.h>
 #include <Misc/StandardValueCoders.h>
 #include <Misc/ThrowStdErr.h>
+#include <Threads/Cond.h>
+#include <Threads/Mutex.h>
+#include <Threads/Thread.h>
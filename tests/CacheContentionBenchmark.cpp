@@ -0,0 +1,146 @@
+/* Throughput of the render thread touching the nodes of its representation
+   while fetch threads look up, grab and release buffers of the same cache.
+   Reports the touches per second for an increasing number of fetch threads */
+
+#include <iostream>
+#include <vector>
+
+#include <Threads/Thread.h>
+
+#include <crusta/Cache.h>
+#include <crusta/Timer.h>
+
+
+namespace crusta {
+
+#if CRUSTA_ENABLE_DEBUG
+int CRUSTA_DEBUG_LEVEL_MIN = CRUSTA_DEBUG_LEVEL_MIN_VALUE;
+int CRUSTA_DEBUG_LEVEL_MAX = CRUSTA_DEBUG_LEVEL_MAX_VALUE;
+#endif //CRUSTA_ENABLE_DEBUG
+
+FrameStamp CURRENT_FRAME(0.00000001);
+FrameStamp LAST_FRAME(0.0);
+
+} //namespace crusta
+
+
+using namespace crusta;
+
+typedef CacheBuffer<int>  Buffer;
+typedef CacheUnit<Buffer> Cache;
+
+static const int CACHE_SIZE   = 4096;
+static const int NUM_VISIBLE  = 1024;
+static const int NUM_FRAMES   = 200;
+///the representation is traversed several times per frame (split, draw, ...)
+static const int NUM_PASSES   = 8;
+static const int MAX_FETCHERS = 4;
+
+static Cache cache;
+static bool  terminateFetch = false;
+
+/** loads nodes that are not part of the representation, the way the fetch
+    threads do. Each fetcher has its own set of indices, such that no two of
+    them load the same node */
+struct Fetcher
+{
+    Fetcher() :
+        id(0), numLoads(0), randomState(0)
+    {
+    }
+
+    void* run()
+    {
+        randomState = 777 + id;
+        while (!__atomic_load_n(&terminateFetch, __ATOMIC_ACQUIRE))
+        {
+            randomState = randomState*1664525u + 1013904223u;
+            uint64_t key = (randomState>>8)%100000 * MAX_FETCHERS + id;
+            DataIndex index(0, TreeIndex(1, 0, 20, key));
+
+            if (cache.find(index) != NULL)
+                continue;
+            Buffer* buffer = cache.grabBuffer(LAST_FRAME);
+            if (buffer != NULL)
+            {
+                cache.releaseBuffer(index, buffer);
+                ++numLoads;
+            }
+        }
+        return NULL;
+    }
+
+    int      id;
+    uint64_t numLoads;
+    uint32_t randomState;
+};
+
+int main()
+{
+    cache.init("Benchmark", CACHE_SIZE);
+
+    //load the representation
+    std::vector<Buffer*> visible(NUM_VISIBLE);
+    for (int i=0; i<NUM_VISIBLE; ++i)
+    {
+        visible[i] = cache.grabBuffer(CURRENT_FRAME);
+        cache.releaseBuffer(DataIndex(0, TreeIndex(0, 0, 10, i)), visible[i]);
+    }
+
+    bool success = true;
+    for (int numFetchers=0; numFetchers<=MAX_FETCHERS;
+         numFetchers = numFetchers==0 ? 1 : 2*numFetchers)
+    {
+        __atomic_store_n(&terminateFetch, false, __ATOMIC_RELEASE);
+        Fetcher         fetchers[MAX_FETCHERS];
+        Threads::Thread threads[MAX_FETCHERS];
+        for (int f=0; f<numFetchers; ++f)
+        {
+            fetchers[f].id = f;
+            threads[f].start(&fetchers[f], &Fetcher::run);
+        }
+
+        Timer timer;
+        timer.start();
+        for (int frame=0; frame<NUM_FRAMES; ++frame)
+        {
+            LAST_FRAME     = CURRENT_FRAME;
+            CURRENT_FRAME += 1.0;
+            for (int pass=0; pass<NUM_PASSES; ++pass)
+            {
+                for (int i=0; i<NUM_VISIBLE; ++i)
+                    cache.touch(visible[i]);
+            }
+        }
+        timer.stop();
+
+        __atomic_store_n(&terminateFetch, true, __ATOMIC_RELEASE);
+        uint64_t numLoads = 0;
+        for (int f=0; f<numFetchers; ++f)
+        {
+            threads[f].join();
+            numLoads += fetchers[f].numLoads;
+        }
+
+        double numTouches = double(NUM_FRAMES) * NUM_PASSES * NUM_VISIBLE;
+        std::cout << numFetchers << " fetch threads: " <<
+                     numTouches / timer.seconds() * 1e-6 << " Mtouches/s, " <<
+                     double(numLoads) / timer.seconds() << " loads/s" <<
+                     std::endl;
+
+        //the representation must have survived the loads
+        for (int i=0; i<NUM_VISIBLE; ++i)
+        {
+            DataIndex index(0, TreeIndex(0, 0, 10, i));
+            if (cache.find(index)!=visible[i] || !cache.isCurrent(visible[i]))
+            {
+                std::cerr << "node " << i << " of the representation was "
+                             "recycled" << std::endl;
+                success = false;
+                break;
+            }
+        }
+    }
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,98 @@
+/* Checks the accumulation and merging of the construo counters and their JSON
+   report, and measures the overhead the stage timers add to every timed
+   stage of an update */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include <construo/ConstruoStats.h>
+#include <crusta/Timer.h>
+
+
+using namespace crusta;
+
+static const int NUM_TIMED = 1000000;
+
+static bool
+check(bool condition, const char* message)
+{
+    if (!condition)
+        std::cerr << message << std::endl;
+    return condition;
+}
+
+static bool
+contains(const std::string& json, const char* text)
+{
+    if (json.find(text) != std::string::npos)
+        return true;
+    std::cerr << "the report lacks " << text << std::endl;
+    return false;
+}
+
+int main()
+{
+    bool success = true;
+
+    //two workers' worth of counters
+    ConstruoStats first;
+    first.add(ConstruoStats::STAGE_READ_IMAGE, 0.5, 1024*1024);
+    first.add(ConstruoStats::STAGE_WRITE_TILE, 0.25, 2*1024*1024);
+    first.addSourced(3, 0.125);
+    first.addSourced(3, 0.125);
+
+    ConstruoStats second;
+    second.add(ConstruoStats::STAGE_READ_IMAGE, 1.5, 1024*1024);
+    second.addSourced(5, 0.5);
+    second.addResampled(2, 0.25);
+
+    success &= check(first.getNumTiles()==2 && second.getNumTiles()==2,
+                     "tiles of the workers are miscounted");
+    first.merge(second);
+    success &= check(first.getNumTiles() == 4,
+                     "merged tiles are miscounted");
+
+    std::ostringstream os;
+    first.writeJson(os, 2.0);
+    std::string json = os.str();
+    success &= contains(json, "\"seconds\": 2.000000,");
+    success &= contains(json, "\"tilesSourced\": 3,");
+    success &= contains(json, "\"tilesResampled\": 1,");
+    success &= contains(json, "\"tilesPerSecond\": 2.000000,");
+    success &= contains(json, "\"mbRead\": 2.000000,");
+    success &= contains(json, "\"mbWritten\": 2.000000,");
+    success &= contains(json, "\"readImage\": { \"count\": 2, \"seconds\": "
+                              "2.000000, \"mb\": 2.000000 }");
+    success &= contains(json, "\"writeTile\": { \"count\": 1,");
+    success &= contains(json, "{ \"level\": 3, \"sourced\": 2, "
+                              "\"sourceSeconds\": 0.250000, \"resampled\": 0,");
+    success &= contains(json, "{ \"level\": 5, \"sourced\": 1,");
+    success &= contains(json, "{ \"level\": 2, \"sourced\": 0, "
+                              "\"sourceSeconds\": 0.000000, \"resampled\": 1,");
+    success &= check(json[0]=='{' && json.substr(json.size()-2)=="}\n",
+                     "the report isn't a single object");
+
+    first.reset();
+    success &= check(first.getNumTiles() == 0, "reset kept the tiles");
+
+    //the overhead of timing a stage
+    ConstruoStats timed;
+    Timer timer;
+    timer.start();
+    for (int i=0; i<NUM_TIMED; ++i)
+    {
+        ConstruoStats::ScopedTimer stage(timed, ConstruoStats::STAGE_FILTER);
+    }
+    timer.stop();
+
+    std::ostringstream timedOs;
+    timed.writeJson(timedOs, 1.0);
+    success &= contains(timedOs.str(), "\"filter\": { \"count\": 1000000,");
+
+    std::cout << "stage timer overhead: " <<
+                 timer.seconds() / NUM_TIMED * 1e9 << " ns per timed stage" <<
+                 std::endl;
+
+    return success ? 0 : 1;
+}
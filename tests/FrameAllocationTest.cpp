@@ -0,0 +1,134 @@
+/* Checks that the per-frame assembly of the surface representation doesn't
+   allocate once its containers have grown to size: the nodes are touched,
+   their data bundles retrieved from the cached buffers through
+   DataManager::getData and added to the SurfaceApproximation, as the
+   traversal does every frame */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+#include <crusta/CrustaSettings.h>
+#include <crusta/DataManager.h>
+#include <crusta/QuadCache.h>
+#include <crusta/SurfaceApproximation.h>
+
+
+using namespace crusta;
+
+static size_t numAllocations = 0;
+
+void* operator new(size_t size)
+{
+    ++numAllocations;
+    void* ptr = malloc(size!=0 ? size : 1);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr)
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t)
+{
+    free(ptr);
+}
+
+static const int NUM_NODES        = 64;
+static const int NUM_COLOR_LAYERS = 2;
+static const int NUM_FLOAT_LAYERS = 3;
+static const int NUM_FRAMES       = 100;
+
+/** provide a buffer of the cache with the data of the given index, as the
+    fetch threads do */
+template <typename CacheParam>
+static typename CacheParam::BufferType*
+load(CacheParam& cache, const DataIndex& index)
+{
+    typename CacheParam::BufferType* buffer = cache.grabBuffer(CURRENT_FRAME);
+    if (buffer != NULL)
+        cache.releaseBuffer(index, buffer);
+    return buffer;
+}
+
+static bool
+check(bool condition, const char* message)
+{
+    if (!condition)
+        std::cerr << message << std::endl;
+    return condition;
+}
+
+int main()
+{
+    SETTINGS = new CrustaSettings;
+    SETTINGS->cacheMainNodeSize     = NUM_NODES;
+    SETTINGS->cacheMainGeometrySize = NUM_NODES;
+    SETTINGS->cacheMainColorSize    = NUM_NODES * NUM_COLOR_LAYERS;
+    SETTINGS->cacheMainLayerfSize   = NUM_NODES * (1+NUM_FLOAT_LAYERS);
+    CACHE       = new Cache;
+    DATAMANAGER = new DataManager;
+
+    MainCache& mc = CACHE->getMainCache();
+
+    bool success = true;
+    std::vector<NodeMainBuffer> buffers(NUM_NODES);
+    for (int i=0; i<NUM_NODES; ++i)
+    {
+        TreeIndex       index(0, 0, 3, i);
+        NodeMainBuffer& buffer = buffers[i];
+
+        buffer.node     = load(mc.node,     DataIndex(0,index));
+        buffer.geometry = load(mc.geometry, DataIndex(0,index));
+        buffer.height   = load(mc.layerf,   DataIndex(0,index));
+        for (int l=0; l<NUM_COLOR_LAYERS; ++l)
+            buffer.colors.push_back(load(mc.color, DataIndex(l,index)));
+        for (int l=0; l<NUM_FLOAT_LAYERS; ++l)
+            buffer.layers.push_back(load(mc.layerf, DataIndex(l+1,index)));
+
+        success &= check(DATAMANAGER->isComplete(buffer),
+                         "unable to load the nodes");
+    }
+    if (!success)
+        return 1;
+
+    SurfaceApproximation surface;
+    size_t allocationsBefore = numAllocations;
+    for (int frame=0; frame<NUM_FRAMES; ++frame)
+    {
+        //the first frame grows the containers of the representation
+        if (frame == 1)
+            allocationsBefore = numAllocations;
+
+        LAST_FRAME     = CURRENT_FRAME;
+        CURRENT_FRAME += 1.0;
+
+        surface.clear();
+        for (int i=0; i<NUM_NODES; ++i)
+        {
+            DATAMANAGER->touch(buffers[i]);
+            surface.add(DATAMANAGER->getData(buffers[i]), i%3!=0);
+        }
+
+        const NodeMainData& node = surface.visible(0);
+        success &= check(surface.nodes.size()==size_t(NUM_NODES) &&
+                         node.node==&buffers[1].node->getData() &&
+                         node.colors.size()==size_t(NUM_COLOR_LAYERS) &&
+                         node.layers.size()==size_t(NUM_FLOAT_LAYERS) &&
+                         node.layers[2]==buffers[1].layers[2]->getData(),
+                         "representation doesn't match the nodes");
+    }
+
+    success &= check(numAllocations == allocationsBefore,
+                     "the frame assembly allocated memory");
+
+    delete DATAMANAGER;
+    delete CACHE;
+    delete SETTINGS;
+
+    return success ? 0 : 1;
+}
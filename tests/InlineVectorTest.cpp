@@ -0,0 +1,90 @@
+/* Checks the InlineVector operations used by the node data bundles, and that
+   none of them allocates */
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+
+#include <crusta/InlineVector.h>
+
+
+using namespace crusta;
+
+static size_t numAllocations = 0;
+
+void* operator new(size_t size)
+{
+    ++numAllocations;
+    void* ptr = malloc(size!=0 ? size : 1);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void* ptr)
+{
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t)
+{
+    free(ptr);
+}
+
+static bool
+check(bool condition, const char* message)
+{
+    if (!condition)
+        std::cerr << message << std::endl;
+    return condition;
+}
+
+int main()
+{
+    typedef InlineVector<int*, 8> Pointers;
+
+    int values[8];
+    for (int i=0; i<8; ++i)
+        values[i] = i;
+
+    size_t allocationsBefore = numAllocations;
+
+    bool success = true;
+    for (int round=0; round<1000; ++round)
+    {
+        Pointers pointers;
+        success &= check(pointers.empty() && pointers.capacity()==8,
+                         "new vector isn't empty");
+
+        pointers.push_back(&values[0]);
+        pointers.resize(5, &values[1]);
+        success &= check(pointers.size()==5 && pointers[0]==&values[0] &&
+                         pointers[4]==&values[1], "resize failed");
+
+        for (int i=0; i<5; ++i)
+            pointers[i] = &values[i];
+
+        Pointers copy(pointers);
+        Pointers assigned;
+        assigned = copy;
+        int sum = 0;
+        for (Pointers::const_iterator it=assigned.begin(); it!=assigned.end();
+             ++it)
+        {
+            sum += **it;
+        }
+        success &= check(assigned.size()==5 && sum==0+1+2+3+4,
+                         "copies don't match");
+
+        pointers.resize(2);
+        success &= check(pointers.size()==2 && copy.size()==5,
+                         "shrinking failed");
+        pointers.clear();
+        success &= check(pointers.empty(), "clear failed");
+    }
+
+    success &= check(numAllocations == allocationsBefore,
+                     "the vector allocated memory");
+
+    return success ? 0 : 1;
+}
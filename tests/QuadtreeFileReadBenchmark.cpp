@@ -0,0 +1,165 @@
+/* Throughput of random tile reads from an uncompressed globe file: positional
+   reads into a tile buffer, reads served from the memory mapping and
+   zero-copy access to the mapped pixels. Each is measured with the file
+   evicted from the page cache (cold) and after a first pass over it (warm) */
+
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+#include <vector>
+
+#include <crustacore/DemHeightGlobeData.h>
+#include <crusta/Timer.h>
+
+
+using namespace crusta;
+
+typedef GlobeData<DemHeight>::File File;
+typedef DemHeight::Type            Pixel;
+
+static const char*    FILE_NAME   = "QuadtreeFileReadBenchmark.qtf";
+static const uint32_t TILE_SIZE[2] = {65, 65};
+static const int      NUM_PIXELS  = 65*65;
+static const int      NUM_TILES   = 2048;
+
+enum Mode
+{
+    MODE_READ,
+    MODE_MAPPED_READ,
+    MODE_MAPPED_PIXELS
+};
+
+static uint32_t randomState = 1357;
+
+static uint32_t
+nextRandom(uint32_t range)
+{
+    randomState = randomState*1664525u + 1013904223u;
+    return (randomState>>8) % range;
+}
+
+static Pixel
+pixelValue(int tile, int pixel)
+{
+    return Pixel(tile) + Pixel(pixel)*0.25f;
+}
+
+static void
+createFile()
+{
+    File file(FILE_NAME, TILE_SIZE, true);
+
+    std::vector<Pixel> pixels(NUM_PIXELS);
+    for (int t=0; t<NUM_TILES; ++t)
+    {
+        for (int p=0; p<NUM_PIXELS; ++p)
+            pixels[p] = pixelValue(t, p);
+
+        File::TileHeader header;
+        header.range[0] = pixels.front();
+        header.range[1] = pixels.back();
+        TileIndex children[4] = {INVALID_TILEINDEX, INVALID_TILEINDEX,
+                                 INVALID_TILEINDEX, INVALID_TILEINDEX};
+
+        TileIndex tile = file.appendTile();
+        file.writeTile(tile, children, header, &pixels.front());
+    }
+}
+
+///drops the pages of the file from the page cache
+static void
+evictFile()
+{
+    int fd = open(FILE_NAME, O_RDONLY);
+    if (fd < 0)
+        return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+static bool
+benchmark(const char* name, Mode mode, const std::vector<TileIndex>& order,
+          bool cold)
+{
+    if (cold)
+        evictFile();
+
+    File file(FILE_NAME, TILE_SIZE, false);
+    if (mode!=MODE_READ && !file.map(File::MAPPED_ACCESS_RANDOM))
+    {
+        std::cerr << name << ": unable to map the file" << std::endl;
+        return false;
+    }
+
+    std::vector<Pixel> pixels(NUM_PIXELS);
+    double sum = 0.0;
+    bool   success = true;
+
+    Timer timer;
+    timer.start();
+    for (size_t i=0; i<order.size(); ++i)
+    {
+        const Pixel* tile = NULL;
+        if (mode == MODE_MAPPED_PIXELS)
+        {
+            tile = file.getMappedPixels(order[i]);
+        }
+        else if (file.readTile(order[i], &pixels.front()))
+        {
+            tile = &pixels.front();
+        }
+
+        if (tile == NULL)
+        {
+            success = false;
+            break;
+        }
+        //touch every page of the tile, as the consumers of the pixels do
+        for (int p=0; p<NUM_PIXELS; p+=256)
+            sum += tile[p];
+        success &= tile[NUM_PIXELS-1] ==
+                   pixelValue(int(order[i]), NUM_PIXELS-1);
+    }
+    timer.stop();
+
+    if (!success)
+    {
+        std::cerr << name << ": tiles don't match the written ones" <<
+                     std::endl;
+        return false;
+    }
+
+    double seconds = timer.seconds();
+    double bytes   = double(order.size()) * NUM_PIXELS * sizeof(Pixel);
+    std::cout << name << (cold ? " (cold): " : " (warm): ") <<
+                 order.size()/seconds << " tiles/s, " <<
+                 bytes/seconds*1e-6 << " MB/s (checksum " << sum << ")" <<
+                 std::endl;
+    return true;
+}
+
+int main()
+{
+    unlink(FILE_NAME);
+    createFile();
+
+    //visit every tile once, in random order
+    std::vector<TileIndex> order(NUM_TILES);
+    for (int t=0; t<NUM_TILES; ++t)
+        order[t] = TileIndex(t);
+    for (int t=NUM_TILES-1; t>0; --t)
+        std::swap(order[t], order[nextRandom(t+1)]);
+
+    bool success = true;
+    for (int cold=1; cold>=0; --cold)
+    {
+        success &= benchmark("positional read", MODE_READ, order, cold!=0);
+        success &= benchmark("mapped read", MODE_MAPPED_READ, order, cold!=0);
+        success &= benchmark("mapped pixels", MODE_MAPPED_PIXELS, order,
+                             cold!=0);
+    }
+
+    unlink(FILE_NAME);
+    return success ? 0 : 1;
+}
@@ -0,0 +1,154 @@
+/* Stress test of the coalescing and the ordering of the pending child requests
+   against a straightforward model of the queue */
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+
+#include <crusta/RequestQueue.h>
+
+
+using namespace crusta;
+
+struct TestRequest
+{
+    float   lod;
+    uint8_t childMask;
+    bool    prefetch;
+};
+
+typedef RequestQueue<TestRequest> Queue;
+
+struct ModelEntry
+{
+    TestRequest request;
+    uint64_t    sequence;
+};
+typedef std::map<Queue::Key, ModelEntry> Model;
+
+static uint32_t randomState = 12345;
+
+static uint32_t
+nextRandom(uint32_t range)
+{
+    randomState = randomState*1664525u + 1013904223u;
+    return (randomState>>8) % range;
+}
+
+static float
+absolute(float value)
+{
+    return value<0.0f ? -value : value;
+}
+
+///whether entry a is served before entry b
+static bool
+ranksBefore(const ModelEntry& a, const ModelEntry& b)
+{
+    if (a.request.prefetch != b.request.prefetch)
+        return !a.request.prefetch;
+    if (absolute(a.request.lod) != absolute(b.request.lod))
+        return absolute(a.request.lod) < absolute(b.request.lod);
+    return a.sequence > b.sequence;
+}
+
+static Model::iterator
+findFirst(Model& model, bool last)
+{
+    Model::iterator best = model.begin();
+    for (Model::iterator it=model.begin(); it!=model.end(); ++it)
+    {
+        if (ranksBefore(it->second, best->second) != last)
+            best = it;
+    }
+    return best;
+}
+
+static void
+modelPush(Model& model, Queue::Key key, TestRequest request,
+          uint64_t sequence, size_t maxSize)
+{
+    Model::iterator dup = model.find(key);
+    if (dup != model.end())
+    {
+        const TestRequest& existing = dup->second.request;
+        request.lod        = std::min(request.lod, existing.lod);
+        request.childMask |= existing.childMask;
+        request.prefetch   = request.prefetch && existing.prefetch;
+    }
+    ModelEntry& entry = model[key];
+    entry.request  = request;
+    entry.sequence = sequence;
+
+    while (model.size() > maxSize)
+        model.erase(findFirst(model, true));
+}
+
+static bool
+check(bool condition, const char* message, int step)
+{
+    if (!condition)
+        std::cerr << "step " << step << ": " << message << std::endl;
+    return condition;
+}
+
+int main()
+{
+    static const int    NUM_STEPS = 200000;
+    static const int    NUM_KEYS  = 300;
+    static const size_t MAX_SIZE  = 64;
+
+    Queue    queue;
+    Model    model;
+    uint64_t sequence = 0;
+
+    for (int step=0; step<NUM_STEPS; ++step)
+    {
+        if (nextRandom(3) != 0)
+        {
+            //few distinct lods to exercise the ordering by sequence
+            Queue::Key key = nextRandom(NUM_KEYS);
+            TestRequest request;
+            request.lod       = float(int(nextRandom(16)) - 8) * 0.5f;
+            request.childMask = uint8_t(1 << nextRandom(4));
+            request.prefetch  = nextRandom(4) == 0;
+
+            queue.push(key, request, MAX_SIZE);
+            modelPush(model, key, request, sequence++, MAX_SIZE);
+        }
+        else if (!model.empty())
+        {
+            Model::iterator expected = findFirst(model, false);
+
+            Queue::Key key;
+            TestRequest request = queue.pop(key);
+            if (!check(key==expected->first, "wrong request served", step) ||
+                !check(request.lod==expected->second.request.lod &&
+                       request.childMask==expected->second.request.childMask &&
+                       request.prefetch==expected->second.request.prefetch,
+                       "requests not merged", step))
+            {
+                return 1;
+            }
+            model.erase(expected);
+        }
+
+        if (!check(queue.size()==model.size(), "size mismatch", step))
+            return 1;
+    }
+
+    //drain the remaining requests in order
+    while (!model.empty())
+    {
+        Model::iterator expected = findFirst(model, false);
+        Queue::Key key;
+        queue.pop(key);
+        if (!check(key==expected->first, "wrong request drained", NUM_STEPS))
+            return 1;
+        model.erase(expected);
+    }
+    if (!check(queue.empty(), "requests left over", NUM_STEPS))
+        return 1;
+
+    return 0;
+}
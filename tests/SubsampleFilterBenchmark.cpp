@@ -0,0 +1,150 @@
+/* Time per tile of the separable lanczos5 subsampling against the per pixel
+   lookups it replaces, for the float (topography, float layers) and color
+   pixel types. The domains are random with scattered nodata pixels and a
+   nodata hole. The separable results must match the per pixel ones */
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <construo/SubsampleFilter.h>
+#include <crustacore/GlobeData.h>
+#include <crusta/Timer.h>
+
+
+using namespace crusta;
+
+static const size_t TILE_SIZE[2] = {65, 65};
+static const int    NUM_PIXELS  = 65*65;
+///the subsampling domain spans the tile and its neighbors
+static const int    DOMAIN_SIZE = 4*65 - 3;
+static const int    NUM_ROUNDS  = 50;
+
+static uint32_t randomState = 8642;
+
+static uint32_t
+nextRandom(uint32_t range)
+{
+    randomState = randomState*1664525u + 1013904223u;
+    return (randomState>>8) % range;
+}
+
+static DemHeight::Type
+makeHeight(const DemHeight::Type& nodata)
+{
+    return nextRandom(10)==0 ? nodata : DemHeight::Type(nextRandom(10000))/7.0f;
+}
+
+static TextureColor::Type
+makeColor(const TextureColor::Type& nodata)
+{
+    if (nextRandom(10) == 0)
+        return nodata;
+    return TextureColor::Type(nextRandom(256), nextRandom(256),
+                              nextRandom(256));
+}
+
+///the values must be within relative precision and agree on nodata
+static bool
+matches(const DemHeight::Type& a, const DemHeight::Type& b,
+        const DemHeight::Type& nodata)
+{
+    if ((a==nodata) != (b==nodata))
+        return false;
+    return a==nodata ||
+           std::fabs(a-b) <= 1e-5 * std::max(1.0f, std::fabs(b));
+}
+
+///the channels may differ by one from rounding
+static bool
+matches(const TextureColor::Type& a, const TextureColor::Type& b,
+        const TextureColor::Type&)
+{
+    for (int c=0; c<3; ++c)
+    {
+        if (std::abs(int(a[c]) - int(b[c])) > 1)
+            return false;
+    }
+    return true;
+}
+
+template <typename PixelType>
+static bool
+benchmark(const char* name, PixelType (*makePixel)(const PixelType&),
+          const PixelType& nodata)
+{
+    typedef SubsampleTileFilter<PixelType, SUBSAMPLEFILTER_LANCZOS5> Separable;
+    typedef SubsampleFilter<PixelType, SUBSAMPLEFILTER_LANCZOS5>     PerPixel;
+
+    std::vector<PixelType> domain(DOMAIN_SIZE*DOMAIN_SIZE, nodata);
+    for (int y=0; y<DOMAIN_SIZE; ++y)
+    {
+        for (int x=0; x<DOMAIN_SIZE; ++x)
+        {
+            domain[y*DOMAIN_SIZE + x] = x>=100 && x<140 ? nodata :
+                                                           makePixel(nodata);
+        }
+    }
+    //the tile starts at the center of the domain
+    PixelType* at = &domain[(TILE_SIZE[1]-1)*DOMAIN_SIZE + (TILE_SIZE[0]-1)];
+
+    std::vector<double>    scratch(Separable::scratchSize(TILE_SIZE));
+    std::vector<PixelType> separable(NUM_PIXELS, nodata);
+    std::vector<PixelType> perPixel(NUM_PIXELS, nodata);
+
+    Timer separableTimer;
+    separableTimer.start();
+    for (int round=0; round<NUM_ROUNDS; ++round)
+    {
+        Separable::sample(at, DOMAIN_SIZE, TILE_SIZE, &separable.front(),
+                          nodata, &scratch.front());
+    }
+    separableTimer.stop();
+
+    Timer perPixelTimer;
+    perPixelTimer.start();
+    for (int round=0; round<NUM_ROUNDS; ++round)
+    {
+        for (size_t y=0; y<TILE_SIZE[1]; ++y)
+        {
+            for (size_t x=0; x<TILE_SIZE[0]; ++x)
+            {
+                perPixel[y*TILE_SIZE[0] + x] = PerPixel::sample(
+                    at + 2*y*DOMAIN_SIZE + 2*x, DOMAIN_SIZE, nodata);
+            }
+        }
+    }
+    perPixelTimer.stop();
+
+    int numMismatches = 0;
+    for (int i=0; i<NUM_PIXELS; ++i)
+    {
+        if (!matches(separable[i], perPixel[i], nodata))
+            ++numMismatches;
+    }
+    if (numMismatches != 0)
+    {
+        std::cerr << name << ": " << numMismatches << " pixels differ from "
+                     "the per pixel lookups" << std::endl;
+        return false;
+    }
+
+    double separableMs = separableTimer.seconds() * 1000.0 / NUM_ROUNDS;
+    double perPixelMs  = perPixelTimer.seconds()  * 1000.0 / NUM_ROUNDS;
+    std::cout << name << ": separable " << separableMs << " ms/tile, per "
+                 "pixel " << perPixelMs << " ms/tile (speedup " <<
+                 perPixelMs/separableMs << ")" << std::endl;
+    return true;
+}
+
+int main()
+{
+    bool success = true;
+    success &= benchmark("float", &makeHeight,
+                         GlobeData<DemHeight>::defaultNodata());
+    success &= benchmark("color", &makeColor,
+                         GlobeData<TextureColor>::defaultNodata());
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+/* Compression ratio and throughput of the tile codecs for the pixel types of
+   the globe files, over synthetic tiles resembling their typical content:
+   rough terrain, imagery and a layer with large nodata areas */
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <crustacore/DemHeight.h>
+#include <crustacore/LayerData.h>
+#include <crustacore/TextureColor.h>
+#include <crustacore/TileCodec.h>
+#include <crusta/Timer.h>
+
+
+using namespace crusta;
+
+static const int TILE_SIZE  = 65;
+static const int NUM_PIXELS = TILE_SIZE*TILE_SIZE;
+static const int NUM_TILES  = 200;
+static const int NUM_ROUNDS = 5;
+
+static uint32_t randomState = 2468;
+
+static uint32_t
+nextRandom(uint32_t range)
+{
+    randomState = randomState*1664525u + 1013904223u;
+    return (randomState>>8) % range;
+}
+
+///smooth relief with small scale roughness, at decimeter resolution
+static void
+makeHeightTile(int tile, DemHeight::Type* pixels)
+{
+    for (int y=0; y<TILE_SIZE; ++y)
+    {
+        for (int x=0; x<TILE_SIZE; ++x)
+        {
+            float height = 800.0f*std::sin(x*0.05f + tile)*std::cos(y*0.04f) +
+                           30.0f*std::sin(x*0.3f)*std::sin(y*0.25f + tile) +
+                           float(nextRandom(5));
+            pixels[y*TILE_SIZE + x] = std::floor(height*10.0f) * 0.1f;
+        }
+    }
+}
+
+///imagery: smooth color gradients with sensor noise
+static void
+makeColorTile(int tile, TextureColor::Type* pixels)
+{
+    for (int y=0; y<TILE_SIZE; ++y)
+    {
+        for (int x=0; x<TILE_SIZE; ++x)
+        {
+            TextureColor::Type& pixel = pixels[y*TILE_SIZE + x];
+            for (int c=0; c<3; ++c)
+            {
+                int value = 60 + c*40 + (x+tile)%64 + y/2 + int(nextRandom(8));
+                pixel[c]  = uint8_t(value>255 ? 255 : value);
+            }
+        }
+    }
+}
+
+///a layer only defined over part of the tile, e.g., over land
+static void
+makeLayerfTile(int tile, LayerDataf::Type* pixels)
+{
+    const LayerDataf::Type nodata = LayerDataf::defaultNodata();
+    for (int y=0; y<TILE_SIZE; ++y)
+    {
+        for (int x=0; x<TILE_SIZE; ++x)
+        {
+            pixels[y*TILE_SIZE + x] = x+y < TILE_SIZE+tile%TILE_SIZE ? nodata :
+                0.25f*std::sin(x*0.1f) + 0.01f*float(nextRandom(100));
+        }
+    }
+}
+
+template <typename PixelType>
+static bool
+benchmark(const char* name, void (*makeTile)(int, PixelType*))
+{
+    typedef TileCodecBase::Bytes Bytes;
+
+    /* the codecs only see the bytes of the pixels. Keep them in plain byte
+       storage, as not all pixel types initialize their components */
+    const size_t tileBytes = NUM_PIXELS*sizeof(PixelType);
+    std::vector<uint8_t> tiles(NUM_TILES*tileBytes);
+    for (int t=0; t<NUM_TILES; ++t)
+        makeTile(t, reinterpret_cast<PixelType*>(&tiles[t*tileBytes]));
+
+    std::vector<Bytes> encoded(NUM_TILES);
+    Timer encodeTimer;
+    encodeTimer.start();
+    for (int t=0; t<NUM_TILES; ++t)
+    {
+        TileCodec<PixelType>::encode(
+            reinterpret_cast<const PixelType*>(&tiles[t*tileBytes]),
+            TILE_SIZE, TILE_SIZE, encoded[t]);
+    }
+    encodeTimer.stop();
+
+    std::vector<uint8_t> decoded(tiles.size());
+    Timer decodeTimer;
+    decodeTimer.start();
+    for (int round=0; round<NUM_ROUNDS; ++round)
+    {
+        for (int t=0; t<NUM_TILES; ++t)
+        {
+            TileCodecBase::decode(&encoded[t].front(), encoded[t].size(),
+                                  TILE_SIZE, TILE_SIZE, sizeof(PixelType),
+                                  &decoded[t*tileBytes]);
+        }
+    }
+    decodeTimer.stop();
+
+    if (tiles != decoded)
+    {
+        std::cerr << name << " tiles didn't survive the round trip" <<
+                     std::endl;
+        return false;
+    }
+
+    size_t rawBytes     = tiles.size();
+    size_t encodedBytes = 0;
+    for (int t=0; t<NUM_TILES; ++t)
+        encodedBytes += encoded[t].size();
+
+    std::cout << name << ": " << rawBytes << " bytes in, " << encodedBytes <<
+                 " bytes out (ratio " << double(rawBytes)/encodedBytes <<
+                 "), encode " << rawBytes/encodeTimer.seconds()*1e-6 <<
+                 " MB/s, decode " <<
+                 NUM_ROUNDS*rawBytes/decodeTimer.seconds()*1e-6 << " MB/s" <<
+                 std::endl;
+    return true;
+}
+
+int main()
+{
+    bool success = true;
+    success &= benchmark("DemHeight", &makeHeightTile);
+    success &= benchmark("TextureColor", &makeColorTile);
+    success &= benchmark("LayerDataf", &makeLayerfTile);
+
+    return success ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+/* Round trip of the tile codecs over tiles of the kinds found in globe files:
+   smooth terrain with nodata holes, constant and random tiles. The decoded
+   pixels must match the encoded ones bit for bit */
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <crustacore/TileCodec.h>
+
+
+using namespace crusta;
+
+///a three channel pixel, as used for the color tiles
+struct ColorPixel
+{
+    uint8_t channels[3];
+};
+
+static const int TILE_SIZE  = 65;
+static const int NUM_PIXELS = TILE_SIZE*TILE_SIZE;
+static const int NUM_KINDS  = 5;
+
+static uint32_t randomState = 4321;
+
+static uint32_t
+nextRandom()
+{
+    randomState = randomState*1664525u + 1013904223u;
+    return randomState;
+}
+
+static void
+makeFloatTile(int kind, std::vector<float>& tile)
+{
+    for (int y=0; y<TILE_SIZE; ++y)
+    {
+        for (int x=0; x<TILE_SIZE; ++x)
+        {
+            float& value = tile[y*TILE_SIZE + x];
+            switch (kind)
+            {
+                case 0: //smooth terrain
+                    value = 1000.0f*std::sin(x*0.1f)*std::cos(y*0.07f);
+                    break;
+                case 1: //terrain with nodata holes
+                    value = (nextRandom()>>8)%7==0 ? -4.2949673e9f :
+                                                      300.0f + x + 0.5f*y;
+                    break;
+                case 2: //constant
+                    value = 0.0f;
+                    break;
+                case 3: //arbitrary bit patterns, including NaNs
+                {
+                    uint32_t bits = nextRandom();
+                    memcpy(&value, &bits, sizeof(value));
+                    break;
+                }
+                default: //noisy terrain
+                    value = float(x*y) + float((nextRandom()>>8)%1000)*0.001f;
+                    break;
+            }
+        }
+    }
+}
+
+static void
+makeColorTile(int kind, std::vector<ColorPixel>& tile)
+{
+    for (int i=0; i<NUM_PIXELS; ++i)
+    {
+        for (int c=0; c<3; ++c)
+        {
+            uint8_t& channel = tile[i].channels[c];
+            switch (kind)
+            {
+                case 0:  channel = uint8_t(i/TILE_SIZE + c);         break;
+                case 1:  channel = uint8_t((i%TILE_SIZE)*3 + c*40);  break;
+                case 2:  channel = 7;                                break;
+                case 3:  channel = uint8_t(nextRandom()>>16);        break;
+                default: channel = uint8_t(i*13 + c);                break;
+            }
+        }
+    }
+}
+
+template <typename PixelType>
+static bool
+roundTrip(const std::vector<PixelType>& tile, const char* name, int kind)
+{
+    TileCodecBase::Bytes encoded;
+    TileCodec<PixelType>::encode(&tile.front(), TILE_SIZE, TILE_SIZE,
+                                 encoded);
+
+    std::vector<PixelType> decoded(NUM_PIXELS);
+    TileCodecBase::decode(&encoded.front(), encoded.size(), TILE_SIZE,
+                          TILE_SIZE, sizeof(PixelType), &decoded.front());
+
+    if (memcmp(&tile.front(), &decoded.front(),
+               NUM_PIXELS*sizeof(PixelType)) != 0)
+    {
+        std::cerr << name << " tile of kind " << kind << " didn't survive "
+                     "the round trip" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main()
+{
+    std::vector<float>      floatTile(NUM_PIXELS);
+    std::vector<ColorPixel> colorTile(NUM_PIXELS);
+
+    bool success = true;
+    for (int i=0; i<100; ++i)
+    {
+        int kind = i % NUM_KINDS;
+        makeFloatTile(kind, floatTile);
+        success &= roundTrip(floatTile, "float", kind);
+        makeColorTile(kind, colorTile);
+        success &= roundTrip(colorTile, "color", kind);
+    }
+
+    return success ? 0 : 1;
+}